@@ -0,0 +1,136 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+Benchmark::Benchmark(const Options &options) : m_options(options) {
+}
+
+const Benchmark::Options &Benchmark::getOptions() const {
+    return m_options;
+}
+
+bool Benchmark::isSelected(const std::string &name) const {
+    return m_options.filter.empty() || name.find(m_options.filter) != std::string::npos;
+}
+
+Benchmark::Result &Benchmark::addResult(const std::string &name, size_t itemCount, uint64_t iterations, std::vector<double> &samples) {
+    std::sort(samples.begin(), samples.end());
+
+    Result &result = m_results.emplace_back();
+    result.name = name;
+    result.itemCount = itemCount;
+    result.iterations = iterations;
+    result.medianNanoseconds = samples[samples.size() / 2];
+    result.minNanoseconds = samples.front();
+    result.maxNanoseconds = samples.back();
+
+    fprintf(stderr, "%-48s %14.1f ns %12.2f ns/item\n", name.c_str(), result.medianNanoseconds, result.medianNanoseconds / std::max<size_t>(itemCount, 1));
+    return result;
+}
+
+void Benchmark::check(const std::string &name, double error, double tolerance) {
+    if (!isSelected(name)) {
+        return;
+    }
+
+    m_checks.push_back({ name, error, tolerance });
+    if (!(error <= tolerance)) {
+        fprintf(stderr, "CHECK FAILED: %s error %g > %g\n", name.c_str(), error, tolerance);
+    }
+}
+
+bool Benchmark::hasFailedChecks() const {
+    for (const Check &check : m_checks) {
+        if (!(check.error <= check.tolerance)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *getSimdName() {
+#if defined(XRMATRIX4X4F_SCALAR)
+    return "scalar";
+#elif defined(__AVX__)
+    return "avx";
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    return "sse2";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+static const char *getCompilerName() {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc";
+#else
+    return "unknown";
+#endif
+}
+
+// JSON has no NaN or infinity, e.g. a relative error over a zero timing or value is written as null
+static void writeNumber(FILE *file, const char *format, double value) {
+    if (std::isfinite(value)) {
+        fprintf(file, format, value);
+    }
+    else {
+        fprintf(file, "null");
+    }
+}
+
+// Names are plain ASCII without quotes or backslashes so no escaping needed, numbers go through writeNumber
+void Benchmark::writeJson(FILE *file) const {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"format_version\": 1,\n");
+    fprintf(file, "  \"compiler\": \"%s\",\n", getCompilerName());
+    fprintf(file, "  \"simd\": \"%s\",\n", getSimdName());
+    fprintf(file, "  \"sample_count\": %d,\n", m_options.sampleCount);
+
+    fprintf(file, "  \"benchmarks\": [");
+    for (size_t i = 0; i < m_results.size(); i++) {
+        const Result &result = m_results[i];
+        fprintf(file, "%s\n    {\n", i ? "," : "");
+        fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+        fprintf(file, "      \"items\": %zu,\n", result.itemCount);
+        fprintf(file, "      \"iterations\": %llu,\n", (unsigned long long)result.iterations);
+        fprintf(file, "      \"ns_per_iteration\": { \"median\": ");
+        writeNumber(file, "%.3f", result.medianNanoseconds);
+        fprintf(file, ", \"min\": ");
+        writeNumber(file, "%.3f", result.minNanoseconds);
+        fprintf(file, ", \"max\": ");
+        writeNumber(file, "%.3f", result.maxNanoseconds);
+        fprintf(file, " },\n      \"ns_per_item\": ");
+        writeNumber(file, "%.4f", result.medianNanoseconds / std::max<size_t>(result.itemCount, 1));
+        if (!result.counters.empty()) {
+            fprintf(file, ",\n      \"counters\": {");
+            for (size_t j = 0; j < result.counters.size(); j++) {
+                fprintf(file, "%s \"%s\": ", j ? "," : "", result.counters[j].first.c_str());
+                writeNumber(file, "%.6g", result.counters[j].second);
+            }
+            fprintf(file, " }");
+        }
+        fprintf(file, "\n    }");
+    }
+    fprintf(file, "\n  ],\n");
+
+    fprintf(file, "  \"checks\": [");
+    for (size_t i = 0; i < m_checks.size(); i++) {
+        const Check &check = m_checks[i];
+        fprintf(file, "%s\n    { \"name\": \"%s\", \"error\": ", i ? "," : "", check.name.c_str());
+        writeNumber(file, "%.6g", check.error);
+        fprintf(file, ", \"tolerance\": ");
+        writeNumber(file, "%.6g", check.tolerance);
+        fprintf(file, ", \"passed\": %s }", check.error <= check.tolerance ? "true" : "false");
+    }
+    fprintf(file, "\n  ]\n");
+    fprintf(file, "}\n");
+}
@@ -0,0 +1,109 @@
+#ifndef BENCH_BENCHMARK_H
+#define BENCH_BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Keeps the compiler from throwing away a computation whose result is never used
+template<typename T>
+inline void keep(const T &value) {
+#if defined(_MSC_VER)
+    static volatile const void *sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// Times callables until every sample takes long enough to trust the clock, collects the results and correctness checks
+// and writes all of them as one JSON document
+class Benchmark {
+public:
+    typedef struct Options {
+        std::string filter;
+        double sampleMilliseconds = 25.;
+        int sampleCount = 7;
+        size_t maxCubeCount = 1000000;
+    };
+
+    typedef struct Result {
+        std::string name;
+        // Items (matrices, samples, cubes...) processed per iteration
+        size_t itemCount;
+        uint64_t iterations;
+        double medianNanoseconds;
+        double minNanoseconds;
+        double maxNanoseconds;
+        std::vector<std::pair<std::string, double>> counters;
+    };
+
+    typedef struct Check {
+        std::string name;
+        double error;
+        double tolerance;
+    };
+
+    explicit Benchmark(const Options &options);
+
+    const Options &getOptions() const;
+    bool isSelected(const std::string &name) const;
+
+    // function runs one iteration, the returned result can get counters attached, nullptr if filtered out
+    template<typename Function>
+    Result *run(const std::string &name, size_t itemCount, Function &&function);
+
+    void check(const std::string &name, double error, double tolerance);
+    bool hasFailedChecks() const;
+
+    void writeJson(FILE *file) const;
+
+private:
+    Options m_options;
+    std::vector<Result> m_results;
+    std::vector<Check> m_checks;
+
+    Result &addResult(const std::string &name, size_t itemCount, uint64_t iterations, std::vector<double> &samples);
+};
+
+template<typename Function>
+Benchmark::Result *Benchmark::run(const std::string &name, size_t itemCount, Function &&function) {
+    if (!isSelected(name)) {
+        return nullptr;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    const double sampleNanoseconds = m_options.sampleMilliseconds * 1e6;
+
+    // Doubles the iterations until a sample is long enough, which also warms up caches and the branch predictor
+    uint64_t iterations = 1;
+    while (true) {
+        const Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            function();
+        }
+        const double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        if (elapsed >= sampleNanoseconds || iterations >= (1ull << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int sample = 0; sample < m_options.sampleCount; sample++) {
+        const Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            function();
+        }
+        samples.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / iterations);
+    }
+
+    return &addResult(name, itemCount, iterations, samples);
+}
+
+#endif //BENCH_BENCHMARK_H
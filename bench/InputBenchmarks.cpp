@@ -0,0 +1,141 @@
+#include "Suites.h"
+
+#include "vr/ColorWheel.h"
+#include "vr/HandInput.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+
+
+static const size_t SAMPLE_COUNT = 1024;
+static const float TWO_PI = 6.28318531f;
+
+typedef struct ThumbstickSample {
+    float x;
+    float y;
+    bool isClickStarted;
+} ThumbstickSample;
+
+// The stick pushed to the edge and turned around once, clicked a quarter of the way in, like picking a hue
+// and then shading it
+static std::vector<ThumbstickSample> createSamples() {
+    std::vector<ThumbstickSample> samples;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        const float angle = TWO_PI * i / SAMPLE_COUNT;
+        // Some samples inside the deadzone so the wheel gets reset too
+        const float radius = i % 64 < 4 ? 0.1f : 0.9f;
+        samples.push_back({ radius * cosf(angle), radius * sinf(angle), i % 256 == 64 });
+    }
+    return samples;
+}
+
+static double getError(const XrColor4f &color, const XrVector3f &scale, const XrColor4f &expectedColor, float expectedScale) {
+    double error = 0.;
+    for (double difference : { color.r - expectedColor.r, color.g - expectedColor.g, color.b - expectedColor.b,
+                               scale.x - expectedScale, scale.y - expectedScale, scale.z - expectedScale }) {
+        error = std::max(error, std::abs(difference));
+    }
+    return error;
+}
+
+void runInputBenchmarks(Benchmark &benchmark) {
+    const std::vector<ThumbstickSample> samples = createSamples();
+    std::vector<float> angles;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        angles.push_back(TWO_PI * i / SAMPLE_COUNT);
+    }
+
+    benchmark.run("input/color_wheel/hue", SAMPLE_COUNT, [&]() {
+        for (float angle : angles) {
+            const XrColor4f color = ColorWheel::getHue(angle);
+            keep(color);
+        }
+    });
+
+    const XrColor4f originalColor{ 0.8f, 0.4f, 0.2f, 1.f };
+    benchmark.run("input/color_wheel/shade", SAMPLE_COUNT, [&]() {
+        for (float angle : angles) {
+            const XrColor4f color = ColorWheel::getShade(originalColor, 1.f, angle);
+            keep(color);
+        }
+    });
+
+    // What pollActions runs per hand and sync
+    ColorWheel colorWheel;
+    XrColor4f color{ 1.f, 1.f, 1.f, 1.f };
+    benchmark.run("input/color_wheel/update", SAMPLE_COUNT, [&]() {
+        for (const ThumbstickSample &sample : samples) {
+            colorWheel.update(sample.x, sample.y, sample.isClickStarted, color);
+        }
+        keep(color);
+    });
+
+    // The same stick movement recorded as action snapshots, with the triggers and modifiers cycling through their
+    // combinations, what pollActions hands to HandInput per hand and frame
+    std::vector<HandInput::Snapshot> snapshots(SAMPLE_COUNT);
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        HandInput::Snapshot &snapshot = snapshots[i];
+        memset(&snapshot, 0, sizeof(snapshot));
+        auto setState = [&](HandInput::Action action, float value) {
+            HandInput::ActionState &state = snapshot.states[(int)action];
+            const float previousValue = i ? snapshots[i - 1].states[(int)action].value : 0.f;
+            state = { value, value != previousValue, (XrTime)i * 11111111 };
+        };
+
+        setState(HandInput::Action::PLACE, samples[i].isClickStarted ? 1.f : 0.f);
+        setState(HandInput::Action::REMOVE, samples[i].isClickStarted ? 1.f : 0.f);
+        setState(HandInput::Action::THUMBSTICK_X, samples[i].x);
+        setState(HandInput::Action::THUMBSTICK_Y, samples[i].y);
+        setState(HandInput::Action::EXPAND, i % 128 < 32 ? 0.5f : 0.f);
+        setState(HandInput::Action::SHRINK, i % 128 >= 96 ? 0.5f : 0.f);
+        setState(HandInput::Action::MODIFIER_XA, i % 512 >= 256 ? 1.f : 0.f);
+        setState(HandInput::Action::MODIFIER_YB, i % 256 >= 128 ? 1.f : 0.f);
+    }
+
+    HandInput handInput;
+    size_t placeCount = 0;
+    benchmark.run("input/hand/update", SAMPLE_COUNT, [&]() {
+        for (const HandInput::Snapshot &snapshot : snapshots) {
+            const HandInput::Commands commands = handInput.update(snapshot, snapshot);
+            placeCount += commands.isPlaceRequested;
+        }
+    });
+    keep(placeCount);
+
+    // Replaying the recording against what the rules make of it by hand. Every click lands in the deadzone: the ones
+    // at 64 and 576 place, the ones at 320 and 832 hold XA and remove instead. YB gets pressed at 128, 384, 640 and
+    // 896, with XA held at 384 and 896, which toggles the type
+    HandInput replayed;
+    std::vector<size_t> placeIndices;
+    std::vector<size_t> removeIndices;
+    std::vector<size_t> toggleIndices;
+    double placeError = 0.;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        const HandInput::Commands commands = replayed.update(snapshots[i], snapshots[i]);
+        if (commands.isPlaceRequested) {
+            placeIndices.push_back(i);
+            // Centered clicks don't start shading, the color is the hue of the sample before and the expand of the
+            // block's first 32 samples grew every axis by 32 * 0.5 * 0.0189
+            const XrColor4f expectedColor = i == 64 ? XrColor4f{ 0.434570f, 0.f, 0.565430f, 1.f } : XrColor4f{ 0.065430f, 0.934570f, 0.f, 1.f };
+            placeError = std::max(placeError, getError(commands.placeColor, commands.placeScale, expectedColor, 1.3024f));
+        }
+        if (commands.isRemoveRequested) {
+            removeIndices.push_back(i);
+        }
+        if (commands.isTypeToggled) {
+            toggleIndices.push_back(i);
+        }
+    }
+
+    const bool areCommandsExpected = placeIndices == std::vector<size_t>{ 64, 576 } && removeIndices == std::vector<size_t>{ 320, 832 } && toggleIndices == std::vector<size_t>{ 384, 896 };
+    benchmark.check("input/hand/commands", areCommandsExpected ? 0. : 1., 0.);
+    benchmark.check("input/hand/place", placeError, 1e-4);
+
+    // The last sample is a 1024th of a turn short of a full one, between blue at 11 / 6 pi and red at 1 / 2 pi that's
+    // r = 1 / 4 - 3 / 1024. Every block shrinks the axes it grew by as much, so the scale is back to 1
+    const double replayError = getError(replayed.getColor(), replayed.getScale(), XrColor4f{ 0.2470703f, 0.f, 0.7529297f, 1.f }, 1.f);
+    benchmark.check("input/hand/replay", replayError, 1e-4);
+}
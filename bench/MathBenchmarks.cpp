@@ -0,0 +1,169 @@
+#include "Suites.h"
+
+#include "vr/XrMatrix4x4f.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+
+static const size_t MATRIX_COUNT = 1024;
+// The kernels only reorder the same float operations, anything above a few ulps is a bug
+static const double TOLERANCE = 1e-5;
+
+typedef struct Inputs {
+    std::vector<XrVector3f> translations;
+    std::vector<XrQuaternionf> rotations;
+    std::vector<XrVector3f> scales;
+    std::vector<XrMatrix4x4f> matrices;
+    std::vector<XrMatrix4x4f> rigidBodies;
+} Inputs;
+
+static Inputs createInputs() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-10.f, 10.f);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> size(0.01f, 10.f);
+
+    Inputs inputs;
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        inputs.translations.push_back({ position(random), position(random), position(random) });
+        inputs.scales.push_back({ size(random), size(random), size(random) });
+
+        XrQuaternionf rotation{ unit(random), unit(random), unit(random), unit(random) };
+        const float length = sqrtf(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z + rotation.w * rotation.w);
+        rotation = { rotation.x / length, rotation.y / length, rotation.z / length, rotation.w / length };
+        inputs.rotations.push_back(rotation);
+
+        XrMatrix4x4f matrix;
+        XrMatrix4x4f::CreateTranslationRotationScaleScalar(&matrix, &inputs.translations[i], &rotation, &inputs.scales[i]);
+        inputs.matrices.push_back(matrix);
+
+        const XrVector3f unitScale{ 1.f, 1.f, 1.f };
+        XrMatrix4x4f::CreateTranslationRotationScaleScalar(&matrix, &inputs.translations[i], &rotation, &unitScale);
+        inputs.rigidBodies.push_back(matrix);
+    }
+
+    return inputs;
+}
+
+// Largest difference relative to the magnitude of the reference element, with 1 as the floor
+static double getError(const XrMatrix4x4f *results, const XrMatrix4x4f *references, size_t count) {
+    double error = 0.;
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < 16; j++) {
+            const double reference = references[i].m[j];
+            error = std::max(error, std::abs(results[i].m[j] - reference) / std::max(1., std::abs(reference)));
+        }
+    }
+    return error;
+}
+
+void runMathBenchmarks(Benchmark &benchmark) {
+    const Inputs inputs = createInputs();
+    std::vector<XrMatrix4x4f> results(MATRIX_COUNT);
+    std::vector<XrMatrix4x4f> references(MATRIX_COUNT);
+
+    const XrMatrix4x4f *matrices = inputs.matrices.data();
+    const XrMatrix4x4f *rigidBodies = inputs.rigidBodies.data();
+
+    // Multiply
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        XrMatrix4x4f::MultiplyScalar(&references[i], &matrices[i], &matrices[(i + 1) % MATRIX_COUNT]);
+        XrMatrix4x4f::Multiply(&results[i], &matrices[i], &matrices[(i + 1) % MATRIX_COUNT]);
+    }
+    benchmark.check("math/multiply", getError(results.data(), references.data(), MATRIX_COUNT), TOLERANCE);
+
+    benchmark.run("math/multiply/scalar", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::MultiplyScalar(&results[i], &matrices[i], &matrices[(i + 1) % MATRIX_COUNT]);
+        }
+        keep(results[0]);
+    });
+    benchmark.run("math/multiply/simd", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::Multiply(&results[i], &matrices[i], &matrices[(i + 1) % MATRIX_COUNT]);
+        }
+        keep(results[0]);
+    });
+
+    // MultiplyBatch, one view-projection times every model matrix
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        XrMatrix4x4f::MultiplyScalar(&references[i], &matrices[0], &matrices[i]);
+    }
+    XrMatrix4x4f::MultiplyBatch(results.data(), &matrices[0], matrices, MATRIX_COUNT);
+    benchmark.check("math/multiply_batch", getError(results.data(), references.data(), MATRIX_COUNT), TOLERANCE);
+
+    benchmark.run("math/multiply_batch/simd", MATRIX_COUNT, [&]() {
+        XrMatrix4x4f::MultiplyBatch(results.data(), &matrices[0], matrices, MATRIX_COUNT);
+        keep(results[0]);
+    });
+
+    // InvertRigidBody
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        XrMatrix4x4f::InvertRigidBodyScalar(&references[i], &rigidBodies[i]);
+        XrMatrix4x4f::InvertRigidBody(&results[i], &rigidBodies[i]);
+    }
+    benchmark.check("math/invert_rigid_body", getError(results.data(), references.data(), MATRIX_COUNT), TOLERANCE);
+
+    benchmark.run("math/invert_rigid_body/scalar", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::InvertRigidBodyScalar(&results[i], &rigidBodies[i]);
+        }
+        keep(results[0]);
+    });
+    benchmark.run("math/invert_rigid_body/simd", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::InvertRigidBody(&results[i], &rigidBodies[i]);
+        }
+        keep(results[0]);
+    });
+
+    // CreateViewMatrix
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        XrMatrix4x4f::CreateViewMatrixScalar(&references[i], &inputs.translations[i], &inputs.rotations[i]);
+        XrMatrix4x4f::CreateViewMatrix(&results[i], &inputs.translations[i], &inputs.rotations[i]);
+    }
+    benchmark.check("math/create_view_matrix", getError(results.data(), references.data(), MATRIX_COUNT), TOLERANCE);
+
+    benchmark.run("math/create_view_matrix/scalar", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::CreateViewMatrixScalar(&results[i], &inputs.translations[i], &inputs.rotations[i]);
+        }
+        keep(results[0]);
+    });
+    benchmark.run("math/create_view_matrix/simd", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::CreateViewMatrix(&results[i], &inputs.translations[i], &inputs.rotations[i]);
+        }
+        keep(results[0]);
+    });
+
+    // CreateTranslationRotationScale
+    for (size_t i = 0; i < MATRIX_COUNT; i++) {
+        XrMatrix4x4f::CreateTranslationRotationScaleScalar(&references[i], &inputs.translations[i], &inputs.rotations[i], &inputs.scales[i]);
+        XrMatrix4x4f::CreateTranslationRotationScale(&results[i], &inputs.translations[i], &inputs.rotations[i], &inputs.scales[i]);
+    }
+    benchmark.check("math/create_translation_rotation_scale", getError(results.data(), references.data(), MATRIX_COUNT), TOLERANCE);
+
+    benchmark.run("math/create_translation_rotation_scale/scalar", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::CreateTranslationRotationScaleScalar(&results[i], &inputs.translations[i], &inputs.rotations[i], &inputs.scales[i]);
+        }
+        keep(results[0]);
+    });
+    benchmark.run("math/create_translation_rotation_scale/simd", MATRIX_COUNT, [&]() {
+        for (size_t i = 0; i < MATRIX_COUNT; i++) {
+            XrMatrix4x4f::CreateTranslationRotationScale(&results[i], &inputs.translations[i], &inputs.rotations[i], &inputs.scales[i]);
+        }
+        keep(results[0]);
+    });
+
+    // CreateProjectionFov has no SIMD version, it's here to catch regressions in the per view setup
+    const XrFovf fov{ -0.87f, 0.78f, 0.82f, -0.86f };
+    benchmark.run("math/create_projection_fov", 1, [&]() {
+        XrMatrix4x4f::CreateProjectionFov(&results[0], fov, 0.1f, 100.f);
+        keep(results[0]);
+    });
+}
@@ -0,0 +1,598 @@
+#include "Suites.h"
+
+#include "vr/AlignedAllocator.h"
+#include "vr/BoundingVolumeHierarchy.h"
+#include "vr/FrustumCuller.h"
+#include "vr/JobSystem.h"
+#include "vr/SceneFile.h"
+#include "vr/TransformCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+
+
+
+static const uint32_t BUCKET_COUNT = 2;
+static const size_t CUBE_COUNTS[] = { 1000, 10000, 100000, 1000000 };
+static const float NEAR_Z = 0.1f;
+static const float FAR_Z = 100.f;
+static const int QUERY_COUNT = 256;
+// Where drawing one by one and drawing instanced are compared, past that the per-cube loop only gets slower linearly
+static const size_t MAX_DRAW_CUBE_COUNT = 100000;
+
+// Same as VRCore::CubeType, the bucket every cube of the scene goes into, MIXED alternates
+enum class SceneType {
+    EMPTY,
+    FILLED,
+    MIXED
+};
+
+typedef struct SyntheticCube {
+    XrVector3f translation;
+    XrQuaternionf rotation;
+    XrVector3f scale;
+    XrColor4f color;
+    uint32_t bucket;
+} SyntheticCube;
+
+static_assert(sizeof(SyntheticCube) == sizeof(TransformCache::Object) && offsetof(SyntheticCube, bucket) == offsetof(TransformCache::Object, bucket), "Synthetic cubes are added to the transform cache as they are");
+
+static const char *getName(SceneType type) {
+    switch (type) {
+        case SceneType::EMPTY:
+            return "empty";
+        case SceneType::FILLED:
+            return "filled";
+        default:
+            return "mixed";
+    }
+}
+
+// Cubes scattered around the stage within reach of the far plane, so a good part but not all of them is visible
+static std::vector<SyntheticCube> createScene(SceneType type, size_t count) {
+    std::mt19937 random((uint32_t)count);
+    std::uniform_real_distribution<float> horizontal(-40.f, 40.f);
+    std::uniform_real_distribution<float> vertical(0.f, 5.f);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> size(0.1f, 3.f);
+    std::uniform_real_distribution<float> channel(0.f, 1.f);
+
+    std::vector<SyntheticCube> cubes(count);
+    for (size_t i = 0; i < count; i++) {
+        SyntheticCube &cube = cubes[i];
+        cube.translation = { horizontal(random), vertical(random), horizontal(random) };
+
+        XrQuaternionf rotation{ unit(random), unit(random), unit(random), unit(random) };
+        const float length = sqrtf(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z + rotation.w * rotation.w);
+        cube.rotation = { rotation.x / length, rotation.y / length, rotation.z / length, rotation.w / length };
+
+        cube.scale = { size(random), size(random), size(random) };
+        cube.color = { channel(random), channel(random), channel(random), 1.f };
+        cube.bucket = type == SceneType::MIXED ? (uint32_t)(i % BUCKET_COUNT) : static_cast<uint32_t>(type);
+    }
+    return cubes;
+}
+
+// Standing in the middle of the stage, looking down -Z with a typical headset's field of view
+static void createViews(XrView *views) {
+    for (int i = 0; i < 2; i++) {
+        views[i] = {};
+        views[i].type = XR_TYPE_VIEW;
+        views[i].pose.orientation = { 0.f, 0.f, 0.f, 1.f };
+        views[i].pose.position = { i == 0 ? -0.032f : 0.032f, 1.6f, 0.f };
+        views[i].fov = { i == 0 ? -0.87f : -0.78f, i == 0 ? 0.78f : 0.87f, 0.82f, -0.86f };
+    }
+}
+
+// Displays canted outwards by 10 degrees each, like wide field of view headsets have, and fields of view that don't
+// match between the eyes vertically either. No single frustum with the planes of one eye or the other covers both
+static void createCantedViews(XrView *views) {
+    static const float HALF_CANT = 0.0873f;
+    createViews(views);
+    views[0].pose.orientation = { 0.f, sinf(HALF_CANT), 0.f, cosf(HALF_CANT) };
+    views[1].pose.orientation = { 0.f, -sinf(HALF_CANT), 0.f, cosf(HALF_CANT) };
+    views[1].fov.angleUp = 0.7f;
+    views[1].fov.angleDown = -0.95f;
+}
+
+static float getRadius(const SyntheticCube &cube) {
+    // Same bounding sphere as VRCore::addCube
+    return 0.1f * sqrtf(cube.scale.x * cube.scale.x + cube.scale.y * cube.scale.y + cube.scale.z * cube.scale.z);
+}
+
+static void addCubes(const std::vector<SyntheticCube> &cubes, TransformCache &transformCache, FrustumCuller &frustumCuller) {
+    transformCache.clear();
+    frustumCuller.clear();
+
+    for (const SyntheticCube &cube : cubes) {
+        transformCache.add(cube.translation, cube.rotation, cube.scale, cube.color, cube.bucket);
+        frustumCuller.add(cube.translation, getRadius(cube));
+    }
+}
+
+static BoundingVolumeHierarchy::Box getBounds(const SyntheticCube &cube) {
+    // Same box as VRCore::addCube
+    return BoundingVolumeHierarchy::getOrientedBoxBounds(cube.translation, cube.rotation, { 0.1f * cube.scale.x, 0.1f * cube.scale.y, 0.1f * cube.scale.z });
+}
+
+// Exact test of the oriented box, as VRCore::pickCube does
+static float intersectCube(const SyntheticCube &cube, const XrVector3f &origin, const XrVector3f &direction, float maxDistance) {
+    return BoundingVolumeHierarchy::intersectOrientedBox(origin, direction, maxDistance, cube.translation, cube.rotation, { 0.1f * cube.scale.x, 0.1f * cube.scale.y, 0.1f * cube.scale.z });
+}
+
+static double getMaxDifference(const XrMatrix4x4f &a, const XrMatrix4x4f &b) {
+    double difference = 0.;
+    for (int i = 0; i < 16; i++) {
+        difference = std::max(difference, (double)fabsf(a.m[i] - b.m[i]));
+    }
+    return difference;
+}
+
+// The queries are timed per batch of QUERY_COUNT and checked against testing every cube
+static void runHierarchyBenchmarks(Benchmark &benchmark, const XrView *views, size_t cubeCount) {
+    const std::string prefix = "scene/hierarchy/" + std::to_string(cubeCount);
+    if (!benchmark.isSelected(prefix + "/")) {
+        return;
+    }
+
+    const std::vector<SyntheticCube> cubes = createScene(SceneType::EMPTY, cubeCount);
+    std::vector<BoundingVolumeHierarchy::Box> boxes;
+    for (const SyntheticCube &cube : cubes) {
+        boxes.push_back(getBounds(cube));
+    }
+
+    BoundingVolumeHierarchy hierarchy;
+    benchmark.run(prefix + "/insert", cubeCount, [&]() {
+        hierarchy.clear();
+        for (uint32_t i = 0; i < cubeCount; i++) {
+            hierarchy.insert(i, boxes[i]);
+        }
+    });
+    if (Benchmark::Result *result = benchmark.run(prefix + "/rebuild", cubeCount, [&]() {
+        hierarchy.rebuild();
+    })) {
+        const BoundingVolumeHierarchy::Statistics statistics = hierarchy.getStatistics();
+        result->counters.push_back({ "height", (double)statistics.height });
+    }
+    hierarchy.rebuild();
+
+    FrustumCuller frustumCuller;
+    frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+    std::vector<uint32_t> visibleCubes;
+    visibleCubes.reserve(cubeCount);
+    if (Benchmark::Result *result = benchmark.run(prefix + "/cull", cubeCount, [&]() {
+        visibleCubes.clear();
+        hierarchy.queryFrustum(frustumCuller.getPlanes(), FrustumCuller::PLANE_COUNT, frustumCuller.getViewCount(), visibleCubes);
+    })) {
+        result->counters.push_back({ "visible", (double)visibleCubes.size() });
+    }
+
+    // Rays from around head height in every direction, like a controller pointing around the room
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> horizontal(-40.f, 40.f);
+    XrVector3f origins[QUERY_COUNT];
+    XrVector3f directions[QUERY_COUNT];
+    XrVector3f points[QUERY_COUNT];
+    for (int i = 0; i < QUERY_COUNT; i++) {
+        origins[i] = { unit(random), 1.6f + unit(random) * 0.4f, unit(random) };
+        directions[i] = { unit(random), unit(random), unit(random) };
+        points[i] = { horizontal(random), 2.5f + unit(random) * 2.5f, horizontal(random) };
+    }
+
+    auto hitTest = [&](uint32_t item, const XrVector3f &origin, const XrVector3f &direction, float maxDistance) {
+        return intersectCube(cubes[item], origin, direction, maxDistance);
+    };
+
+    benchmark.run(prefix + "/raycast", QUERY_COUNT, [&]() {
+        for (int i = 0; i < QUERY_COUNT; i++) {
+            keep(hierarchy.raycast(origins[i], directions[i], FAR_Z, hitTest));
+        }
+    });
+    benchmark.run(prefix + "/nearest", QUERY_COUNT, [&]() {
+        for (int i = 0; i < QUERY_COUNT; i++) {
+            keep(hierarchy.findNearest(points[i], 1.f));
+        }
+    });
+
+    double rayError = 0.;
+    for (int i = 0; i < QUERY_COUNT; i += 16) {
+        float distance = FAR_Z;
+        for (uint32_t item = 0; item < cubeCount; item++) {
+            const float itemDistance = intersectCube(cubes[item], origins[i], directions[i], distance);
+            if (itemDistance >= 0.f) {
+                distance = itemDistance;
+            }
+        }
+
+        const BoundingVolumeHierarchy::Hit hit = hierarchy.raycast(origins[i], directions[i], FAR_Z, hitTest);
+        rayError = std::max(rayError, (double)std::abs((hit.item == BoundingVolumeHierarchy::NO_ITEM ? FAR_Z : hit.distance) - distance));
+    }
+    benchmark.check(prefix + "/raycast", rayError, 1e-4);
+}
+
+// The CPU culling against what the culling compute shader of VRCore keeps: the cubes inside all planes of either view
+static void runCantedCullingBenchmarks(Benchmark &benchmark, size_t cubeCount) {
+    const std::string prefix = "scene/canted/" + std::to_string(cubeCount);
+    if (!benchmark.isSelected(prefix + "/")) {
+        return;
+    }
+
+    XrView views[2];
+    createCantedViews(views);
+    const std::vector<SyntheticCube> cubes = createScene(SceneType::MIXED, cubeCount);
+    TransformCache transformCache(BUCKET_COUNT);
+    FrustumCuller frustumCuller;
+    addCubes(cubes, transformCache, frustumCuller);
+
+    std::vector<uint32_t> visibleCubes;
+    visibleCubes.reserve(cubeCount);
+    if (Benchmark::Result *result = benchmark.run(prefix + "/cull", cubeCount, [&]() {
+        frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+        frustumCuller.cull(visibleCubes);
+    })) {
+        result->counters.push_back({ "visible", (double)visibleCubes.size() });
+    }
+    frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+    frustumCuller.cull(visibleCubes);
+
+    XrVector4f planes[2 * FrustumCuller::PLANE_COUNT];
+    for (int i = 0; i < 2; i++) {
+        FrustumCuller::createViewPlanes(&planes[i * FrustumCuller::PLANE_COUNT], views[i], NEAR_Z, FAR_Z);
+    }
+    auto isVisible = [&](const XrVector3f &center, float radius) {
+        auto isInside = [&](int firstPlane) {
+            for (int i = firstPlane; i < firstPlane + FrustumCuller::PLANE_COUNT; i++) {
+                const XrVector4f &plane = planes[i];
+                if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        return isInside(0) || isInside(FrustumCuller::PLANE_COUNT);
+    };
+    std::vector<uint32_t> gpuVisibleCubes;
+    for (uint32_t i = 0; i < cubeCount; i++) {
+        if (isVisible(cubes[i].translation, getRadius(cubes[i]))) {
+            gpuVisibleCubes.push_back(i);
+        }
+    }
+    benchmark.check(prefix + "/cull", visibleCubes == gpuVisibleCubes ? 0. : 1., 0.);
+
+    // The hierarchy tests the boxes inside the spheres, it may leave out cubes whose sphere pokes into a frustum but
+    // never one whose center is inside
+    BoundingVolumeHierarchy hierarchy;
+    for (uint32_t i = 0; i < cubeCount; i++) {
+        hierarchy.insert(i, getBounds(cubes[i]));
+    }
+    std::vector<uint32_t> hierarchyVisibleCubes;
+    hierarchy.queryFrustum(frustumCuller.getPlanes(), FrustumCuller::PLANE_COUNT, frustumCuller.getViewCount(), hierarchyVisibleCubes);
+    std::sort(hierarchyVisibleCubes.begin(), hierarchyVisibleCubes.end());
+    size_t missingCount = 0;
+    for (uint32_t i = 0; i < cubeCount; i++) {
+        if (isVisible(cubes[i].translation, 0.f) && !std::binary_search(hierarchyVisibleCubes.begin(), hierarchyVisibleCubes.end(), i)) {
+            missingCount++;
+        }
+    }
+    benchmark.check(prefix + "/hierarchy", (double)missingCount, 0.);
+}
+
+// Saving a whole scene and bringing it back the way VRCore::loadScene does, minus the hierarchy build that runs on
+// another thread and is timed by scene/hierarchy/N/rebuild
+static void runSceneFileBenchmarks(Benchmark &benchmark, size_t cubeCount) {
+    const std::string prefix = "scene/file/" + std::to_string(cubeCount);
+    if (!benchmark.isSelected(prefix + "/")) {
+        return;
+    }
+
+    const std::vector<SyntheticCube> cubes = createScene(SceneType::MIXED, cubeCount);
+    std::vector<SceneFile::Record> records(cubeCount);
+    for (size_t i = 0; i < cubeCount; i++) {
+        const SyntheticCube &cube = cubes[i];
+        records[i] = { cube.translation, cube.rotation, cube.scale, cube.color, cube.bucket };
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "openxrtest_bench_scene.bin").string();
+    std::filesystem::remove(path);
+
+    SceneFile sceneFile;
+    benchmark.run(prefix + "/save", cubeCount, [&]() {
+        sceneFile.open(path);
+        sceneFile.unmap();
+        sceneFile.write(0, records.data(), cubeCount);
+        sceneFile.commit(cubeCount);
+    });
+
+    // One more cube at a time, as VRCore::addCube saves
+    benchmark.run(prefix + "/append", 1, [&]() {
+        sceneFile.write(cubeCount, records.data(), 1);
+        sceneFile.commit(cubeCount + 1);
+    });
+    sceneFile.commit(cubeCount);
+    sceneFile.close();
+
+    std::vector<SceneFile::Record> loaded;
+    TransformCache transformCache(BUCKET_COUNT);
+    FrustumCuller frustumCuller;
+    std::vector<BoundingVolumeHierarchy::Box> boxes;
+    benchmark.run(prefix + "/restore", cubeCount, [&]() {
+        loaded.clear();
+        transformCache.clear();
+        frustumCuller.clear();
+
+        sceneFile.open(path);
+        const SceneFile::Record *mapped = sceneFile.getMappedRecords();
+        size_t typeCounts[BUCKET_COUNT] = {};
+        for (size_t i = 0; i < sceneFile.size(); i++) {
+            typeCounts[mapped[i].type]++;
+        }
+        loaded.assign(mapped, mapped + sceneFile.size());
+        sceneFile.close();
+
+        transformCache.reserve(typeCounts);
+        frustumCuller.reserve(loaded.size());
+        boxes.resize(loaded.size());
+        for (size_t i = 0; i < loaded.size(); i++) {
+            const SceneFile::Record &record = loaded[i];
+            transformCache.add(record.translation, record.rotation, record.scale, record.color, record.type);
+
+            const XrVector3f halfExtents{ 0.1f * record.scale.x, 0.1f * record.scale.y, 0.1f * record.scale.z };
+            frustumCuller.add(record.translation, sqrtf(halfExtents.x * halfExtents.x + halfExtents.y * halfExtents.y + halfExtents.z * halfExtents.z));
+            boxes[i] = BoundingVolumeHierarchy::getOrientedBoxBounds(record.translation, record.rotation, halfExtents);
+        }
+    });
+
+    benchmark.check(prefix + "/restore", loaded.size() == cubeCount && memcmp(loaded.data(), records.data(), cubeCount * sizeof(SceneFile::Record)) == 0 ? 0. : 1., 0.);
+
+    // A third of the cubes removed the way VRCore::removeCube does, replayed like loading does and written back
+    std::vector<SceneFile::Record> expected = records;
+    std::vector<SceneFile::Record> log = records;
+    for (size_t i = 0; i < cubeCount / 3; i++) {
+        const size_t index = i * 7919 % expected.size();
+        expected[index] = expected.back();
+        expected.pop_back();
+        log.push_back(SceneFile::createRemoval(index));
+    }
+
+    size_t compactedCount = 0;
+    benchmark.run(prefix + "/compact", log.size(), [&]() {
+        loaded = log;
+        compactedCount = SceneFile::compact(loaded.data(), loaded.size());
+    });
+    if (benchmark.isSelected(prefix + "/compact")) {
+        sceneFile.open(path);
+        sceneFile.unmap();
+        sceneFile.write(0, log.data(), log.size());
+        sceneFile.commit(log.size());
+        sceneFile.rewrite(loaded.data(), compactedCount);
+        sceneFile.close();
+
+        sceneFile.open(path);
+        const bool isCompacted = compactedCount == expected.size() && sceneFile.size() == expected.size() && memcmp(sceneFile.getMappedRecords(), expected.data(), expected.size() * sizeof(SceneFile::Record)) == 0;
+        sceneFile.close();
+        benchmark.check(prefix + "/compact", isCompacted ? 0. : 1., 0.);
+    }
+    std::filesystem::remove(path);
+}
+
+// 1, 2, 4... threads up to the hardware's, with the last one being all of them
+static std::vector<uint32_t> getThreadCounts() {
+    const uint32_t hardwareThreadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threadCount = 1; threadCount < hardwareThreadCount; threadCount *= 2) {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(hardwareThreadCount);
+    return threadCounts;
+}
+
+// What VRCore computes for the visible cubes every frame without instancing, a model transformation and one
+// model-view-projection per eye for every cube, against compacting the cached transformations into instances. The
+// uniform uploads and draw calls around them need a GL context and aren't timed, run the app with --instancing 0 for those
+static void runDrawBenchmarks(Benchmark &benchmark, const XrView *views, size_t cubeCount) {
+    const std::string prefix = "scene/draw/" + std::to_string(cubeCount);
+    if (cubeCount > MAX_DRAW_CUBE_COUNT || !benchmark.isSelected(prefix + "/")) {
+        return;
+    }
+
+    const std::vector<SyntheticCube> cubes = createScene(SceneType::MIXED, cubeCount);
+    TransformCache transformCache(BUCKET_COUNT);
+    FrustumCuller frustumCuller;
+    addCubes(cubes, transformCache, frustumCuller);
+    frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+    std::vector<uint32_t> visibleCubes;
+    frustumCuller.cull(visibleCubes);
+
+    XrMatrix4x4f viewProjections[2];
+    for (int i = 0; i < 2; i++) {
+        XrMatrix4x4f projection;
+        XrMatrix4x4f::CreateProjectionFov(&projection, views[i].fov, NEAR_Z, FAR_Z);
+        XrMatrix4x4f viewTransformation;
+        XrMatrix4x4f::CreateViewMatrix(&viewTransformation, &views[i].pose.position, &views[i].pose.orientation);
+        XrMatrix4x4f::Multiply(&viewProjections[i], &projection, &viewTransformation);
+    }
+
+    // Stands in for the uniforms, one model transformation and two model-view-projections per cube
+    AlignedVector<XrMatrix4x4f> uniforms(3 * visibleCubes.size());
+    auto setUniforms = [&]() {
+        XrMatrix4x4f *uniform = uniforms.data();
+        for (uint32_t index : visibleCubes) {
+            const SyntheticCube &cube = cubes[index];
+            XrMatrix4x4f::CreateTranslationRotationScale(&uniform[0], &cube.translation, &cube.rotation, &cube.scale);
+            XrMatrix4x4f::Multiply(&uniform[1], &viewProjections[0], &uniform[0]);
+            XrMatrix4x4f::Multiply(&uniform[2], &viewProjections[1], &uniform[0]);
+            uniform += 3;
+        }
+        keep(uniforms[0]);
+    };
+    benchmark.run(prefix + "/per_cube", visibleCubes.size(), setUniforms);
+    setUniforms();
+
+    AlignedVector<TransformCache::Instance> instances(visibleCubes.size());
+    size_t counts[BUCKET_COUNT];
+    auto writeInstances = [&]() {
+        std::fill(counts, counts + BUCKET_COUNT, 0);
+        transformCache.countInstances(visibleCubes, counts);
+
+        TransformCache::Instance *destinations[BUCKET_COUNT];
+        TransformCache::Instance *next = instances.data();
+        for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+            destinations[bucket] = next;
+            next += counts[bucket];
+        }
+        transformCache.writeInstances(visibleCubes, destinations);
+        keep(instances[0]);
+    };
+    benchmark.run(prefix + "/instanced", visibleCubes.size(), writeInstances);
+    writeInstances();
+
+    // Both end up with the same model transformations, the instances go bucket by bucket in the order of the cubes
+    const TransformCache::Instance *bucketInstances[BUCKET_COUNT];
+    const TransformCache::Instance *next = instances.data();
+    for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        bucketInstances[bucket] = next;
+        next += counts[bucket];
+    }
+    double difference = 0.;
+    for (size_t i = 0; i < visibleCubes.size(); i++) {
+        const TransformCache::Instance &instance = *bucketInstances[cubes[visibleCubes[i]].bucket]++;
+        difference = std::max(difference, getMaxDifference(uniforms[3 * i], instance.transformation));
+    }
+    benchmark.check(prefix + "/instanced", difference, 1e-5);
+}
+
+// The job system's versions of restoring, culling and writing, on more and more threads and checked against the serial
+// ones. Below the thresholds of FrustumCuller and TransformCache only restoring goes parallel
+static void runScalingBenchmarks(Benchmark &benchmark, const XrView *views, size_t cubeCount) {
+    const std::string prefix = "scene/scaling/" + std::to_string(cubeCount);
+    if (!benchmark.isSelected(prefix + "/")) {
+        return;
+    }
+
+    const std::vector<SyntheticCube> cubes = createScene(SceneType::MIXED, cubeCount);
+    TransformCache transformCache(BUCKET_COUNT);
+    FrustumCuller frustumCuller;
+    addCubes(cubes, transformCache, frustumCuller);
+    frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+
+    std::vector<uint32_t> expectedCubes;
+    frustumCuller.cull(expectedCubes);
+    size_t counts[BUCKET_COUNT] = {};
+    transformCache.countInstances(expectedCubes, counts);
+    AlignedVector<TransformCache::Instance> expectedInstances(expectedCubes.size());
+    TransformCache::Instance *destinations[BUCKET_COUNT];
+    TransformCache::Instance *next = expectedInstances.data();
+    for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        destinations[bucket] = next;
+        next += counts[bucket];
+    }
+    transformCache.writeInstances(expectedCubes, destinations);
+
+    std::vector<uint32_t> visibleCubes;
+    visibleCubes.reserve(cubeCount);
+    AlignedVector<TransformCache::Instance> instances(expectedCubes.size());
+
+    for (uint32_t threadCount : getThreadCounts()) {
+        const std::string threadPrefix = prefix + "/" + std::to_string(threadCount);
+        if (!benchmark.isSelected(threadPrefix + "/")) {
+            continue;
+        }
+        JobSystem jobSystem(threadCount);
+
+        // Leaves the cache as addCubes did, the cubes go in in the same order
+        benchmark.run(threadPrefix + "/restore", cubeCount, [&]() {
+            transformCache.clear();
+            transformCache.add(reinterpret_cast<const TransformCache::Object *>(cubes.data()), cubeCount, jobSystem);
+        });
+
+        benchmark.run(threadPrefix + "/cull", cubeCount, [&]() {
+            frustumCuller.cull(visibleCubes, jobSystem);
+        });
+        frustumCuller.cull(visibleCubes, jobSystem);
+        benchmark.check(threadPrefix + "/cull", visibleCubes == expectedCubes ? 0. : 1., 0.);
+
+        benchmark.run(threadPrefix + "/write", expectedCubes.size(), [&]() {
+            size_t counts[BUCKET_COUNT] = {};
+            transformCache.countInstances(visibleCubes, counts, jobSystem);
+
+            TransformCache::Instance *destinations[BUCKET_COUNT];
+            TransformCache::Instance *next = instances.data();
+            for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+                destinations[bucket] = next;
+                next += counts[bucket];
+            }
+            transformCache.writeInstances(visibleCubes, destinations, jobSystem);
+            keep(instances[0]);
+        });
+        benchmark.check(threadPrefix + "/write", memcmp(instances.data(), expectedInstances.data(), instances.size() * sizeof(TransformCache::Instance)) == 0 ? 0. : 1., 0.);
+    }
+}
+
+void runSceneBenchmarks(Benchmark &benchmark) {
+    XrView views[2];
+    createViews(views);
+
+    for (size_t cubeCount : CUBE_COUNTS) {
+        if (cubeCount > benchmark.getOptions().maxCubeCount) {
+            continue;
+        }
+
+        for (SceneType type : { SceneType::EMPTY, SceneType::FILLED, SceneType::MIXED }) {
+            const std::string prefix = std::string("scene/") + getName(type) + "/" + std::to_string(cubeCount);
+            if (!benchmark.isSelected(prefix + "/")) {
+                continue;
+            }
+
+            const std::vector<SyntheticCube> cubes = createScene(type, cubeCount);
+            TransformCache transformCache(BUCKET_COUNT);
+            FrustumCuller frustumCuller;
+
+            // Placing every cube, the cost of restoring a scene
+            benchmark.run(prefix + "/build", cubeCount, [&]() {
+                addCubes(cubes, transformCache, frustumCuller);
+            });
+            addCubes(cubes, transformCache, frustumCuller);
+
+            std::vector<uint32_t> visibleCubes;
+            visibleCubes.reserve(cubeCount);
+            if (Benchmark::Result *result = benchmark.run(prefix + "/cull", cubeCount, [&]() {
+                frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+                frustumCuller.cull(visibleCubes);
+            })) {
+                result->counters.push_back({ "visible", (double)visibleCubes.size() });
+            }
+
+            frustumCuller.setFrustum(views, 2, NEAR_Z, FAR_Z);
+            frustumCuller.cull(visibleCubes);
+
+            // Compacting the visible cubes per bucket, as VRCore::updateCubeInstances does into the stream buffer
+            AlignedVector<TransformCache::Instance> instances(visibleCubes.size() + BUCKET_COUNT);
+            benchmark.run(prefix + "/write", visibleCubes.size(), [&]() {
+                size_t counts[BUCKET_COUNT] = {};
+                transformCache.countInstances(visibleCubes, counts);
+
+                TransformCache::Instance *destinations[BUCKET_COUNT];
+                TransformCache::Instance *next = instances.data();
+                for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+                    destinations[bucket] = next;
+                    next += counts[bucket];
+                }
+                transformCache.writeInstances(visibleCubes, destinations);
+                keep(instances[0]);
+            });
+        }
+
+        runDrawBenchmarks(benchmark, views, cubeCount);
+        runHierarchyBenchmarks(benchmark, views, cubeCount);
+        runCantedCullingBenchmarks(benchmark, cubeCount);
+        runSceneFileBenchmarks(benchmark, cubeCount);
+        runScalingBenchmarks(benchmark, views, cubeCount);
+    }
+}
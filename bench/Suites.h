@@ -0,0 +1,16 @@
+#ifndef BENCH_SUITES_H
+#define BENCH_SUITES_H
+
+#include "Benchmark.h"
+
+
+// XrMatrix4x4f, every SIMD kernel timed next to its scalar reference and checked against it
+void runMathBenchmarks(Benchmark &benchmark);
+// The thumbstick color wheel and the rest of what pollActions does with the action states
+void runInputBenchmarks(Benchmark &benchmark);
+// What the frame loop does on the CPU per placed cube: caching, culling and writing the instance data, and the
+// spatial queries on the cube hierarchy and saving and restoring the scene file, and how the parallel versions scale
+// with the job system's thread count
+void runSceneBenchmarks(Benchmark &benchmark);
+
+#endif //BENCH_SUITES_H
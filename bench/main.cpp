@@ -0,0 +1,55 @@
+#include "Benchmark.h"
+#include "Suites.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// OpenXRTestBench [--filter SUBSTRING] [--output FILE] [--samples N] [--sample-ms MS] [--max-cubes N]
+// Progress goes to stderr, the JSON to the output file or stdout. Exits with 1 if a SIMD kernel disagrees with
+// its scalar reference
+int main(int argc, char *argv[]) {
+    Benchmark::Options options;
+    const char *outputPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && hasValue) {
+            options.sampleCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--sample-ms") == 0 && hasValue) {
+            options.sampleMilliseconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-cubes") == 0 && hasValue) {
+            options.maxCubeCount = strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    Benchmark benchmark(options);
+    runMathBenchmarks(benchmark);
+    runInputBenchmarks(benchmark);
+    runSceneBenchmarks(benchmark);
+
+    FILE *output = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!output) {
+        fprintf(stderr, "Can't open %s\n", outputPath);
+        return 2;
+    }
+    benchmark.writeJson(output);
+    if (outputPath) {
+        fclose(output);
+    }
+
+    return benchmark.hasFailedChecks() ? 1 : 0;
+}
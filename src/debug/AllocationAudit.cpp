@@ -0,0 +1,142 @@
+#include "debug/AllocationAudit.h"
+
+#ifdef OPENXRTEST_AUDIT_ALLOCATIONS
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+
+
+// The scope currently audited on this thread, nullptr outside of one
+static thread_local const char *s_scope = nullptr;
+
+void AllocationAudit::begin(const char *scope) {
+    s_scope = scope;
+}
+
+void AllocationAudit::end() {
+    s_scope = nullptr;
+}
+
+static void checkAllocation(size_t size) {
+    if (s_scope) {
+        // No logger here, it might allocate itself
+        fprintf(stderr, "Heap allocation of %zu bytes inside of %s\n", size, s_scope);
+        fflush(stderr);
+        abort();
+    }
+}
+
+static void *allocate(size_t size) {
+    checkAllocation(size);
+    return malloc(size ? size : 1);
+}
+
+static void *allocateAligned(size_t size, std::align_val_t alignment) {
+    checkAllocation(size);
+#ifdef _MSC_VER
+    return _aligned_malloc(size ? size : 1, static_cast<size_t>(alignment));
+#else
+    const size_t alignmentSize = static_cast<size_t>(alignment);
+    return aligned_alloc(alignmentSize, (size + alignmentSize - 1) / alignmentSize * alignmentSize);
+#endif
+}
+
+static void deallocateAligned(void *pointer) {
+#ifdef _MSC_VER
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+void *operator new(size_t size) {
+    void *pointer = allocate(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    void *pointer = allocateAligned(size, alignment);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+    deallocateAligned(pointer);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef DEBUG_ALLOCATIONAUDIT_H
+#define DEBUG_ALLOCATIONAUDIT_H
+
+
+// Steady state frames shouldn't touch the heap. Building with OPENXRTEST_AUDIT_ALLOCATIONS defined replaces the global
+// operator new and aborts on any allocation made by the auditing thread between begin() and end(), without it
+// everything here compiles to nothing
+class AllocationAudit {
+public:
+#ifdef OPENXRTEST_AUDIT_ALLOCATIONS
+    static void begin(const char *scope);
+    static void end();
+#else
+    static void begin(const char *) {}
+    static void end() {}
+#endif
+};
+
+#endif //DEBUG_ALLOCATIONAUDIT_H
@@ -0,0 +1,190 @@
+#include "debug/DeferredLog.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+// Written by its thread only, read by whoever drains, under s_drainMutex
+struct DeferredLog::Ring {
+    Entry entries[RING_CAPACITY];
+    alignas(64) std::atomic<uint32_t> head{ 0 };
+    alignas(64) std::atomic<uint32_t> tail{ 0 };
+    std::atomic<uint64_t> droppedCount{ 0 };
+    // Set after the thread's last entry, the next drain frees the ring
+    std::atomic<bool> isReleased{ false };
+};
+
+static_assert((DeferredLog::RING_CAPACITY & (DeferredLog::RING_CAPACITY - 1)) == 0, "Ring indices wrap around");
+
+// Often enough that a ring only fills up if something writes far more than the frame loop should
+static const std::chrono::milliseconds DRAIN_INTERVAL(5);
+
+std::vector<std::unique_ptr<DeferredLog::Ring>> DeferredLog::s_rings;
+std::vector<std::unique_ptr<DeferredLog::Ring>> DeferredLog::s_freeRings;
+thread_local DeferredLog::RingOwner DeferredLog::s_ring;
+thread_local DeferredLog::Entry DeferredLog::s_immediateEntry;
+
+static std::mutex s_ringsMutex;
+
+static std::atomic<bool> s_isRunning{ false };
+static std::mutex s_drainMutex;
+static std::mutex s_wakeMutex;
+static std::condition_variable s_wake;
+static std::thread s_thread;
+static std::atomic<uint64_t> s_droppedCount{ 0 };
+
+void DeferredLog::start() {
+    static_assert(sizeof(Entry) == ENTRY_SIZE, "Entries have a fixed size");
+
+    if (s_isRunning) {
+        return;
+    }
+
+    if (!s_ring.ring) {
+        s_ring.ring = attachThread();
+    }
+    s_isRunning = true;
+    s_thread = std::thread(&DeferredLog::run);
+}
+
+void DeferredLog::stop() {
+    if (!s_isRunning) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_wakeMutex);
+        s_isRunning = false;
+    }
+    s_wake.notify_one();
+    s_thread.join();
+
+    flush();
+}
+
+void DeferredLog::flush() {
+    std::lock_guard<std::mutex> lock(s_drainMutex);
+    drain();
+}
+
+uint64_t DeferredLog::getDroppedCount() {
+    uint64_t droppedCount = s_droppedCount;
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+    for (const auto &ring : s_rings) {
+        droppedCount += ring->droppedCount;
+    }
+    return droppedCount;
+}
+
+DeferredLog::Entry *DeferredLog::reserveEntry() {
+    if (!s_isRunning.load(std::memory_order_acquire)) {
+        return &s_immediateEntry;
+    }
+
+    if (!s_ring.ring) {
+        s_ring.ring = attachThread();
+    }
+
+    Ring *ring = s_ring.ring;
+    const uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == RING_CAPACITY) {
+        ring->droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &ring->entries[head % RING_CAPACITY];
+}
+
+void DeferredLog::commitEntry(Entry *entry) {
+    if (entry == &s_immediateEntry) {
+        logEntry(*entry);
+        return;
+    }
+
+    Ring *ring = s_ring.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void DeferredLog::logEntry(const Entry &entry) {
+    fmt::memory_buffer buffer;
+    entry.formatFunction(entry.format, entry.payload, buffer);
+    spdlog::default_logger_raw()->log(entry.time, spdlog::source_loc{}, entry.level, spdlog::string_view_t(buffer.data(), buffer.size()));
+}
+
+void DeferredLog::drain() {
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard<std::mutex> lock(s_ringsMutex);
+        for (const auto &ring : s_rings) {
+            rings.push_back(ring.get());
+        }
+    }
+
+    std::vector<Ring *> releasedRings;
+    for (Ring *ring : rings) {
+        // Read before the head, so a released ring is empty once drained up to it
+        const bool isReleased = ring->isReleased.load(std::memory_order_acquire);
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        const uint32_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            logEntry(ring->entries[tail % RING_CAPACITY]);
+            // Hands the slot back right away so the writer doesn't drop entries while a long batch is formatted
+            ring->tail.store(tail + 1, std::memory_order_release);
+        }
+
+        const uint64_t droppedCount = ring->droppedCount.exchange(0, std::memory_order_relaxed);
+        if (droppedCount) {
+            s_droppedCount += droppedCount;
+            spdlog::warn("LOG: {} entries dropped, a ring was full", droppedCount);
+        }
+
+        if (isReleased) {
+            releasedRings.push_back(ring);
+        }
+    }
+
+    if (releasedRings.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+    for (Ring *released : releasedRings) {
+        const auto it = std::find_if(s_rings.begin(), s_rings.end(), [released](const auto &ring) { return ring.get() == released; });
+        s_freeRings.push_back(std::move(*it));
+        s_rings.erase(it);
+    }
+}
+
+void DeferredLog::run() {
+    std::unique_lock<std::mutex> wakeLock(s_wakeMutex);
+    while (s_isRunning) {
+        s_wake.wait_for(wakeLock, DRAIN_INTERVAL);
+
+        std::lock_guard<std::mutex> drainLock(s_drainMutex);
+        drain();
+    }
+}
+
+DeferredLog::Ring *DeferredLog::attachThread() {
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+    if (s_freeRings.empty()) {
+        s_rings.push_back(std::make_unique<Ring>());
+    }
+    else {
+        // Empty and without dropped entries, the indices just carry on
+        s_rings.push_back(std::move(s_freeRings.back()));
+        s_freeRings.pop_back();
+        s_rings.back()->isReleased.store(false, std::memory_order_relaxed);
+    }
+    return s_rings.back().get();
+}
+
+DeferredLog::RingOwner::~RingOwner() {
+    if (ring) {
+        ring->isReleased.store(true, std::memory_order_release);
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef DEBUG_DEFERREDLOG_H
+#define DEBUG_DEFERREDLOG_H
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Trace and debug entries are compiled out below spdlog's SPDLOG_ACTIVE_LEVEL, their arguments aren't even evaluated
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define DEFERRED_LOG_TRACE(...) DeferredLog::write(spdlog::level::trace, __VA_ARGS__)
+#else
+#define DEFERRED_LOG_TRACE(...) ((void)0)
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define DEFERRED_LOG_DEBUG(...) DeferredLog::write(spdlog::level::debug, __VA_ARGS__)
+#else
+#define DEFERRED_LOG_DEBUG(...) ((void)0)
+#endif
+
+
+// Logging for the frame loop. An entry is only the format string, a timestamp and the raw arguments, copied into a
+// ring of the writing thread's own. A background thread formats the entries and hands them to spdlog's default logger,
+// so neither formatting nor a slow sink ever holds up a frame. A full ring drops entries instead of waiting, how many
+// is logged once the background thread gets to it. Before start() and after stop() entries are logged right away.
+// The ring of a thread that exits is reused by the next one once it's drained.
+// Arguments must be trivially copyable, strings are copied and cut short if there isn't room for them
+class DeferredLog {
+public:
+    template<typename T>
+    static constexpr bool IS_STRING = std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *> || std::is_same_v<std::decay_t<T>, std::string_view>;
+    // What an argument is kept as in an entry
+    template<typename T>
+    using Stored = std::conditional_t<IS_STRING<T>, std::string_view, std::decay_t<T>>;
+
+    static const size_t ENTRY_SIZE = 128;
+    static const uint32_t RING_CAPACITY = 1024;
+
+    // Starts the background thread and gives the calling thread its ring, other threads get theirs on their first entry
+    static void start();
+    // Logs what's left and stops the background thread, the other threads should be done writing
+    static void stop();
+    // Logs everything written so far before returning, e.g. before logging something directly through spdlog
+    static void flush();
+    static uint64_t getDroppedCount();
+
+    template<typename... Args>
+    static void write(spdlog::level::level_enum level, fmt::format_string<Stored<Args>...> format, const Args &...args);
+
+    template<typename... Args>
+    static void info(fmt::format_string<Stored<Args>...> format, const Args &...args) {
+        write(spdlog::level::info, format, args...);
+    }
+
+    template<typename... Args>
+    static void warn(fmt::format_string<Stored<Args>...> format, const Args &...args) {
+        write(spdlog::level::warn, format, args...);
+    }
+
+private:
+    typedef void (*FormatFunction)(fmt::string_view format, const uint8_t *payload, fmt::memory_buffer &buffer);
+
+    typedef struct Entry {
+        fmt::string_view format;
+        FormatFunction formatFunction;
+        spdlog::log_clock::time_point time;
+        spdlog::level::level_enum level;
+        uint8_t payload[ENTRY_SIZE - 40];
+    };
+
+    struct Ring;
+
+    // Releases the ring when its thread exits
+    typedef struct RingOwner {
+        Ring *ring = nullptr;
+
+        ~RingOwner();
+    };
+
+    static std::vector<std::unique_ptr<Ring>> s_rings;
+    // Drained rings of exited threads, drain() doesn't look at them anymore
+    static std::vector<std::unique_ptr<Ring>> s_freeRings;
+    static thread_local RingOwner s_ring;
+    // Logged right away from here while nothing drains the rings
+    static thread_local Entry s_immediateEntry;
+
+    // Slot for the next entry of the calling thread, nullptr if its ring is full
+    static Entry *reserveEntry();
+    static void commitEntry(Entry *entry);
+    static void logEntry(const Entry &entry);
+    static void drain();
+    static void run();
+    static Ring *attachThread();
+
+    template<typename T>
+    static void pack(uint8_t *&cursor, size_t maxStringLength, const T &value);
+    template<typename T>
+    static T unpack(const uint8_t *&cursor);
+    template<typename... Values>
+    static void formatPayload(fmt::string_view format, const uint8_t *payload, fmt::memory_buffer &buffer);
+};
+
+template<typename... Args>
+void DeferredLog::write(spdlog::level::level_enum level, fmt::format_string<Stored<Args>...> format, const Args &...args) {
+    static_assert((std::is_trivially_copyable_v<Stored<Args>> && ...), "Arguments are copied as raw bytes");
+    static_assert(((IS_STRING<Args> || !std::is_pointer_v<std::decay_t<Args>>) && ...), "Pointers other than strings would dangle");
+
+    if (!spdlog::default_logger_raw()->should_log(level)) {
+        return;
+    }
+
+    Entry *entry = reserveEntry();
+    if (!entry) {
+        return;
+    }
+
+    entry->format = format;
+    entry->formatFunction = &formatPayload<Stored<Args>...>;
+    entry->time = spdlog::log_clock::now();
+    entry->level = level;
+
+    // What the other arguments leave is split evenly between the strings, each of which also takes a length byte
+    constexpr size_t stringCount = ((IS_STRING<Args> ? 1 : 0) + ... + 0);
+    constexpr size_t fixedSize = ((IS_STRING<Args> ? 1 : sizeof(Stored<Args>)) + ... + 0);
+    static_assert(fixedSize <= sizeof(Entry::payload), "Too many arguments for one entry");
+    [[maybe_unused]] constexpr size_t maxStringLength = std::min<size_t>((sizeof(Entry::payload) - fixedSize) / (stringCount ? stringCount : 1), 255);
+
+    [[maybe_unused]] uint8_t *cursor = entry->payload;
+    (pack<Stored<Args>>(cursor, maxStringLength, args), ...);
+
+    commitEntry(entry);
+}
+
+template<typename T>
+void DeferredLog::pack(uint8_t *&cursor, size_t maxStringLength, const T &value) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        const size_t length = std::min(value.size(), maxStringLength);
+        *cursor++ = (uint8_t)length;
+        memcpy(cursor, value.data(), length);
+        cursor += length;
+    }
+    else {
+        memcpy(cursor, &value, sizeof(T));
+        cursor += sizeof(T);
+    }
+}
+
+template<typename T>
+T DeferredLog::unpack(const uint8_t *&cursor) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        const size_t length = *cursor++;
+        const std::string_view value(reinterpret_cast<const char *>(cursor), length);
+        cursor += length;
+        return value;
+    }
+    else {
+        T value;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+}
+
+template<typename... Values>
+void DeferredLog::formatPayload(fmt::string_view format, const uint8_t *payload, fmt::memory_buffer &buffer) {
+    [[maybe_unused]] const uint8_t *cursor = payload;
+    // Braced initialization unpacks the values in order
+    const std::tuple<Values...> values{ unpack<Values>(cursor)... };
+    std::apply([&](const Values &...unpacked) {
+        fmt::vformat_to(std::back_inserter(buffer), format, fmt::make_format_args(unpacked...));
+    }, values);
+}
+
+#endif //DEBUG_DEFERREDLOG_H
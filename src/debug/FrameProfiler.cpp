@@ -0,0 +1,141 @@
+#include "debug/FrameProfiler.h"
+
+#include "debug/DeferredLog.h"
+
+#include <algorithm>
+
+
+
+static const char *PHASE_NAMES[] = {
+    "events",
+    "input",
+    "xrWaitFrame",
+    "xrBeginFrame",
+    "culling",
+    "instances",
+    "acquire image",
+    "wait image",
+    "draw pass 0",
+    "draw pass 1",
+    "late latch",
+    "release image",
+    "xrEndFrame",
+    "frame",
+    "input latency",
+    "GPU pass 0",
+    "GPU pass 1"
+};
+
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == (size_t)FrameProfiler::Phase::COUNT, "Every phase needs a name");
+
+FrameProfiler::ScopedTimer::ScopedTimer(FrameProfiler &profiler, Phase phase) :
+    m_profiler(profiler),
+    m_phase(phase),
+    m_start(std::chrono::steady_clock::now()) {
+}
+
+FrameProfiler::ScopedTimer::~ScopedTimer() {
+    const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - m_start;
+    m_profiler.add(m_phase, duration.count());
+}
+
+FrameProfiler::FrameProfiler() :
+    m_frameMilliseconds(),
+    m_isPhaseHit(),
+    m_isGpuTimingEnabled(false),
+    m_queryIds(),
+    m_isQueryIssued(),
+    m_gpuFrame(0) {
+}
+
+void FrameProfiler::initGpuQueries() {
+    // GL_TIME_ELAPSED is core since 3.3
+    m_isGpuTimingEnabled = epoxy_gl_version() >= 33 || epoxy_has_gl_extension("GL_ARB_timer_query");
+    if (m_isGpuTimingEnabled) {
+        glGenQueries(GPU_FRAME_LATENCY * PASS_COUNT, &m_queryIds[0][0]);
+    }
+}
+
+void FrameProfiler::destroyGpuQueries() {
+    if (m_isGpuTimingEnabled) {
+        glDeleteQueries(GPU_FRAME_LATENCY * PASS_COUNT, &m_queryIds[0][0]);
+        m_isGpuTimingEnabled = false;
+    }
+}
+
+void FrameProfiler::beginGpuPass(uint32_t pass) {
+    if (m_isGpuTimingEnabled && pass < PASS_COUNT) {
+        glBeginQuery(GL_TIME_ELAPSED, m_queryIds[m_gpuFrame][pass]);
+        m_isQueryIssued[m_gpuFrame][pass] = true;
+    }
+}
+
+void FrameProfiler::endGpuPass() {
+    if (m_isGpuTimingEnabled) {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+}
+
+void FrameProfiler::add(Phase phase, float milliseconds) {
+    m_frameMilliseconds[(int)phase] += milliseconds;
+    m_isPhaseHit[(int)phase] = true;
+}
+
+void FrameProfiler::endFrame() {
+    for (int phase = 0; phase < (int)Phase::COUNT; phase++) {
+        if (m_isPhaseHit[phase]) {
+            addSample(static_cast<Phase>(phase), m_frameMilliseconds[phase]);
+        }
+        m_frameMilliseconds[phase] = 0.f;
+        m_isPhaseHit[phase] = false;
+    }
+
+    if (m_isGpuTimingEnabled) {
+        // The oldest frame's queries get reused next, whatever isn't done by now is dropped rather than waited for
+        m_gpuFrame = (m_gpuFrame + 1) % GPU_FRAME_LATENCY;
+        collectGpuQueries(m_gpuFrame);
+    }
+}
+
+void FrameProfiler::collectGpuQueries(uint32_t gpuFrame) {
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        if (!m_isQueryIssued[gpuFrame][pass]) {
+            continue;
+        }
+        m_isQueryIssued[gpuFrame][pass] = false;
+
+        GLuint isAvailable = GL_FALSE;
+        glGetQueryObjectuiv(m_queryIds[gpuFrame][pass], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (isAvailable) {
+            GLuint64 nanoseconds;
+            glGetQueryObjectui64v(m_queryIds[gpuFrame][pass], GL_QUERY_RESULT, &nanoseconds);
+            addSample(static_cast<Phase>((int)Phase::GPU_PASS_0 + pass), nanoseconds / 1000000.f);
+        }
+    }
+}
+
+void FrameProfiler::addSample(Phase phase, float milliseconds) {
+    Samples &samples = m_samples[(int)phase];
+    samples.values[samples.next] = milliseconds;
+    samples.next = (samples.next + 1) % SAMPLE_COUNT;
+    samples.count = std::min<uint32_t>(samples.count + 1, SAMPLE_COUNT);
+}
+
+void FrameProfiler::log() const {
+    float sorted[SAMPLE_COUNT];
+    for (int phase = 0; phase < (int)Phase::COUNT; phase++) {
+        const Samples &samples = m_samples[phase];
+        if (!samples.count) {
+            continue;
+        }
+
+        std::copy(samples.values, samples.values + samples.count, sorted);
+        std::sort(sorted, sorted + samples.count);
+
+        auto percentile = [&](float fraction) {
+            return sorted[(uint32_t)(fraction * (samples.count - 1) + 0.5f)];
+        };
+
+        DeferredLog::info("PROFILE: {:<14} p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms", PHASE_NAMES[phase], percentile(.5f), percentile(.95f), percentile(.99f));
+    }
+}
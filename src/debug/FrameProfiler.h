@@ -0,0 +1,87 @@
+#ifndef DEBUG_FRAMEPROFILER_H
+#define DEBUG_FRAMEPROFILER_H
+
+#include <epoxy/gl.h>
+
+#include <chrono>
+
+
+// Times the phases of a frame on the CPU and the render passes on the GPU and keeps the last samples of each around
+// for percentiles. GPU timer queries are only read back a few frames later so they never stall the pipeline. A profiler
+// belongs to one thread, every thread of the frame loop keeps its own
+class FrameProfiler {
+public:
+    enum class Phase {
+        EVENTS,
+        INPUT,
+        WAIT_FRAME,
+        BEGIN_FRAME,
+        CULLING,
+        INSTANCES,
+        ACQUIRE_IMAGE,
+        WAIT_IMAGE,
+        DRAW_PASS_0,
+        DRAW_PASS_1,
+        LATE_LATCH,
+        RELEASE_IMAGE,
+        END_FRAME,
+        FRAME,
+        // From sampling the input to ending the frame
+        LATENCY,
+        GPU_PASS_0,
+        GPU_PASS_1,
+        COUNT
+    };
+
+    // Adds the time until it goes out of scope to the phase
+    class ScopedTimer {
+    public:
+        ScopedTimer(FrameProfiler &profiler, Phase phase);
+        ~ScopedTimer();
+
+    private:
+        FrameProfiler &m_profiler;
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    static const int PASS_COUNT = 2;
+
+    FrameProfiler();
+
+    void initGpuQueries();
+    void destroyGpuQueries();
+    void beginGpuPass(uint32_t pass);
+    void endGpuPass();
+
+    // Phases hit several times in one frame add up
+    void add(Phase phase, float milliseconds);
+    // Commits the frame's samples and collects the GPU timings that have become available since
+    void endFrame();
+    void log() const;
+
+private:
+    static const int SAMPLE_COUNT = 512;
+    // Frames until a timer query is read back
+    static const int GPU_FRAME_LATENCY = 4;
+
+    typedef struct Samples {
+        float values[SAMPLE_COUNT];
+        uint32_t count = 0;
+        uint32_t next = 0;
+    };
+
+    Samples m_samples[(int)Phase::COUNT];
+    float m_frameMilliseconds[(int)Phase::COUNT];
+    bool m_isPhaseHit[(int)Phase::COUNT];
+
+    bool m_isGpuTimingEnabled;
+    GLuint m_queryIds[GPU_FRAME_LATENCY][PASS_COUNT];
+    bool m_isQueryIssued[GPU_FRAME_LATENCY][PASS_COUNT];
+    uint32_t m_gpuFrame;
+
+    void addSample(Phase phase, float milliseconds);
+    void collectGpuQueries(uint32_t gpuFrame);
+};
+
+#endif //DEBUG_FRAMEPROFILER_H
@@ -0,0 +1,91 @@
+#include "gl/MeshArena.h"
+
+#include <stdexcept>
+
+
+
+MeshArena::MeshArena() :
+    m_vertexBufferId(0),
+    m_indexBufferId(0) {
+}
+
+MeshArena::~MeshArena() {
+    destroy();
+}
+
+GLint MeshArena::addVertices(const GLfloat *positions, GLsizei vertexCount) {
+    if (m_vertexBufferId) {
+        throw std::runtime_error("Mesh arena is already uploaded");
+    }
+
+    const GLint baseVertex = (GLint)(m_positions.size() / 3);
+    m_positions.insert(m_positions.end(), positions, positions + 3 * vertexCount);
+    return baseVertex;
+}
+
+uint32_t MeshArena::addMesh(GLenum mode, const GLuint *indices, GLsizei indexCount, GLint baseVertex) {
+    if (m_vertexBufferId) {
+        throw std::runtime_error("Mesh arena is already uploaded");
+    }
+
+    m_meshes.push_back({ mode, indexCount, (GLuint)m_indices.size(), baseVertex });
+    m_indices.insert(m_indices.end(), indices, indices + indexCount);
+    return (uint32_t)m_meshes.size() - 1;
+}
+
+void MeshArena::upload() {
+    if (m_vertexBufferId) {
+        throw std::runtime_error("Mesh arena is already uploaded");
+    }
+
+    // The element buffer binding belongs to whatever vertex array is bound, so the indices go in through another target
+    glGenBuffers(1, &m_vertexBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * m_positions.size(), m_positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_indexBufferId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBufferId);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * m_indices.size(), m_indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    m_positions = std::vector<GLfloat>();
+    m_indices = std::vector<GLuint>();
+}
+
+void MeshArena::destroy() {
+    if (m_vertexBufferId) {
+        glDeleteBuffers(1, &m_vertexBufferId);
+        glDeleteBuffers(1, &m_indexBufferId);
+        m_vertexBufferId = 0;
+        m_indexBufferId = 0;
+    }
+    m_meshes.clear();
+}
+
+void MeshArena::attach(GLuint positionLocation) const {
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid *)0);
+    glEnableVertexAttribArray(positionLocation);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+}
+
+void MeshArena::draw(uint32_t id) const {
+    const Mesh &mesh = m_meshes[id];
+    glDrawElementsBaseVertex(mesh.mode, mesh.indexCount, GL_UNSIGNED_INT, (void *)(sizeof(GLuint) * mesh.firstIndex), mesh.baseVertex);
+}
+
+void MeshArena::drawInstanced(uint32_t id, GLsizei instanceCount) const {
+    const Mesh &mesh = m_meshes[id];
+    glDrawElementsInstancedBaseVertex(mesh.mode, mesh.indexCount, GL_UNSIGNED_INT, (void *)(sizeof(GLuint) * mesh.firstIndex), instanceCount, mesh.baseVertex);
+}
+
+const MeshArena::Mesh &MeshArena::getMesh(uint32_t id) const {
+    return m_meshes[id];
+}
+
+uint32_t MeshArena::getMeshCount() const {
+    return (uint32_t)m_meshes.size();
+}
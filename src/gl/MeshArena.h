@@ -0,0 +1,50 @@
+#ifndef GL_MESHARENA_H
+#define GL_MESHARENA_H
+
+#include <epoxy/gl.h>
+
+#include <vector>
+
+
+// Every static mesh in one vertex and one index buffer. A mesh is only a range of indices relative to a base vertex,
+// so a vertex array that has the arena attached draws any of them without binding anything else. Meshes are added
+// first and uploaded once, their ids count up from 0 in the order they're added
+class MeshArena {
+public:
+    typedef struct Mesh {
+        GLenum mode;
+        GLsizei indexCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+    };
+
+    MeshArena();
+    ~MeshArena();
+
+    // Positions are 3 floats per vertex, returns the base vertex the meshes using them index from
+    GLint addVertices(const GLfloat *positions, GLsizei vertexCount);
+    // Returns the mesh id
+    uint32_t addMesh(GLenum mode, const GLuint *indices, GLsizei indexCount, GLint baseVertex);
+    void upload();
+    void destroy();
+
+    // Points the attribute at the positions and the element buffer at the indices of the bound vertex array
+    void attach(GLuint positionLocation) const;
+    // Draw from the bound vertex array, which has to have the arena attached
+    void draw(uint32_t id) const;
+    void drawInstanced(uint32_t id, GLsizei instanceCount) const;
+
+    const Mesh &getMesh(uint32_t id) const;
+    uint32_t getMeshCount() const;
+
+private:
+    GLuint m_vertexBufferId;
+    GLuint m_indexBufferId;
+    std::vector<Mesh> m_meshes;
+
+    // Only kept until upload()
+    std::vector<GLfloat> m_positions;
+    std::vector<GLuint> m_indices;
+};
+
+#endif //GL_MESHARENA_H
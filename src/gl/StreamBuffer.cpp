@@ -0,0 +1,166 @@
+#include "gl/StreamBuffer.h"
+
+#include <stdexcept>
+
+
+
+StreamBuffer::StreamBuffer() :
+    m_target(GL_ARRAY_BUFFER),
+    m_bufferId(0),
+    m_isPersistent(false),
+    m_mappedPointer(nullptr),
+    m_regionSize(0),
+    m_regionCount(0),
+    m_region(0),
+    m_regionOffset(0) {
+}
+
+StreamBuffer::~StreamBuffer() {
+    destroy();
+}
+
+void StreamBuffer::init(GLenum target, GLsizeiptr regionSize, uint32_t regionCount) {
+    if (m_bufferId) {
+        throw std::runtime_error("Stream buffer shouldn't be already initialized");
+    }
+    if (!regionCount) {
+        throw std::runtime_error("Stream buffer needs at least one region");
+    }
+
+    m_target = target;
+    m_regionCount = regionCount;
+    m_region = 0;
+    m_fences.assign(regionCount, nullptr);
+    m_isPersistent = epoxy_gl_version() >= 44 || epoxy_has_gl_extension("GL_ARB_buffer_storage");
+
+    createStorage(regionSize);
+}
+
+void StreamBuffer::destroy() {
+    if (m_bufferId) {
+        destroyStorage();
+    }
+}
+
+void StreamBuffer::createStorage(GLsizeiptr regionSize) {
+    // Keep every region's start nicely aligned
+    m_regionSize = (regionSize + 255) / 256 * 256;
+    const GLsizeiptr size = m_regionSize * m_regionCount;
+
+    glGenBuffers(1, &m_bufferId);
+    glBindBuffer(m_target, m_bufferId);
+    if (m_isPersistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(m_target, size, nullptr, flags);
+        m_mappedPointer = static_cast<uint8_t *>(glMapBufferRange(m_target, 0, size, flags));
+        if (!m_mappedPointer) {
+            glBindBuffer(m_target, 0);
+            throw std::runtime_error("Mapping a stream buffer");
+        }
+    }
+    else {
+        glBufferData(m_target, size, nullptr, GL_STREAM_DRAW);
+        m_stagingBuffer.resize(m_regionSize);
+    }
+    glBindBuffer(m_target, 0);
+}
+
+void StreamBuffer::destroyStorage() {
+    for (uint32_t region = 0; region < m_regionCount; region++) {
+        waitForRegion(region);
+    }
+
+    if (m_mappedPointer) {
+        glBindBuffer(m_target, m_bufferId);
+        glUnmapBuffer(m_target);
+        glBindBuffer(m_target, 0);
+        m_mappedPointer = nullptr;
+    }
+
+    glDeleteBuffers(1, &m_bufferId);
+    m_bufferId = 0;
+}
+
+void StreamBuffer::reserve(GLsizeiptr frameSize) {
+    if (frameSize > m_regionSize) {
+        // The old buffer may still be read by frames in flight, destroyStorage() waits for them
+        destroyStorage();
+        createStorage(frameSize > 2 * m_regionSize ? frameSize : 2 * m_regionSize);
+        m_frameStatistics.reallocations++;
+    }
+}
+
+void StreamBuffer::beginFrame(GLsizeiptr frameSize) {
+    reserve(frameSize);
+
+    m_region = (m_region + 1) % m_regionCount;
+    waitForRegion(m_region);
+    m_regionOffset = 0;
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+    const GLsizeiptr offset = (m_regionOffset + alignment - 1) / alignment * alignment;
+    if (offset + size > m_regionSize) {
+        throw std::runtime_error("Stream buffer allocation exceeds the frame size");
+    }
+    m_regionOffset = offset + size;
+    m_frameStatistics.uploadedBytes += size;
+
+    const GLintptr bufferOffset = m_region * m_regionSize + offset;
+    void *pointer = m_isPersistent ? m_mappedPointer + bufferOffset : m_stagingBuffer.data() + offset;
+
+    return { pointer, bufferOffset, size };
+}
+
+void StreamBuffer::flush() {
+    // Persistent mappings are coherent, nothing to do there
+    if (m_isPersistent || !m_regionOffset) {
+        return;
+    }
+
+    glBindBuffer(m_target, m_bufferId);
+    glBufferSubData(m_target, m_region * m_regionSize, m_regionOffset, m_stagingBuffer.data());
+    glBindBuffer(m_target, 0);
+}
+
+void StreamBuffer::endFrame() {
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_statistics = m_frameStatistics;
+    m_frameStatistics = Statistics();
+}
+
+void StreamBuffer::waitForRegion(uint32_t region) {
+    GLsync fence = m_fences[region];
+    if (!fence) {
+        return;
+    }
+
+    // Only count the waits that would actually block
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        m_frameStatistics.fenceWaits++;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+
+    glDeleteSync(fence);
+    m_fences[region] = nullptr;
+
+    if (result == GL_WAIT_FAILED) {
+        throw std::runtime_error("Waiting for a stream buffer fence");
+    }
+}
+
+GLuint StreamBuffer::getBufferId() const {
+    return m_bufferId;
+}
+
+bool StreamBuffer::isPersistent() const {
+    return m_isPersistent;
+}
+
+const StreamBuffer::Statistics &StreamBuffer::getStatistics() const {
+    return m_statistics;
+}
@@ -0,0 +1,68 @@
+#ifndef GL_STREAMBUFFER_H
+#define GL_STREAMBUFFER_H
+
+#include <epoxy/gl.h>
+
+#include <vector>
+
+
+// Ring buffer for data that is written by the CPU every frame. The buffer is split into one region per frame in
+// flight and every region is guarded by a fence so a region is only written to again once the GPU is done with it.
+// With GL_ARB_buffer_storage the buffer stays persistently mapped, otherwise the frame's data is staged on the CPU
+// and uploaded in flush()
+class StreamBuffer {
+public:
+    typedef struct Allocation {
+        void *pointer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    typedef struct Statistics {
+        size_t uploadedBytes = 0;
+        uint32_t fenceWaits = 0;
+        uint32_t reallocations = 0;
+    };
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    void init(GLenum target, GLsizeiptr regionSize, uint32_t regionCount);
+    void destroy();
+
+    // Grows the regions ahead of time, outside of a frame
+    void reserve(GLsizeiptr frameSize);
+    // frameSize is the upper bound of what's allocated until endFrame(), the buffer grows between frames if needed
+    void beginFrame(GLsizeiptr frameSize);
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment);
+    // Has to be called after writing the allocations and before drawing from them
+    void flush();
+    void endFrame();
+
+    GLuint getBufferId() const;
+    bool isPersistent() const;
+    // Counters of the last finished frame
+    const Statistics &getStatistics() const;
+
+private:
+    GLenum m_target;
+    GLuint m_bufferId;
+    bool m_isPersistent;
+    uint8_t *m_mappedPointer;
+    std::vector<uint8_t> m_stagingBuffer;
+
+    GLsizeiptr m_regionSize;
+    uint32_t m_regionCount;
+    uint32_t m_region;
+    GLsizeiptr m_regionOffset;
+    std::vector<GLsync> m_fences;
+
+    Statistics m_statistics;
+    Statistics m_frameStatistics;
+
+    void createStorage(GLsizeiptr regionSize);
+    void destroyStorage();
+    void waitForRegion(uint32_t region);
+};
+
+#endif //GL_STREAMBUFFER_H
@@ -1,16 +1,90 @@
 #include "vr/VRCore.h"
+#include "debug/DeferredLog.h"
 
 #include "spdlog/spdlog.h"
 
-int main() {
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+int main(int argc, char *argv[]) {
+    // --frames N renders N frames once and exits, for unattended runs e.g. against the mock runtime in tools/
+    uint64_t frameLimit = 0;
+    // --scene PATH is where the placed cubes are kept, an empty path keeps them in memory only
+    std::string scenePath = "scene.bin";
+    // --pipeline-depth N submits the frames from a render thread, up to N frames behind the simulation, 0 keeps
+    // everything on one thread. The runtime holds it to 1, see VRCore::MAX_PIPELINE_DEPTH
+    uint32_t pipelineDepth = 0;
+    // --instancing, --culling, --gpu-culling and --hierarchical-culling 0 or 1 switch the ways of drawing the cubes, e.g.
+    // --instancing 0 draws them one by one as before instancing
+    VRCore::RenderOptions renderOptions;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0) {
+            frameLimit = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--scene") == 0) {
+            scenePath = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--pipeline-depth") == 0) {
+            pipelineDepth = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--instancing") == 0) {
+            renderOptions.isInstancingEnabled = strcmp(argv[i + 1], "0") != 0;
+        }
+        else if (strcmp(argv[i], "--culling") == 0) {
+            renderOptions.isCullingEnabled = strcmp(argv[i + 1], "0") != 0;
+        }
+        else if (strcmp(argv[i], "--gpu-culling") == 0) {
+            renderOptions.isGpuCullingEnabled = strcmp(argv[i + 1], "0") != 0;
+        }
+        else if (strcmp(argv[i], "--hierarchical-culling") == 0) {
+            renderOptions.isHierarchicalCullingEnabled = strcmp(argv[i + 1], "0") != 0;
+        }
+    }
+
+    DeferredLog::start();
+
+    if (frameLimit) {
+        try {
+            VRCore vRCore(scenePath, renderOptions);
+            vRCore.runVR(frameLimit, pipelineDepth);
+        }
+        catch (const std::runtime_error &e) {
+            DeferredLog::stop();
+            spdlog::critical(e.what());
+            return 1;
+        }
+
+        DeferredLog::stop();
+        return 0;
+    }
+
+    // VRCore recovers lost sessions and instances itself, this only restarts it after anything else. Quick at first,
+    // backing off while it keeps failing e.g. with no headset connected
+    static const std::chrono::milliseconds initialRestartDelay(500);
+    static const std::chrono::milliseconds maxRestartDelay(30000);
+    std::chrono::milliseconds restartDelay = initialRestartDelay;
     while (true) {
+        const auto start = std::chrono::steady_clock::now();
         try {
-            VRCore vRCore;
-            vRCore.runVR();
+            VRCore vRCore(scenePath, renderOptions);
+
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+            spdlog::info("STARTED in {:.1f} ms", duration.count());
+            restartDelay = initialRestartDelay;
+
+            vRCore.runVR(0, pipelineDepth);
         }
-        catch (std::runtime_error e) {
+        catch (const std::runtime_error &e) {
+            // Whatever led up to it first
+            DeferredLog::flush();
             spdlog::critical(e.what());
-            std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+            spdlog::info("RESTARTING in {} ms", restartDelay.count());
+            std::this_thread::sleep_for(restartDelay);
+            restartDelay = std::min(2 * restartDelay, maxRestartDelay);
         }
     }
 
@@ -0,0 +1,723 @@
+#include "vr/BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+
+
+// Past this depth a build stops looking for good splits and halves the items, which bounds the depth
+static const int MAX_SAH_DEPTH = 48;
+
+static float getAxis(const XrVector3f &vector, int axis) {
+    return (&vector.x)[axis];
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() {
+}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy() {
+    if (m_rebuild.valid()) {
+        m_rebuild.wait();
+    }
+}
+
+BoundingVolumeHierarchy::Box BoundingVolumeHierarchy::getOrientedBoxBounds(const XrVector3f &center, const XrQuaternionf &rotation, const XrVector3f &halfExtents) {
+    const float x2 = rotation.x + rotation.x;
+    const float y2 = rotation.y + rotation.y;
+    const float z2 = rotation.z + rotation.z;
+
+    const float xx2 = rotation.x * x2;
+    const float yy2 = rotation.y * y2;
+    const float zz2 = rotation.z * z2;
+    const float yz2 = rotation.y * z2;
+    const float wx2 = rotation.w * x2;
+    const float xy2 = rotation.x * y2;
+    const float wz2 = rotation.w * z2;
+    const float xz2 = rotation.x * z2;
+    const float wy2 = rotation.w * y2;
+
+    // Every axis of the rotated box contributes the absolute value of its projection onto the world axes
+    const float x = std::abs(halfExtents.x);
+    const float y = std::abs(halfExtents.y);
+    const float z = std::abs(halfExtents.z);
+    const XrVector3f extents{
+        std::abs(1.f - yy2 - zz2) * x + std::abs(xy2 - wz2) * y + std::abs(xz2 + wy2) * z,
+        std::abs(xy2 + wz2) * x + std::abs(1.f - xx2 - zz2) * y + std::abs(yz2 - wx2) * z,
+        std::abs(xz2 - wy2) * x + std::abs(yz2 + wx2) * y + std::abs(1.f - xx2 - yy2) * z
+    };
+
+    return {
+        { center.x - extents.x, center.y - extents.y, center.z - extents.z },
+        { center.x + extents.x, center.y + extents.y, center.z + extents.z }
+    };
+}
+
+// Conjugate rotation of v by q, v + 2w(v x q) + 2(v x q) x q with q the vector part
+static XrVector3f rotateInverse(const XrQuaternionf &rotation, const XrVector3f &vector) {
+    const XrVector3f t{
+        2.f * (vector.y * rotation.z - vector.z * rotation.y),
+        2.f * (vector.z * rotation.x - vector.x * rotation.z),
+        2.f * (vector.x * rotation.y - vector.y * rotation.x)
+    };
+    return {
+        vector.x + rotation.w * t.x + (t.y * rotation.z - t.z * rotation.y),
+        vector.y + rotation.w * t.y + (t.z * rotation.x - t.x * rotation.z),
+        vector.z + rotation.w * t.z + (t.x * rotation.y - t.y * rotation.x)
+    };
+}
+
+// The ray is moved into the box's frame where it's axis aligned, rotating keeps the distances along it
+float BoundingVolumeHierarchy::intersectOrientedBox(const XrVector3f &origin, const XrVector3f &direction, float maxDistance, const XrVector3f &center, const XrQuaternionf &rotation, const XrVector3f &halfExtents) {
+    const XrVector3f localOrigin = rotateInverse(rotation, { origin.x - center.x, origin.y - center.y, origin.z - center.z });
+    const XrVector3f localDirection = rotateInverse(rotation, direction);
+
+    const XrVector3f extents{ std::abs(halfExtents.x), std::abs(halfExtents.y), std::abs(halfExtents.z) };
+    const Box box{ { -extents.x, -extents.y, -extents.z }, extents };
+    return getEntryDistance(box, localOrigin, { 1.f / localDirection.x, 1.f / localDirection.y, 1.f / localDirection.z }, maxDistance);
+}
+
+void BoundingVolumeHierarchy::insert(uint32_t item, const Box &box) {
+    if (contains(item)) {
+        throw std::runtime_error("Item already in the hierarchy");
+    }
+
+    recordEdit({ EditType::INSERT, item, NO_ITEM, box });
+    insertItem(m_tree, item, box);
+}
+
+void BoundingVolumeHierarchy::update(uint32_t item, const Box &box) {
+    if (!contains(item)) {
+        throw std::runtime_error("Item not in the hierarchy");
+    }
+
+    recordEdit({ EditType::UPDATE, item, NO_ITEM, box });
+    const int32_t leaf = m_tree.leaves[item];
+    setBox(m_tree, leaf, box);
+    refitAncestors(m_tree, m_tree.nodes[leaf].parent);
+}
+
+void BoundingVolumeHierarchy::remove(uint32_t item) {
+    if (!contains(item)) {
+        throw std::runtime_error("Item not in the hierarchy");
+    }
+
+    recordEdit({ EditType::REMOVE, item, NO_ITEM, {} });
+    removeItem(m_tree, item);
+}
+
+void BoundingVolumeHierarchy::rename(uint32_t item, uint32_t newItem) {
+    if (!contains(item) || contains(newItem)) {
+        throw std::runtime_error("Renaming to an item that's in the hierarchy or from one that isn't");
+    }
+
+    recordEdit({ EditType::RENAME, item, newItem, {} });
+    renameItem(m_tree, item, newItem);
+}
+
+void BoundingVolumeHierarchy::clear() {
+    if (m_rebuild.valid()) {
+        m_rebuild.wait();
+        m_rebuild = {};
+    }
+    m_pendingEdits.clear();
+
+    m_tree = {};
+    m_builtCost = 0.;
+}
+
+bool BoundingVolumeHierarchy::contains(uint32_t item) const {
+    return item < m_tree.leaves.size() && m_tree.leaves[item] != NO_NODE;
+}
+
+size_t BoundingVolumeHierarchy::size() const {
+    return m_tree.itemCount;
+}
+
+void BoundingVolumeHierarchy::maintain() {
+    if (m_rebuild.valid()) {
+        if (m_rebuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        Tree tree = m_rebuild.get();
+        const double builtCost = getCost(tree);
+        for (const Edit &edit : m_pendingEdits) {
+            applyEdit(tree, edit);
+        }
+        m_pendingEdits.clear();
+
+        m_tree = std::move(tree);
+        m_builtCost = builtCost;
+        m_rebuildCount++;
+        return;
+    }
+
+    if (m_tree.itemCount >= MIN_REBUILD_ITEM_COUNT && getCost(m_tree) > REBUILD_COST_RATIO * m_builtCost) {
+        m_rebuild = std::async(std::launch::async, build, getBuildItems(), m_tree.leaves.size());
+    }
+}
+
+void BoundingVolumeHierarchy::rebuild() {
+    if (m_rebuild.valid()) {
+        m_rebuild.wait();
+        m_rebuild = {};
+    }
+    m_pendingEdits.clear();
+
+    m_tree = build(getBuildItems(), m_tree.leaves.size());
+    m_builtCost = getCost(m_tree);
+    m_rebuildCount++;
+}
+
+void BoundingVolumeHierarchy::load(std::vector<Box> boxes) {
+    clear();
+
+    m_rebuild = std::async(std::launch::async, [](std::vector<Box> boxes) {
+        std::vector<BuildItem> items(boxes.size());
+        for (uint32_t item = 0; item < boxes.size(); item++) {
+            const Box &box = boxes[item];
+            items[item] = { item, box, { (box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f } };
+        }
+        return build(std::move(items), boxes.size());
+    }, std::move(boxes));
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const XrVector4f *planes, int planeCount, uint32_t viewCount, std::vector<uint32_t> &items) {
+    if (m_tree.root == NO_NODE) {
+        return;
+    }
+
+    // Subtrees found to be completely inside are pushed as ~node and taken without further tests
+    m_stack.clear();
+    m_stack.push_back(m_tree.root);
+    while (!m_stack.empty()) {
+        const int32_t entry = m_stack.back();
+        m_stack.pop_back();
+
+        bool isInside = entry < 0;
+        const int32_t index = isInside ? ~entry : entry;
+        const Node &node = m_tree.nodes[index];
+
+        if (!isInside) {
+            const XrVector3f center{ (node.box.min.x + node.box.max.x) * 0.5f, (node.box.min.y + node.box.max.y) * 0.5f, (node.box.min.z + node.box.max.z) * 0.5f };
+            const XrVector3f extents{ node.box.max.x - center.x, node.box.max.y - center.y, node.box.max.z - center.z };
+
+            // Outside when every view has it outside, completely inside as soon as one view has
+            bool isOutside = true;
+            for (uint32_t view = 0; view < viewCount && !isInside; view++) {
+                bool isViewOutside = false;
+                bool isViewInside = true;
+                for (int i = 0; i < planeCount; i++) {
+                    const XrVector4f &plane = planes[view * planeCount + i];
+                    const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+                    const float radius = std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+                    if (distance + radius < 0.f) {
+                        isViewOutside = true;
+                        break;
+                    }
+                    if (distance - radius < 0.f) {
+                        isViewInside = false;
+                    }
+                }
+                isOutside = isOutside && isViewOutside;
+                isInside = !isViewOutside && isViewInside;
+            }
+
+            if (isOutside) {
+                continue;
+            }
+        }
+
+        if (node.children[0] == NO_NODE) {
+            items.push_back(node.item);
+        }
+        else if (isInside) {
+            m_stack.push_back(~node.children[0]);
+            m_stack.push_back(~node.children[1]);
+        }
+        else {
+            m_stack.push_back(node.children[0]);
+            m_stack.push_back(node.children[1]);
+        }
+    }
+}
+
+BoundingVolumeHierarchy::Hit BoundingVolumeHierarchy::findNearest(const XrVector3f &point, float maxDistance) {
+    Hit hit;
+    if (m_tree.root == NO_NODE) {
+        return hit;
+    }
+
+    float bestDistanceSquared = maxDistance * maxDistance;
+
+    m_stack.clear();
+    m_stack.push_back(m_tree.root);
+    while (!m_stack.empty()) {
+        const Node &node = m_tree.nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if (getDistanceSquared(node.box, point) > bestDistanceSquared) {
+            continue;
+        }
+
+        if (node.children[0] == NO_NODE) {
+            bestDistanceSquared = getDistanceSquared(node.box, point);
+            hit.item = node.item;
+            continue;
+        }
+
+        // Nearer child last so it's visited first and tightens the bound for the other one
+        const float distances[2] = {
+            getDistanceSquared(m_tree.nodes[node.children[0]].box, point),
+            getDistanceSquared(m_tree.nodes[node.children[1]].box, point)
+        };
+        const int nearer = distances[1] < distances[0] ? 1 : 0;
+        if (distances[1 - nearer] <= bestDistanceSquared) {
+            m_stack.push_back(node.children[1 - nearer]);
+        }
+        m_stack.push_back(node.children[nearer]);
+    }
+
+    if (hit.item != NO_ITEM) {
+        hit.distance = sqrtf(bestDistanceSquared);
+    }
+    return hit;
+}
+
+BoundingVolumeHierarchy::Statistics BoundingVolumeHierarchy::getStatistics() const {
+    Statistics statistics;
+    statistics.itemCount = m_tree.itemCount;
+    statistics.nodeCount = m_tree.itemCount ? 2 * m_tree.itemCount - 1 : 0;
+    statistics.height = m_tree.root == NO_NODE ? 0 : m_tree.nodes[m_tree.root].height;
+    statistics.relativeCost = m_builtCost > 0. ? (float)(getCost(m_tree) / m_builtCost) : 1.f;
+    statistics.rebuildCount = m_rebuildCount;
+    return statistics;
+}
+
+float BoundingVolumeHierarchy::getArea(const Box &box) {
+    const float x = box.max.x - box.min.x;
+    const float y = box.max.y - box.min.y;
+    const float z = box.max.z - box.min.z;
+    return 2.f * (x * y + y * z + z * x);
+}
+
+BoundingVolumeHierarchy::Box BoundingVolumeHierarchy::merge(const Box &a, const Box &b) {
+    return {
+        { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z) },
+        { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z) }
+    };
+}
+
+// Slab test, the distance along the ray at which it enters the box or -1 if it misses it within maxDistance
+float BoundingVolumeHierarchy::getEntryDistance(const Box &box, const XrVector3f &origin, const XrVector3f &inverseDirection, float maxDistance) {
+    float entry = 0.f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        const float entryAxis = (getAxis(box.min, axis) - getAxis(origin, axis)) * getAxis(inverseDirection, axis);
+        const float exitAxis = (getAxis(box.max, axis) - getAxis(origin, axis)) * getAxis(inverseDirection, axis);
+        entry = std::max(entry, std::min(entryAxis, exitAxis));
+        exit = std::min(exit, std::max(entryAxis, exitAxis));
+    }
+
+    return entry <= exit ? entry : -1.f;
+}
+
+float BoundingVolumeHierarchy::getDistanceSquared(const Box &box, const XrVector3f &point) {
+    float distanceSquared = 0.f;
+    for (int axis = 0; axis < 3; axis++) {
+        const float value = getAxis(point, axis);
+        const float delta = std::max(std::max(getAxis(box.min, axis) - value, 0.f), value - getAxis(box.max, axis));
+        distanceSquared += delta * delta;
+    }
+    return distanceSquared;
+}
+
+int32_t BoundingVolumeHierarchy::allocateNode(Tree &tree) {
+    int32_t index;
+    if (tree.freeList != NO_NODE) {
+        index = tree.freeList;
+        tree.freeList = tree.nodes[index].parent;
+    }
+    else {
+        index = (int32_t)tree.nodes.size();
+        tree.nodes.emplace_back();
+    }
+
+    Node &node = tree.nodes[index];
+    node.box = {};
+    node.parent = NO_NODE;
+    node.children[0] = NO_NODE;
+    node.children[1] = NO_NODE;
+    node.height = 0;
+    node.item = NO_ITEM;
+    return index;
+}
+
+// The free list is threaded through the parent indices
+void BoundingVolumeHierarchy::freeNode(Tree &tree, int32_t index) {
+    Node &node = tree.nodes[index];
+    if (node.children[0] != NO_NODE) {
+        tree.innerArea -= getArea(node.box);
+    }
+
+    node.children[0] = NO_NODE;
+    node.children[1] = NO_NODE;
+    node.height = -1;
+    node.parent = tree.freeList;
+    tree.freeList = index;
+}
+
+// Every box change goes through here so that the cost of the inner nodes stays up to date
+void BoundingVolumeHierarchy::setBox(Tree &tree, int32_t index, const Box &box) {
+    Node &node = tree.nodes[index];
+    if (node.children[0] != NO_NODE) {
+        tree.innerArea += (double)getArea(box) - getArea(node.box);
+    }
+    node.box = box;
+}
+
+// Walks down to the sibling that makes the tree grow the least, including the growth of all the ancestors
+void BoundingVolumeHierarchy::insertLeaf(Tree &tree, int32_t leaf) {
+    if (tree.root == NO_NODE) {
+        tree.root = leaf;
+        tree.nodes[leaf].parent = NO_NODE;
+        return;
+    }
+
+    const Box leafBox = tree.nodes[leaf].box;
+    int32_t index = tree.root;
+    while (tree.nodes[index].children[0] != NO_NODE) {
+        const Node &node = tree.nodes[index];
+        const float area = getArea(node.box);
+        const float combinedArea = getArea(merge(node.box, leafBox));
+
+        // Pairing with this node, versus pushing the leaf further down which grows this node anyway
+        const float cost = 2.f * combinedArea;
+        const float inheritanceCost = 2.f * (combinedArea - area);
+
+        float childCosts[2];
+        for (int i = 0; i < 2; i++) {
+            const Node &child = tree.nodes[node.children[i]];
+            const float mergedArea = getArea(merge(child.box, leafBox));
+            childCosts[i] = (child.children[0] == NO_NODE ? mergedArea : mergedArea - getArea(child.box)) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1]) {
+            break;
+        }
+        index = childCosts[0] <= childCosts[1] ? node.children[0] : node.children[1];
+    }
+
+    const int32_t sibling = index;
+    const int32_t oldParent = tree.nodes[sibling].parent;
+    const int32_t newParent = allocateNode(tree);
+
+    tree.nodes[newParent].parent = oldParent;
+    tree.nodes[newParent].children[0] = sibling;
+    tree.nodes[newParent].children[1] = leaf;
+    tree.nodes[newParent].height = tree.nodes[sibling].height + 1;
+    setBox(tree, newParent, merge(tree.nodes[sibling].box, leafBox));
+
+    if (oldParent != NO_NODE) {
+        Node &parent = tree.nodes[oldParent];
+        parent.children[parent.children[0] == sibling ? 0 : 1] = newParent;
+    }
+    else {
+        tree.root = newParent;
+    }
+    tree.nodes[sibling].parent = newParent;
+    tree.nodes[leaf].parent = newParent;
+
+    refitAncestors(tree, newParent);
+}
+
+void BoundingVolumeHierarchy::removeLeaf(Tree &tree, int32_t leaf) {
+    if (leaf == tree.root) {
+        tree.root = NO_NODE;
+        return;
+    }
+
+    const int32_t parent = tree.nodes[leaf].parent;
+    const int32_t grandParent = tree.nodes[parent].parent;
+    const int32_t sibling = tree.nodes[parent].children[0] == leaf ? tree.nodes[parent].children[1] : tree.nodes[parent].children[0];
+
+    freeNode(tree, parent);
+    tree.nodes[sibling].parent = grandParent;
+    if (grandParent != NO_NODE) {
+        Node &node = tree.nodes[grandParent];
+        node.children[node.children[0] == parent ? 0 : 1] = sibling;
+        refitAncestors(tree, grandParent);
+    }
+    else {
+        tree.root = sibling;
+    }
+}
+
+// Rotates the taller grandchild up if the children's heights differ by more than one, returns the subtree's new root
+int32_t BoundingVolumeHierarchy::balance(Tree &tree, int32_t indexA) {
+    Node &a = tree.nodes[indexA];
+    if (a.children[0] == NO_NODE || a.height < 2) {
+        return indexA;
+    }
+
+    const int32_t indexB = a.children[0];
+    const int32_t indexC = a.children[1];
+    const int32_t heightDifference = tree.nodes[indexC].height - tree.nodes[indexB].height;
+    if (heightDifference >= -1 && heightDifference <= 1) {
+        return indexA;
+    }
+
+    // Up is the taller child, it takes A's place and A adopts the shorter of its children
+    const int up = heightDifference > 1 ? 1 : 0;
+    const int32_t indexUp = a.children[up];
+    const int32_t indexStay = a.children[1 - up];
+    Node &upNode = tree.nodes[indexUp];
+
+    const int32_t indexF = upNode.children[0];
+    const int32_t indexG = upNode.children[1];
+    const bool isFTaller = tree.nodes[indexF].height > tree.nodes[indexG].height;
+    const int32_t indexTaller = isFTaller ? indexF : indexG;
+    const int32_t indexShorter = isFTaller ? indexG : indexF;
+
+    upNode.children[0] = indexA;
+    upNode.parent = a.parent;
+    a.parent = indexUp;
+
+    if (upNode.parent != NO_NODE) {
+        Node &parent = tree.nodes[upNode.parent];
+        parent.children[parent.children[0] == indexA ? 0 : 1] = indexUp;
+    }
+    else {
+        tree.root = indexUp;
+    }
+
+    upNode.children[1] = indexTaller;
+    a.children[up] = indexShorter;
+    tree.nodes[indexShorter].parent = indexA;
+
+    a.height = 1 + std::max(tree.nodes[indexStay].height, tree.nodes[indexShorter].height);
+    setBox(tree, indexA, merge(tree.nodes[indexStay].box, tree.nodes[indexShorter].box));
+    upNode.height = 1 + std::max(a.height, tree.nodes[indexTaller].height);
+    setBox(tree, indexUp, merge(a.box, tree.nodes[indexTaller].box));
+
+    return indexUp;
+}
+
+void BoundingVolumeHierarchy::refitAncestors(Tree &tree, int32_t index) {
+    while (index != NO_NODE) {
+        index = balance(tree, index);
+
+        Node &node = tree.nodes[index];
+        const Node &child0 = tree.nodes[node.children[0]];
+        const Node &child1 = tree.nodes[node.children[1]];
+        node.height = 1 + std::max(child0.height, child1.height);
+        setBox(tree, index, merge(child0.box, child1.box));
+
+        index = node.parent;
+    }
+}
+
+void BoundingVolumeHierarchy::insertItem(Tree &tree, uint32_t item, const Box &box) {
+    if (item >= tree.leaves.size()) {
+        tree.leaves.resize(std::max<size_t>(item + 1, 2 * tree.leaves.size()), NO_NODE);
+    }
+
+    const int32_t leaf = allocateNode(tree);
+    tree.nodes[leaf].box = box;
+    tree.nodes[leaf].item = item;
+    tree.leaves[item] = leaf;
+    tree.itemCount++;
+
+    insertLeaf(tree, leaf);
+}
+
+void BoundingVolumeHierarchy::removeItem(Tree &tree, uint32_t item) {
+    const int32_t leaf = tree.leaves[item];
+    removeLeaf(tree, leaf);
+    freeNode(tree, leaf);
+
+    tree.leaves[item] = NO_NODE;
+    tree.itemCount--;
+}
+
+void BoundingVolumeHierarchy::renameItem(Tree &tree, uint32_t item, uint32_t newItem) {
+    if (newItem >= tree.leaves.size()) {
+        tree.leaves.resize(std::max<size_t>(newItem + 1, 2 * tree.leaves.size()), NO_NODE);
+    }
+
+    const int32_t leaf = tree.leaves[item];
+    tree.nodes[leaf].item = newItem;
+    tree.leaves[newItem] = leaf;
+    tree.leaves[item] = NO_NODE;
+}
+
+// Surface area heuristic: how many inner nodes a random ray hitting the root is expected to visit
+double BoundingVolumeHierarchy::getCost(const Tree &tree) {
+    if (tree.root == NO_NODE || tree.nodes[tree.root].children[0] == NO_NODE) {
+        return 0.;
+    }
+
+    const float rootArea = getArea(tree.nodes[tree.root].box);
+    return rootArea > 0.f ? tree.innerArea / rootArea : 0.;
+}
+
+BoundingVolumeHierarchy::Tree BoundingVolumeHierarchy::build(std::vector<BuildItem> items, size_t leafCapacity) {
+    Tree tree;
+    tree.leaves.assign(leafCapacity, NO_NODE);
+    tree.itemCount = items.size();
+    if (items.empty()) {
+        return tree;
+    }
+
+    tree.nodes.reserve(2 * items.size() - 1);
+    tree.root = buildNode(tree, items.data(), items.size(), NO_NODE, 0);
+    return tree;
+}
+
+// Top down with binned SAH splits along the axis the centroids spread the most on
+int32_t BoundingVolumeHierarchy::buildNode(Tree &tree, BuildItem *items, size_t count, int32_t parent, int depth) {
+    const int32_t index = allocateNode(tree);
+    tree.nodes[index].parent = parent;
+
+    if (count == 1) {
+        tree.nodes[index].box = items[0].box;
+        tree.nodes[index].item = items[0].item;
+        tree.leaves[items[0].item] = index;
+        return index;
+    }
+
+    Box centroidBounds{ items[0].centroid, items[0].centroid };
+    for (size_t i = 1; i < count; i++) {
+        centroidBounds = merge(centroidBounds, { items[i].centroid, items[i].centroid });
+    }
+
+    int axis = 0;
+    for (int i = 1; i < 3; i++) {
+        if (getAxis(centroidBounds.max, i) - getAxis(centroidBounds.min, i) > getAxis(centroidBounds.max, axis) - getAxis(centroidBounds.min, axis)) {
+            axis = i;
+        }
+    }
+    const float axisMin = getAxis(centroidBounds.min, axis);
+    const float extent = getAxis(centroidBounds.max, axis) - axisMin;
+
+    size_t middle = 0;
+    if (extent > 0.f && depth < MAX_SAH_DEPTH) {
+        const float binScale = BIN_COUNT / extent;
+        auto getBin = [&](const BuildItem &item) {
+            return std::min(BIN_COUNT - 1, (int)((getAxis(item.centroid, axis) - axisMin) * binScale));
+        };
+
+        Box binBoxes[BIN_COUNT];
+        size_t binCounts[BIN_COUNT] = {};
+        for (size_t i = 0; i < count; i++) {
+            const int bin = getBin(items[i]);
+            binBoxes[bin] = binCounts[bin] ? merge(binBoxes[bin], items[i].box) : items[i].box;
+            binCounts[bin]++;
+        }
+
+        // Cost of splitting after every bin, right sides swept first
+        float rightCosts[BIN_COUNT];
+        Box rightBox{};
+        size_t rightCount = 0;
+        for (int bin = BIN_COUNT - 1; bin > 0; bin--) {
+            if (binCounts[bin]) {
+                rightBox = rightCount ? merge(rightBox, binBoxes[bin]) : binBoxes[bin];
+                rightCount += binCounts[bin];
+            }
+            rightCosts[bin] = rightCount ? getArea(rightBox) * rightCount : 0.f;
+        }
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestSplit = 0;
+        Box leftBox{};
+        size_t leftCount = 0;
+        for (int bin = 0; bin < BIN_COUNT - 1; bin++) {
+            if (binCounts[bin]) {
+                leftBox = leftCount ? merge(leftBox, binBoxes[bin]) : binBoxes[bin];
+                leftCount += binCounts[bin];
+            }
+            if (!leftCount || leftCount == count) {
+                continue;
+            }
+
+            const float cost = getArea(leftBox) * leftCount + rightCosts[bin + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = bin + 1;
+            }
+        }
+
+        if (bestSplit) {
+            middle = std::partition(items, items + count, [&](const BuildItem &item) { return getBin(item) < bestSplit; }) - items;
+        }
+    }
+
+    // All centroids in one spot, or too deep already: median split
+    if (!middle || middle == count) {
+        middle = count / 2;
+        std::nth_element(items, items + middle, items + count, [axis](const BuildItem &a, const BuildItem &b) {
+            return getAxis(a.centroid, axis) < getAxis(b.centroid, axis);
+        });
+    }
+
+    const int32_t left = buildNode(tree, items, middle, index, depth + 1);
+    const int32_t right = buildNode(tree, items + middle, count - middle, index, depth + 1);
+
+    Node &node = tree.nodes[index];
+    node.children[0] = left;
+    node.children[1] = right;
+    node.height = 1 + std::max(tree.nodes[left].height, tree.nodes[right].height);
+    setBox(tree, index, merge(tree.nodes[left].box, tree.nodes[right].box));
+    return index;
+}
+
+std::vector<BoundingVolumeHierarchy::BuildItem> BoundingVolumeHierarchy::getBuildItems() const {
+    std::vector<BuildItem> items;
+    items.reserve(m_tree.itemCount);
+    for (uint32_t item = 0; item < m_tree.leaves.size(); item++) {
+        const int32_t leaf = m_tree.leaves[item];
+        if (leaf == NO_NODE) {
+            continue;
+        }
+
+        const Box &box = m_tree.nodes[leaf].box;
+        items.push_back({ item, box, { (box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f } });
+    }
+    return items;
+}
+
+void BoundingVolumeHierarchy::applyEdit(Tree &tree, const Edit &edit) {
+    switch (edit.type) {
+        case EditType::INSERT: {
+            insertItem(tree, edit.item, edit.box);
+
+            break;
+        }
+        case EditType::UPDATE: {
+            const int32_t leaf = tree.leaves[edit.item];
+            setBox(tree, leaf, edit.box);
+            refitAncestors(tree, tree.nodes[leaf].parent);
+
+            break;
+        }
+        case EditType::REMOVE: {
+            removeItem(tree, edit.item);
+
+            break;
+        }
+        case EditType::RENAME: {
+            renameItem(tree, edit.item, edit.newItem);
+
+            break;
+        }
+    }
+}
+
+// Edits made while a rebuild runs are replayed onto the rebuilt tree
+void BoundingVolumeHierarchy::recordEdit(const Edit &edit) {
+    if (m_rebuild.valid()) {
+        m_pendingEdits.push_back(edit);
+    }
+}
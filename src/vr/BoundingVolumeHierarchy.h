@@ -0,0 +1,208 @@
+#ifndef VR_BOUNDINGVOLUMEHIERARCHY_H
+#define VR_BOUNDINGVOLUMEHIERARCHY_H
+
+#include <openxr/openxr.h>
+
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <vector>
+
+
+// Dynamic AABB tree over items identified by a dense uint32_t id (e.g. an index into a vector). Inserts pick the
+// cheapest sibling and rebalance on the way up, edits only refit the ancestors. Since neither restores the quality
+// of a full build, the tree tracks its surface area cost and rebuilds itself on another thread once it degraded
+// too much, edits made in the meantime are replayed onto the new tree when it's swapped in by maintain()
+class BoundingVolumeHierarchy {
+public:
+    typedef struct Box {
+        XrVector3f min;
+        XrVector3f max;
+    };
+
+    typedef struct Hit {
+        uint32_t item = NO_ITEM;
+        float distance = std::numeric_limits<float>::infinity();
+    };
+
+    typedef struct Statistics {
+        size_t itemCount = 0;
+        size_t nodeCount = 0;
+        int height = 0;
+        // Surface area heuristic cost relative to the cost right after the last full build
+        float relativeCost = 1.f;
+        size_t rebuildCount = 0;
+    };
+
+    static constexpr uint32_t NO_ITEM = 0xFFFFFFFF;
+
+    BoundingVolumeHierarchy();
+    ~BoundingVolumeHierarchy();
+
+    // Bounds of a box of the given half extents, rotated and then moved to center
+    static Box getOrientedBoxBounds(const XrVector3f &center, const XrQuaternionf &rotation, const XrVector3f &halfExtents);
+    // Distance along the ray at which it enters the same box, negative if it misses it within maxDistance, for raycast
+    static float intersectOrientedBox(const XrVector3f &origin, const XrVector3f &direction, float maxDistance, const XrVector3f &center, const XrQuaternionf &rotation, const XrVector3f &halfExtents);
+
+    void insert(uint32_t item, const Box &box);
+    void update(uint32_t item, const Box &box);
+    void remove(uint32_t item);
+    // Gives the item the id of another one that isn't in the tree, e.g. after swapping it into a removed item's slot
+    void rename(uint32_t item, uint32_t newItem);
+    void clear();
+
+    bool contains(uint32_t item) const;
+    size_t size() const;
+
+    // Starts a rebuild if the tree degraded and swaps in a finished one, call it regularly e.g. once per frame
+    void maintain();
+    // Builds from scratch on this thread
+    void rebuild();
+    // Replaces everything with items 0 to boxes.size() - 1, built on another thread. They only show up in queries and
+    // size() once maintain() swapped the tree in, edits made until then must not touch them
+    void load(std::vector<Box> boxes);
+
+    // planes are viewCount sets of planeCount planes. Appends every item whose box is at least partly on the inner side
+    // of all planes (dot(xyz, p) + w >= 0) of any set
+    void queryFrustum(const XrVector4f *planes, int planeCount, uint32_t viewCount, std::vector<uint32_t> &items);
+    // Closest item along the ray. hitTest(item, origin, direction, maxDistance) returns the exact distance to the
+    // item or a negative value if it's missed, direction doesn't have to be normalized, distances are in its units
+    template<typename HitTest>
+    Hit raycast(const XrVector3f &origin, const XrVector3f &direction, float maxDistance, HitTest &&hitTest);
+    // Item with the closest box, within maxDistance
+    Hit findNearest(const XrVector3f &point, float maxDistance);
+
+    Statistics getStatistics() const;
+
+private:
+    static constexpr int32_t NO_NODE = -1;
+    // Rebuilds once the cost grew by half, but not for small trees where rebuilding costs more than it saves
+    static constexpr float REBUILD_COST_RATIO = 1.5f;
+    static const size_t MIN_REBUILD_ITEM_COUNT = 4096;
+    static const int BIN_COUNT = 16;
+
+    typedef struct Node {
+        Box box;
+        int32_t parent;
+        int32_t children[2];
+        int32_t height;
+        uint32_t item;
+    };
+
+    typedef struct Tree {
+        std::vector<Node> nodes;
+        int32_t root = NO_NODE;
+        int32_t freeList = NO_NODE;
+        // Sum of the surface areas of all inner nodes
+        double innerArea = 0.;
+        // Leaf node of every item, NO_NODE if it isn't in the tree
+        std::vector<int32_t> leaves;
+        size_t itemCount = 0;
+    };
+
+    enum class EditType {
+        INSERT,
+        UPDATE,
+        REMOVE,
+        RENAME
+    };
+
+    typedef struct Edit {
+        EditType type;
+        uint32_t item;
+        uint32_t newItem;
+        Box box;
+    };
+
+    typedef struct BuildItem {
+        uint32_t item;
+        Box box;
+        XrVector3f centroid;
+    };
+
+    Tree m_tree;
+    // Cost relative to the root's area right after the last full build
+    double m_builtCost = 0.;
+    size_t m_rebuildCount = 0;
+
+    std::future<Tree> m_rebuild;
+    std::vector<Edit> m_pendingEdits;
+
+    std::vector<int32_t> m_stack;
+
+    static float getArea(const Box &box);
+    static Box merge(const Box &a, const Box &b);
+    static float getEntryDistance(const Box &box, const XrVector3f &origin, const XrVector3f &inverseDirection, float maxDistance);
+    static float getDistanceSquared(const Box &box, const XrVector3f &point);
+
+    static int32_t allocateNode(Tree &tree);
+    static void freeNode(Tree &tree, int32_t node);
+    static void setBox(Tree &tree, int32_t node, const Box &box);
+    static void insertLeaf(Tree &tree, int32_t leaf);
+    static void removeLeaf(Tree &tree, int32_t leaf);
+    static int32_t balance(Tree &tree, int32_t node);
+    static void refitAncestors(Tree &tree, int32_t node);
+    static void insertItem(Tree &tree, uint32_t item, const Box &box);
+    static void removeItem(Tree &tree, uint32_t item);
+    static void renameItem(Tree &tree, uint32_t item, uint32_t newItem);
+    static double getCost(const Tree &tree);
+
+    static Tree build(std::vector<BuildItem> items, size_t leafCapacity);
+    static int32_t buildNode(Tree &tree, BuildItem *items, size_t count, int32_t parent, int depth);
+
+    std::vector<BuildItem> getBuildItems() const;
+    void applyEdit(Tree &tree, const Edit &edit);
+    void recordEdit(const Edit &edit);
+};
+
+template<typename HitTest>
+BoundingVolumeHierarchy::Hit BoundingVolumeHierarchy::raycast(const XrVector3f &origin, const XrVector3f &direction, float maxDistance, HitTest &&hitTest) {
+    Hit hit;
+    hit.distance = maxDistance;
+    if (m_tree.root == NO_NODE) {
+        hit.distance = std::numeric_limits<float>::infinity();
+        return hit;
+    }
+
+    const XrVector3f inverseDirection{ 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+
+    m_stack.clear();
+    m_stack.push_back(m_tree.root);
+    while (!m_stack.empty()) {
+        const Node &node = m_tree.nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if (getEntryDistance(node.box, origin, inverseDirection, hit.distance) < 0.f) {
+            continue;
+        }
+
+        if (node.children[0] == NO_NODE) {
+            const float distance = hitTest(node.item, origin, direction, hit.distance);
+            if (distance >= 0.f && distance <= hit.distance) {
+                hit.item = node.item;
+                hit.distance = distance;
+            }
+            continue;
+        }
+
+        // Nearer child last so it's visited first and shrinks the ray for the other one
+        const float distances[2] = {
+            getEntryDistance(m_tree.nodes[node.children[0]].box, origin, inverseDirection, hit.distance),
+            getEntryDistance(m_tree.nodes[node.children[1]].box, origin, inverseDirection, hit.distance)
+        };
+        const int nearer = distances[1] >= 0.f && (distances[0] < 0.f || distances[1] < distances[0]) ? 1 : 0;
+        if (distances[1 - nearer] >= 0.f) {
+            m_stack.push_back(node.children[1 - nearer]);
+        }
+        if (distances[nearer] >= 0.f) {
+            m_stack.push_back(node.children[nearer]);
+        }
+    }
+
+    if (hit.item == NO_ITEM) {
+        hit.distance = std::numeric_limits<float>::infinity();
+    }
+    return hit;
+}
+
+#endif //VR_BOUNDINGVOLUMEHIERARCHY_H
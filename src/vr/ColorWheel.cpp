@@ -0,0 +1,126 @@
+#include "vr/ColorWheel.h"
+
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+
+void ColorWheel::update(float x, float y, bool isClickStarted, XrColor4f &color) {
+    const float radius = getRadius(x, y);
+
+    // The built-in deadzones into the Reverb G2 controllers' thumbsticks make this a bit awkward
+    if (radius < ACTIVATION_RADIUS) {
+        // The color picker is not enabled so there's no starting angle for CWB
+        m_startingAngle = -1;
+        return;
+    }
+
+    float angle = acos(x / radius);
+    if (y < 0) {
+        angle = 2 * M_PI - angle;
+    }
+
+    if (isClickStarted) {
+        m_startingAngle = angle;
+        m_originalColor = color;
+    }
+    else if (m_startingAngle >= 0) {
+        color = getShade(m_originalColor, m_startingAngle, angle);
+    }
+    else {
+        color = getHue(angle);
+    }
+}
+
+float ColorWheel::getRadius(float x, float y) {
+    return sqrt(pow(x, 2) + pow(y, 2));
+}
+
+// RGB
+// TODO possibly add a second dimension for intensity of the colour
+XrColor4f ColorWheel::getHue(float angle) {
+    XrColor4f color{ 0.f, 0.f, 0.f, 1.f };
+    if (11. / 6. * M_PI < angle || angle <= 1. / 2. * M_PI) {
+        color.g = 0;
+        if (11. / 6. * M_PI < angle) {
+            float angleDelta = angle - 11. / 6. * M_PI;
+            color.r = angleDelta / (2. / 3. * M_PI);
+            color.b = 1 - color.r;
+        }
+        else {
+            float angleDelta = 1. / 2. * M_PI - angle;
+            color.b = angleDelta / (2. / 3. * M_PI);
+            color.r = 1 - color.b;
+        }
+    }
+    else if (1. / 2. * M_PI < angle && angle <= 7. / 6. * M_PI) {
+        color.b = 0;
+        float angleDelta = angle - 1. / 2. * M_PI;
+        color.g = angleDelta / (2. / 3. * M_PI);
+        color.r = 1 - color.g;
+    }
+    else {
+        color.r = 0;
+        float angleDelta = angle - 7. / 6. * M_PI;
+        color.b = angleDelta / (2. / 3. * M_PI);
+        color.g = 1 - color.b;
+    }
+
+    return color;
+}
+
+// CURRENT COLOR, WHITE AND BLACK
+XrColor4f ColorWheel::getShade(const XrColor4f &originalColor, float startingAngle, float angle) {
+    XrColor4f color{ 0.f, 0.f, 0.f, originalColor.a };
+
+    bool isClockwise;
+    if (startingAngle < angle) {
+        isClockwise = false;
+    }
+    else {
+        isClockwise = true;
+    }
+
+    float angleDelta = std::abs(angle - startingAngle);
+    if (M_PI < angleDelta) {
+        isClockwise = !isClockwise;
+        angleDelta = 2 * M_PI - std::abs(angle - startingAngle);
+    }
+
+    // Direction with shortest path from the original angle to the current angle
+    if (isClockwise) {
+        // Old color -> black
+        if (angleDelta <= 2. / 3. * M_PI) {
+            float multiplier = (1. - angleDelta / (2. / 3. * M_PI));
+            color.r = originalColor.r * multiplier;
+            color.g = originalColor.g * multiplier;
+            color.b = originalColor.b * multiplier;
+        }
+        // Black -> white
+        else {
+            color.r = 1. * ((angleDelta - 2. / 3. * M_PI) / (2. / 3. * M_PI));
+            color.g = color.r;
+            color.b = color.r;
+        }
+    }
+    else {
+        // Old color -> white
+        if (angleDelta <= 2. / 3. * M_PI) {
+            float multiplier = (angleDelta / (2. / 3. * (float)M_PI));
+            color.r = originalColor.r + (1. - originalColor.r) * multiplier;
+            color.g = originalColor.g + (1. - originalColor.g) * multiplier;
+            color.b = originalColor.b + (1. - originalColor.b) * multiplier;
+        }
+        // White -> black
+        else {
+            color.r = 1. * (1. - (angleDelta - 2. / 3. * M_PI) / (2. / 3. * M_PI));
+            color.g = color.r;
+            color.b = color.r;
+        }
+    }
+
+    return color;
+}
@@ -0,0 +1,26 @@
+#ifndef VR_COLORWHEEL_H
+#define VR_COLORWHEEL_H
+
+#include <openxr/openxr.h>
+
+
+// The thumbstick color picker of one hand. Pushing the stick picks a hue by its angle, clicking it while pushed and
+// then turning moves the color the hand had at the click towards black one way and towards white the other
+class ColorWheel {
+public:
+    // Below this the stick is considered centered, 1 == max radius
+    static constexpr float ACTIVATION_RADIUS = 0.25f;
+
+    // isClickStarted: the thumbstick got pressed since the last update
+    void update(float x, float y, bool isClickStarted, XrColor4f &color);
+
+    static float getRadius(float x, float y);
+    static XrColor4f getHue(float angle);
+    static XrColor4f getShade(const XrColor4f &originalColor, float startingAngle, float angle);
+
+private:
+    float m_startingAngle = -1;
+    XrColor4f m_originalColor;
+};
+
+#endif //VR_COLORWHEEL_H
@@ -0,0 +1,26 @@
+#ifndef VR_EGLGRAPHICSBINDING_H
+#define VR_EGLGRAPHICSBINDING_H
+
+#include <epoxy/egl.h>
+
+#include <openxr/openxr.h>
+
+
+// XR_MNDX_egl_enable, newer than the 1.0.10 headers this project uses, so it's mirrored here under its own names
+// to not clash with headers that do have it
+#define OPENXRTEST_MNDX_EGL_ENABLE_EXTENSION_NAME "XR_MNDX_egl_enable"
+
+static const XrStructureType OPENXRTEST_TYPE_GRAPHICS_BINDING_EGL_MNDX = static_cast<XrStructureType>(1000048004);
+
+typedef PFN_xrVoidFunction (*PFN_OpenXRTestEglGetProcAddressMNDX)(const char *name);
+
+typedef struct OpenXRTestGraphicsBindingEGLMNDX {
+    XrStructureType type;
+    const void *next;
+    PFN_OpenXRTestEglGetProcAddressMNDX getProcAddress;
+    EGLDisplay display;
+    EGLConfig config;
+    EGLContext context;
+} OpenXRTestGraphicsBindingEGLMNDX;
+
+#endif //VR_EGLGRAPHICSBINDING_H
@@ -0,0 +1,100 @@
+#ifndef VR_FRAMEPIPELINE_H
+#define VR_FRAMEPIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+// Hands frames from the simulation thread to the render thread without locks. One slot is being written, one read and
+// up to depth are published in between, with a depth of 1 that's a triple buffer. Unlike a triple buffer nothing gets
+// overwritten, every frame the simulation waited on has to be begun and ended, so the writer blocks while the frame
+// being read and depth more are in the pipeline. Only one thread may write and only one read
+template<typename T>
+class FramePipeline {
+public:
+    explicit FramePipeline(uint32_t depth) : m_slots(depth + 2) {
+        if (!depth) {
+            throw std::runtime_error("Frame pipeline needs a depth of at least 1");
+        }
+    }
+
+    // The slot to fill next, blocks while the pipeline is full, nullptr once it's closed
+    T *beginWrite() {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        // The sequence is loaded before the condition is checked so a change in between ends the wait right away
+        uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+        // The frame at the tail counts until it's done being read, the last slot is the one written
+        while (head - m_tail.load(std::memory_order_acquire) == m_slots.size() - 1 && !m_isClosed.load(std::memory_order_acquire)) {
+            m_sequence.wait(sequence, std::memory_order_acquire);
+            sequence = m_sequence.load(std::memory_order_acquire);
+        }
+
+        if (m_isClosed.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[head % m_slots.size()];
+    }
+
+    void endWrite() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        signal();
+    }
+
+    // The oldest published frame, blocks while there's none, nullptr once the pipeline is closed and empty
+    const T *beginRead() {
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+        while (m_head.load(std::memory_order_acquire) == tail) {
+            if (m_isClosed.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            m_sequence.wait(sequence, std::memory_order_acquire);
+            sequence = m_sequence.load(std::memory_order_acquire);
+        }
+
+        return &m_slots[tail % m_slots.size()];
+    }
+
+    void endRead() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        signal();
+    }
+
+    // For the writer, blocks until the reader is done with everything written or the pipeline is closed
+    void waitUntilEmpty() {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+        while (m_tail.load(std::memory_order_acquire) != head && !m_isClosed.load(std::memory_order_acquire)) {
+            m_sequence.wait(sequence, std::memory_order_acquire);
+            sequence = m_sequence.load(std::memory_order_acquire);
+        }
+    }
+
+    // Stops the writer, the reader still gets the frames already published
+    void close() {
+        m_isClosed.store(true, std::memory_order_release);
+        signal();
+    }
+
+    uint32_t getDepth() const {
+        return (uint32_t)m_slots.size() - 2;
+    }
+
+private:
+    std::vector<T> m_slots;
+    // Frames published and frames read, wide enough to never wrap around
+    alignas(64) std::atomic<uint64_t> m_head{ 0 };
+    alignas(64) std::atomic<uint64_t> m_tail{ 0 };
+    // Bumped on every change, what both sides block on
+    alignas(64) std::atomic<uint32_t> m_sequence{ 0 };
+    std::atomic<bool> m_isClosed{ false };
+
+    void signal() {
+        m_sequence.fetch_add(1, std::memory_order_release);
+        m_sequence.notify_all();
+    }
+};
+
+#endif //VR_FRAMEPIPELINE_H
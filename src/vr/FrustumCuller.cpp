@@ -0,0 +1,268 @@
+#include "vr/FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUMCULLER_SSE
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define FRUSTUMCULLER_NEON
+#include <arm_neon.h>
+#endif
+
+
+
+static XrVector3f rotate(const XrQuaternionf &q, const XrVector3f &v) {
+    // v + 2w(q x v) + 2q x (q x v)
+    const XrVector3f t{
+        2.f * (q.y * v.z - q.z * v.y),
+        2.f * (q.z * v.x - q.x * v.z),
+        2.f * (q.x * v.y - q.y * v.x)
+    };
+
+    return {
+        v.x + q.w * t.x + (q.y * t.z - q.z * t.y),
+        v.y + q.w * t.y + (q.z * t.x - q.x * t.z),
+        v.z + q.w * t.z + (q.x * t.y - q.y * t.x)
+    };
+}
+
+static float distance(const XrVector4f &plane, const XrVector3f &point) {
+    return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w;
+}
+
+void FrustumCuller::add(const XrVector3f &center, float radius) {
+    m_centersX.push_back(center.x);
+    m_centersY.push_back(center.y);
+    m_centersZ.push_back(center.z);
+    m_radii.push_back(radius);
+    growScratch();
+}
+
+void FrustumCuller::remove(size_t index) {
+    for (std::vector<float> *values : { &m_centersX, &m_centersY, &m_centersZ, &m_radii }) {
+        (*values)[index] = values->back();
+        values->pop_back();
+    }
+}
+
+void FrustumCuller::reserve(size_t count) {
+    for (std::vector<float> *values : { &m_centersX, &m_centersY, &m_centersZ, &m_radii }) {
+        values->reserve(count);
+    }
+    growScratch();
+}
+
+// Room for every sphere there's capacity for, so culling never allocates
+void FrustumCuller::growScratch() {
+    const size_t capacity = m_radii.capacity();
+    if (m_visibleScratch.size() < capacity) {
+        m_visibleScratch.resize(capacity);
+        m_chunkVisibleCounts.resize(capacity / PARALLEL_GRAIN_SIZE + 1);
+    }
+}
+
+void FrustumCuller::clear() {
+    m_centersX.clear();
+    m_centersY.clear();
+    m_centersZ.clear();
+    m_radii.clear();
+}
+
+size_t FrustumCuller::size() const {
+    return m_radii.size();
+}
+
+void FrustumCuller::createViewPlanes(XrVector4f *planes, const XrView &view, float nearZ, float farZ) {
+    const XrFovf &fov = view.fov;
+
+    // Inward facing normals in view space, -Z is forward
+    const XrVector3f normals[PLANE_COUNT] = {
+        { cosf(fov.angleLeft), 0.f, sinf(fov.angleLeft) },
+        { -cosf(fov.angleRight), 0.f, -sinf(fov.angleRight) },
+        { 0.f, cosf(fov.angleDown), sinf(fov.angleDown) },
+        { 0.f, -cosf(fov.angleUp), -sinf(fov.angleUp) },
+        { 0.f, 0.f, -1.f },
+        { 0.f, 0.f, 1.f }
+    };
+    const float distances[PLANE_COUNT] = { 0.f, 0.f, 0.f, 0.f, -nearZ, farZ };
+
+    const XrVector3f &position = view.pose.position;
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        const XrVector3f normal = rotate(view.pose.orientation, normals[i]);
+        planes[i] = {
+            normal.x,
+            normal.y,
+            normal.z,
+            distances[i] - (normal.x * position.x + normal.y * position.y + normal.z * position.z)
+        };
+    }
+}
+
+// Every view keeps its own planes, one frustum merged from them only encloses both while the views are parallel and
+// canted displays or uneven fields of view would cut off what one of the eyes sees
+void FrustumCuller::setFrustum(const XrView *views, uint32_t viewCount, float nearZ, float farZ) {
+    m_viewCount = std::min(viewCount, MAX_VIEW_COUNT);
+    for (uint32_t i = 0; i < m_viewCount; i++) {
+        createViewPlanes(&m_planes[i * PLANE_COUNT], views[i], nearZ, farZ);
+    }
+}
+
+void FrustumCuller::cull(std::vector<uint32_t> &visibleIndices) {
+    const size_t count = m_radii.size();
+    const size_t visibleCount = cullRange(0, count, m_visibleScratch.data());
+    visibleIndices.assign(m_visibleScratch.data(), m_visibleScratch.data() + visibleCount);
+
+    m_statistics.visibleCount = visibleCount;
+    m_statistics.culledCount = count - visibleCount;
+}
+
+void FrustumCuller::cull(std::vector<uint32_t> &visibleIndices, JobSystem &jobSystem) {
+    const size_t count = m_radii.size();
+    if (count < PARALLEL_MIN_COUNT || jobSystem.getThreadCount() == 1) {
+        cull(visibleIndices);
+        return;
+    }
+
+    // Every chunk writes its visible spheres to the start of its own range of the scratch, then they get packed
+    jobSystem.parallelFor((uint32_t)count, PARALLEL_GRAIN_SIZE, [this](uint32_t begin, uint32_t end) {
+        m_chunkVisibleCounts[begin / PARALLEL_GRAIN_SIZE] = cullRange(begin, end, m_visibleScratch.data() + begin);
+    });
+
+    visibleIndices.clear();
+    const uint32_t chunkCount = JobSystem::getChunkCount((uint32_t)count, PARALLEL_GRAIN_SIZE);
+    for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+        const uint32_t *chunkIndices = m_visibleScratch.data() + (size_t)chunk * PARALLEL_GRAIN_SIZE;
+        visibleIndices.insert(visibleIndices.end(), chunkIndices, chunkIndices + m_chunkVisibleCounts[chunk]);
+    }
+
+    m_statistics.visibleCount = visibleIndices.size();
+    m_statistics.culledCount = count - visibleIndices.size();
+}
+
+// Writes every index unconditionally and only moves past the visible ones, no branch per sphere
+size_t FrustumCuller::cullRange(size_t begin, size_t end, uint32_t *visibleIndices) const {
+    const float *centersX = m_centersX.data();
+    const float *centersY = m_centersY.data();
+    const float *centersZ = m_centersZ.data();
+    const float *radii = m_radii.data();
+
+    size_t visibleCount = 0;
+    size_t i = begin;
+
+#if defined(__AVX__)
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(centersX + i);
+        const __m256 y = _mm256_loadu_ps(centersY + i);
+        const __m256 z = _mm256_loadu_ps(centersZ + i);
+        const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radii + i));
+
+        __m256 visible = _mm256_setzero_ps();
+        for (uint32_t view = 0; view < m_viewCount; view++) {
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int j = 0; j < PLANE_COUNT; j++) {
+                const XrVector4f &plane = m_planes[view * PLANE_COUNT + j];
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+                d = _mm256_add_ps(d, _mm256_mul_ps(y, _mm256_set1_ps(plane.y)));
+                d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(plane.z)));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negativeRadius, _CMP_GE_OQ));
+            }
+            visible = _mm256_or_ps(visible, inside);
+        }
+
+        const int mask = _mm256_movemask_ps(visible);
+        for (int lane = 0; lane < 8; lane++) {
+            visibleIndices[visibleCount] = (uint32_t)(i + lane);
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+#endif
+
+#if defined(FRUSTUMCULLER_SSE)
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(centersX + i);
+        const __m128 y = _mm_loadu_ps(centersY + i);
+        const __m128 z = _mm_loadu_ps(centersZ + i);
+        const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radii + i));
+
+        __m128 visible = _mm_setzero_ps();
+        for (uint32_t view = 0; view < m_viewCount; view++) {
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int j = 0; j < PLANE_COUNT; j++) {
+                const XrVector4f &plane = m_planes[view * PLANE_COUNT + j];
+                __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+                d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+                d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negativeRadius));
+            }
+            visible = _mm_or_ps(visible, inside);
+        }
+
+        const int mask = _mm_movemask_ps(visible);
+        for (int lane = 0; lane < 4; lane++) {
+            visibleIndices[visibleCount] = (uint32_t)(i + lane);
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+#elif defined(FRUSTUMCULLER_NEON)
+    for (; i + 4 <= end; i += 4) {
+        const float32x4_t x = vld1q_f32(centersX + i);
+        const float32x4_t y = vld1q_f32(centersY + i);
+        const float32x4_t z = vld1q_f32(centersZ + i);
+        const float32x4_t negativeRadius = vnegq_f32(vld1q_f32(radii + i));
+
+        uint32x4_t visible = vdupq_n_u32(0);
+        for (uint32_t view = 0; view < m_viewCount; view++) {
+            uint32x4_t inside = vdupq_n_u32(0xFFFFFFFF);
+            for (int j = 0; j < PLANE_COUNT; j++) {
+                const XrVector4f &plane = m_planes[view * PLANE_COUNT + j];
+                float32x4_t d = vmlaq_n_f32(vdupq_n_f32(plane.w), x, plane.x);
+                d = vmlaq_n_f32(d, y, plane.y);
+                d = vmlaq_n_f32(d, z, plane.z);
+                inside = vandq_u32(inside, vcgeq_f32(d, negativeRadius));
+            }
+            visible = vorrq_u32(visible, inside);
+        }
+
+        uint32_t lanes[4];
+        vst1q_u32(lanes, visible);
+        for (int lane = 0; lane < 4; lane++) {
+            visibleIndices[visibleCount] = (uint32_t)(i + lane);
+            visibleCount += lanes[lane] & 1;
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        const XrVector3f center{ centersX[i], centersY[i], centersZ[i] };
+
+        bool isVisible = false;
+        for (uint32_t view = 0; view < m_viewCount && !isVisible; view++) {
+            isVisible = true;
+            for (int j = 0; j < PLANE_COUNT; j++) {
+                if (distance(m_planes[view * PLANE_COUNT + j], center) < -radii[i]) {
+                    isVisible = false;
+                    break;
+                }
+            }
+        }
+
+        visibleIndices[visibleCount] = (uint32_t)i;
+        visibleCount += isVisible;
+    }
+
+    return visibleCount;
+}
+
+const XrVector4f *FrustumCuller::getPlanes() const {
+    return m_planes;
+}
+
+uint32_t FrustumCuller::getViewCount() const {
+    return m_viewCount;
+}
+
+const FrustumCuller::Statistics &FrustumCuller::getStatistics() const {
+    return m_statistics;
+}
@@ -0,0 +1,65 @@
+#ifndef VR_FRUSTUMCULLER_H
+#define VR_FRUSTUMCULLER_H
+
+#include "vr/JobSystem.h"
+
+#include <openxr/openxr.h>
+
+#include <vector>
+
+// Tests bounding spheres against the frustum of every view, several spheres per iteration. A sphere is kept if any
+// view sees it, the same test the GPU culling runs
+class FrustumCuller {
+public:
+    static const int PLANE_COUNT = 6;
+    static const uint32_t MAX_VIEW_COUNT = 2;
+    // Fewer spheres than that are culled on the calling thread alone, the chunks are a multiple of the widest SIMD path
+    static const size_t PARALLEL_MIN_COUNT = 32768;
+    static const uint32_t PARALLEL_GRAIN_SIZE = 8192;
+
+    typedef struct Statistics {
+        size_t visibleCount = 0;
+        size_t culledCount = 0;
+    };
+
+    void add(const XrVector3f &center, float radius);
+    // The last sphere takes the removed one's index
+    void remove(size_t index);
+    void clear();
+    void reserve(size_t count);
+    size_t size() const;
+
+    void setFrustum(const XrView *views, uint32_t viewCount, float nearZ, float farZ);
+    void cull(std::vector<uint32_t> &visibleIndices);
+    // Same result, in chunks spread over the job system's threads
+    void cull(std::vector<uint32_t> &visibleIndices, JobSystem &jobSystem);
+
+    // The planes of the last setFrustum, PLANE_COUNT per view, for testing other volumes against the same frustums
+    const XrVector4f *getPlanes() const;
+    uint32_t getViewCount() const;
+    // The PLANE_COUNT planes of a single view, in the same order and form
+    static void createViewPlanes(XrVector4f *planes, const XrView &view, float nearZ, float farZ);
+    const Statistics &getStatistics() const;
+
+private:
+    // Structure of arrays so that the SIMD paths can load several spheres at once
+    std::vector<float> m_centersX;
+    std::vector<float> m_centersY;
+    std::vector<float> m_centersZ;
+    std::vector<float> m_radii;
+
+    // xyz is the inward facing normal, w the distance, a point is inside when dot(normal, point) + w >= 0
+    XrVector4f m_planes[MAX_VIEW_COUNT * PLANE_COUNT];
+    uint32_t m_viewCount = 0;
+    Statistics m_statistics;
+
+    // Where the spheres are culled into before the visible ones are copied out, and how many each parallel chunk found
+    std::vector<uint32_t> m_visibleScratch;
+    std::vector<size_t> m_chunkVisibleCounts;
+
+    void growScratch();
+    // Writes the indices of the visible spheres in [begin, end) to visibleIndices and returns how many there are
+    size_t cullRange(size_t begin, size_t end, uint32_t *visibleIndices) const;
+};
+
+#endif //VR_FRUSTUMCULLER_H
@@ -0,0 +1,127 @@
+#include "vr/HandInput.h"
+
+#include <algorithm>
+
+
+
+const HandInput::ActionDefinition HandInput::ACTIONS[ACTION_COUNT] = {
+    { "pose", "Pose", XR_ACTION_TYPE_POSE_INPUT },
+    { "place", "Place", XR_ACTION_TYPE_BOOLEAN_INPUT },
+    { "remove", "Remove", XR_ACTION_TYPE_BOOLEAN_INPUT },
+    { "expand", "Expand", XR_ACTION_TYPE_FLOAT_INPUT },
+    { "shrink", "Shrink", XR_ACTION_TYPE_FLOAT_INPUT },
+    { "modifier_xa", "Modifier XA", XR_ACTION_TYPE_BOOLEAN_INPUT },
+    { "modifier_yb", "Modifier YB", XR_ACTION_TYPE_BOOLEAN_INPUT },
+    { "thumbstick_x", "Thumbstick X", XR_ACTION_TYPE_FLOAT_INPUT },
+    { "thumbstick_y", "Thumbstick Y", XR_ACTION_TYPE_FLOAT_INPUT }
+};
+
+// The menu button is left out, the SteamVR runtime hijacks it: "Invalid input type click for controller"
+const HandInput::ProfileBindings HandInput::PROFILES[] = {
+    {
+        "/interaction_profiles/hp/mixed_reality_controller",
+        {
+            { "/input/grip/pose", "/input/grip/pose" },
+            { "/input/thumbstick/click", "/input/thumbstick/click" },
+            // Shares the click with placing, the XA modifier tells them apart
+            { "/input/thumbstick/click", "/input/thumbstick/click" },
+            { "/input/trigger/value", "/input/trigger/value" },
+            { "/input/squeeze/value", "/input/squeeze/value" },
+            { "/input/x/click", "/input/a/click" },
+            { "/input/y/click", "/input/b/click" },
+            { "/input/thumbstick/x", "/input/thumbstick/x" },
+            { "/input/thumbstick/y", "/input/thumbstick/y" }
+        }
+    },
+    // Same layout, a core profile so it works without the HP extension
+    {
+        "/interaction_profiles/oculus/touch_controller",
+        {
+            { "/input/grip/pose", "/input/grip/pose" },
+            { "/input/thumbstick/click", "/input/thumbstick/click" },
+            { "/input/thumbstick/click", "/input/thumbstick/click" },
+            { "/input/trigger/value", "/input/trigger/value" },
+            { "/input/squeeze/value", "/input/squeeze/value" },
+            { "/input/x/click", "/input/a/click" },
+            { "/input/y/click", "/input/b/click" },
+            { "/input/thumbstick/x", "/input/thumbstick/x" },
+            { "/input/thumbstick/y", "/input/thumbstick/y" }
+        }
+    }
+};
+
+const int HandInput::PROFILE_COUNT = sizeof(PROFILES) / sizeof(PROFILES[0]);
+
+const char *const HandInput::HAND_PATHS[HAND_COUNT] = { "/user/hand/left", "/user/hand/right" };
+
+HandInput::Commands HandInput::update(const Snapshot &snapshot, const Snapshot &otherSnapshot) {
+    Commands commands;
+
+    // Not enough buttons and no interface -> modifiers
+    const bool modifierXA = snapshot[Action::MODIFIER_XA].value != 0.f;
+    const bool modifierYB = snapshot[Action::MODIFIER_YB].value != 0.f;
+
+    const float thumbstickX = snapshot[Action::THUMBSTICK_X].value;
+    const float thumbstickY = snapshot[Action::THUMBSTICK_Y].value;
+    const bool isCentered = ColorWheel::getRadius(thumbstickX, thumbstickY) < ColorWheel::ACTIVATION_RADIUS;
+    const bool isClickStarted = snapshot.isPressStarted(Action::PLACE);
+
+    // REMOVE, shares the thumbstick click with placing so it's behind the XA modifier
+    if (modifierXA && isCentered && snapshot.isPressStarted(Action::REMOVE)) {
+        commands.isRemoveRequested = true;
+    }
+    // PLACE
+    else if (isCentered && isClickStarted) {
+        commands.isPlaceRequested = true;
+        commands.placeTime = snapshot[Action::PLACE].lastChangeTime;
+        commands.placeColor = m_color;
+        commands.placeScale = m_scale;
+    }
+
+    m_colorWheel.update(thumbstickX, thumbstickY, isClickStarted, m_color);
+
+    static const float RESIZE_SPEED = ((MAX_CUBE_SCALE - 1) + 10 * (1 - MIN_CUBE_SCALE)) * 0.001f;
+
+    const float expand = snapshot[Action::EXPAND].value;
+    if (expand && std::min(std::min(m_scale.x, m_scale.y), m_scale.z) < MAX_CUBE_SCALE) {
+        resize(expand * RESIZE_SPEED, modifierXA, modifierYB);
+    }
+
+    const float shrink = snapshot[Action::SHRINK].value;
+    if (shrink && std::max(std::max(m_scale.x, m_scale.y), m_scale.z) > MIN_CUBE_SCALE) {
+        resize(-shrink * RESIZE_SPEED, modifierXA, modifierYB);
+    }
+
+    commands.isTypeToggled = otherSnapshot[Action::MODIFIER_XA].value != 0.f && snapshot.isPressStarted(Action::MODIFIER_YB);
+
+    return commands;
+}
+
+const XrColor4f &HandInput::getColor() const {
+    return m_color;
+}
+
+const XrVector3f &HandInput::getScale() const {
+    return m_scale;
+}
+
+void HandInput::resize(float delta, bool modifierXA, bool modifierYB) {
+    auto resizeAxis = [delta](float &axis) {
+        axis = std::clamp(axis + delta, MIN_CUBE_SCALE, MAX_CUBE_SCALE);
+    };
+
+    if (modifierXA && modifierYB) {
+        resizeAxis(m_scale.z);
+    }
+    else if (modifierXA) {
+        resizeAxis(m_scale.x);
+    }
+    else if (modifierYB) {
+        resizeAxis(m_scale.y);
+    }
+    else {
+        resizeAxis(m_scale.x);
+        resizeAxis(m_scale.y);
+        resizeAxis(m_scale.z);
+    }
+}
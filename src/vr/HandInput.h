@@ -0,0 +1,95 @@
+#ifndef VR_HANDINPUT_H
+#define VR_HANDINPUT_H
+
+#include "vr/ColorWheel.h"
+
+#include <openxr/openxr.h>
+
+
+// The controller actions, declared once in tables that drive creating them, suggesting their bindings and fetching
+// their states, and what a hand does with those states. update() depends on nothing but its arguments and the hand's
+// own tool, so recorded snapshots play back the same offline as they did on the headset
+class HandInput {
+public:
+    enum class Action {
+        POSE,
+        PLACE,
+        REMOVE,
+        EXPAND,
+        SHRINK,
+        MODIFIER_XA,
+        MODIFIER_YB,
+        THUMBSTICK_X,
+        THUMBSTICK_Y,
+        COUNT
+    };
+
+    static const int ACTION_COUNT = (int)Action::COUNT;
+    static const int HAND_COUNT = 2;
+
+    typedef struct ActionDefinition {
+        const char *name;
+        const char *localizedName;
+        XrActionType type;
+    };
+
+    typedef struct ProfileBindings {
+        const char *interactionProfile;
+        // Per action and hand, relative to the hand's path, nullptr if the action isn't bound on that hand
+        const char *bindings[ACTION_COUNT][HAND_COUNT];
+    };
+
+    // Indexed by Action
+    static const ActionDefinition ACTIONS[ACTION_COUNT];
+    static const ProfileBindings PROFILES[];
+    static const int PROFILE_COUNT;
+    static const char *const HAND_PATHS[HAND_COUNT];
+
+    // Booleans are 0 or 1
+    typedef struct ActionState {
+        float value;
+        XrBool32 changedSinceLastSync;
+        XrTime lastChangeTime;
+    };
+
+    // The states of every action but the pose for one hand and frame
+    typedef struct Snapshot {
+        ActionState states[ACTION_COUNT];
+
+        const ActionState &operator[](Action action) const {
+            return states[(int)action];
+        }
+        bool isPressStarted(Action action) const {
+            return states[(int)action].changedSinceLastSync && states[(int)action].value != 0.f;
+        }
+    };
+
+    // What the frame loop does for the hand, placing comes with the cube as the hand held it when the click happened
+    typedef struct Commands {
+        bool isRemoveRequested = false;
+        bool isPlaceRequested = false;
+        XrTime placeTime = 0;
+        XrColor4f placeColor;
+        XrVector3f placeScale;
+        bool isTypeToggled = false;
+    };
+
+    static constexpr float MAX_CUBE_SCALE = 10.f;
+    static constexpr float MIN_CUBE_SCALE = .01f;
+
+    // otherSnapshot is the other hand's, its XA modifier is part of toggling the cube type
+    Commands update(const Snapshot &snapshot, const Snapshot &otherSnapshot);
+
+    const XrColor4f &getColor() const;
+    const XrVector3f &getScale() const;
+
+private:
+    XrColor4f m_color = { 1.f, 1.f, 1.f, 1.f };
+    XrVector3f m_scale = { 1.f, 1.f, 1.f };
+    ColorWheel m_colorWheel;
+
+    // Grows or shrinks the axes the modifiers pick: XA x, YB y, both z and neither all of them
+    void resize(float delta, bool modifierXA, bool modifierYB);
+};
+
+#endif //VR_HANDINPUT_H
@@ -0,0 +1,285 @@
+#include "vr/JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+
+// Which system and worker the current thread belongs to
+static thread_local const JobSystem *s_system = nullptr;
+static thread_local uint32_t s_workerIndex = 0;
+
+// Rounds of looking for work before an idle worker goes to sleep, waking one up costs more than a frame's worth of
+// short jobs
+static const int SPIN_COUNT = 64;
+
+bool JobSystem::Task::isDone() const {
+    return m_isDone.load(std::memory_order_acquire);
+}
+
+bool JobSystem::Deque::push(Task *task) {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+        return false;
+    }
+
+    m_tasks[bottom & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Task *JobSystem::Deque::pop() {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Task *task = m_tasks[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // The last one, a thief may be after it too
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+JobSystem::Task *JobSystem::Deque::steal() {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Task *task = m_tasks[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+JobSystem::JobSystem(uint32_t threadCount) {
+    if (!threadCount) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_deques.push_back(std::make_unique<Deque>());
+    }
+
+    s_system = this;
+    s_workerIndex = 0;
+    for (uint32_t i = 1; i < threadCount; i++) {
+        m_threads.emplace_back(&JobSystem::runWorker, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    m_isStopping.store(true, std::memory_order_seq_cst);
+    m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    m_epoch.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+
+    if (s_system == this) {
+        s_system = nullptr;
+    }
+}
+
+uint32_t JobSystem::getThreadCount() const {
+    return (uint32_t)m_deques.size();
+}
+
+uint32_t JobSystem::getChunkCount(uint32_t count, uint32_t grainSize) {
+    return (count + grainSize - 1) / grainSize;
+}
+
+void JobSystem::schedule(Task &task, uint32_t count, uint32_t grainSize, Function function, void *context, std::initializer_list<Task *> dependencies) {
+    if (!task.isDone()) {
+        throw std::runtime_error("Scheduling a task that is still running");
+    }
+
+    task.m_function = function;
+    task.m_context = context;
+    task.m_count = count;
+    task.m_grainSize = std::max(1u, grainSize);
+    task.m_nextChunk.store(0, std::memory_order_relaxed);
+    task.m_unfinishedChunks.store(getChunkCount(count, task.m_grainSize), std::memory_order_relaxed);
+    task.m_references.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(task.m_mutex);
+        task.m_dependentCount = 0;
+        task.m_isCompleted = false;
+    }
+    task.m_isDone.store(false, std::memory_order_relaxed);
+    task.m_pendingDependencies.store((uint32_t)dependencies.size() + 1, std::memory_order_relaxed);
+
+    for (Task *dependency : dependencies) {
+        std::unique_lock<std::mutex> lock(dependency->m_mutex);
+        if (dependency->m_isCompleted) {
+            lock.unlock();
+            task.m_pendingDependencies.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+
+        if (dependency->m_dependentCount == MAX_DEPENDENTS) {
+            throw std::runtime_error("Too many tasks depend on the same task");
+        }
+        dependency->m_dependents[dependency->m_dependentCount++] = &task;
+    }
+
+    if (task.m_pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        enqueue(task);
+    }
+}
+
+void JobSystem::wait(Task &task) {
+    const uint32_t workerIndex = getWorkerIndex();
+    while (!task.isDone()) {
+        if (Task *next = findTask(workerIndex)) {
+            execute(*next);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+uint32_t JobSystem::getWorkerIndex() const {
+    if (s_system != this) {
+        throw std::runtime_error("Jobs can only be scheduled and waited on by the job system's workers");
+    }
+    return s_workerIndex;
+}
+
+// Queues a copy of the task for every worker that can get a chunk of it, so they all start right away instead of
+// stealing one after another
+void JobSystem::enqueue(Task &task) {
+    const uint32_t chunkCount = getChunkCount(task.m_count, task.m_grainSize);
+    if (!chunkCount) {
+        complete(task);
+        task.m_isDone.store(true, std::memory_order_release);
+        return;
+    }
+
+    const uint32_t copyCount = std::min(chunkCount, getThreadCount());
+    task.m_references.store(copyCount, std::memory_order_relaxed);
+
+    Deque &deque = *m_deques[getWorkerIndex()];
+    for (uint32_t i = 0; i < copyCount; i++) {
+        // A full deque runs the work right here instead
+        if (!deque.push(&task)) {
+            execute(task);
+        }
+    }
+    wake();
+}
+
+JobSystem::Task *JobSystem::findTask(uint32_t workerIndex) {
+    if (Task *task = m_deques[workerIndex]->pop()) {
+        return task;
+    }
+
+    const uint32_t threadCount = getThreadCount();
+    for (uint32_t i = 1; i < threadCount; i++) {
+        if (Task *task = m_deques[(workerIndex + i) % threadCount]->steal()) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Task &task) {
+    const uint32_t chunkCount = getChunkCount(task.m_count, task.m_grainSize);
+
+    uint32_t chunk;
+    while ((chunk = task.m_nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunkCount) {
+        const uint32_t begin = chunk * task.m_grainSize;
+        task.m_function(task.m_context, begin, std::min(begin + task.m_grainSize, task.m_count));
+
+        if (task.m_unfinishedChunks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            complete(task);
+        }
+    }
+
+    release(task);
+}
+
+// Queues the tasks that were only waiting for this one
+void JobSystem::complete(Task &task) {
+    Task *dependents[MAX_DEPENDENTS];
+    uint32_t dependentCount;
+    {
+        std::lock_guard<std::mutex> lock(task.m_mutex);
+        task.m_isCompleted = true;
+        dependentCount = task.m_dependentCount;
+        std::copy(task.m_dependents, task.m_dependents + dependentCount, dependents);
+    }
+
+    for (uint32_t i = 0; i < dependentCount; i++) {
+        if (dependents[i]->m_pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            enqueue(*dependents[i]);
+        }
+    }
+}
+
+// The task may be reused as soon as it's done, so that only happens once no deque holds it anymore
+void JobSystem::release(Task &task) {
+    if (task.m_references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        task.m_isDone.store(true, std::memory_order_release);
+    }
+}
+
+void JobSystem::wake() {
+    // Pairs with the sleeper count going up before the last look for work in runWorker
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeperCount.load(std::memory_order_seq_cst)) {
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        m_epoch.notify_all();
+    }
+}
+
+void JobSystem::runWorker(uint32_t workerIndex) {
+    s_system = this;
+    s_workerIndex = workerIndex;
+
+    int idleCount = 0;
+    while (!m_isStopping.load(std::memory_order_acquire)) {
+        if (Task *task = findTask(workerIndex)) {
+            execute(*task);
+            idleCount = 0;
+            continue;
+        }
+
+        if (++idleCount < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Announced before looking one last time, so whoever queues work after that look sees a sleeper to wake
+        const uint32_t epoch = m_epoch.load(std::memory_order_seq_cst);
+        m_sleeperCount.fetch_add(1, std::memory_order_seq_cst);
+        if (Task *task = findTask(workerIndex)) {
+            m_sleeperCount.fetch_sub(1, std::memory_order_seq_cst);
+            execute(*task);
+            idleCount = 0;
+            continue;
+        }
+        if (!m_isStopping.load(std::memory_order_acquire)) {
+            m_epoch.wait(epoch, std::memory_order_seq_cst);
+        }
+        m_sleeperCount.fetch_sub(1, std::memory_order_seq_cst);
+        idleCount = 0;
+    }
+}
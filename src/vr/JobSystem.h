@@ -0,0 +1,130 @@
+#ifndef VR_JOBSYSTEM_H
+#define VR_JOBSYSTEM_H
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Runs ranges of work split into chunks on a fixed set of threads. The thread that creates the system is worker 0 and
+// only does work while it waits, the others take work from their own deque and steal from the others' when theirs is
+// empty. Scheduling only ever happens on a worker: the creating thread or inside a job
+class JobSystem {
+public:
+    // Called once per chunk with the range of items [begin, end) it covers
+    typedef void (*Function)(void *context, uint32_t begin, uint32_t end);
+
+    static const uint32_t MAX_DEPENDENTS = 8;
+
+    // One range of work, owned by whoever schedules it and reusable once it's done. Chunks are claimed one at a time by
+    // whichever worker gets to the task so no chunk needs an allocation
+    class Task {
+    public:
+        Task() = default;
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+        bool isDone() const;
+
+    private:
+        friend class JobSystem;
+
+        Function m_function = nullptr;
+        void *m_context = nullptr;
+        uint32_t m_count = 0;
+        uint32_t m_grainSize = 1;
+
+        std::atomic<uint32_t> m_nextChunk{ 0 };
+        std::atomic<uint32_t> m_unfinishedChunks{ 0 };
+        // Dependencies that haven't completed yet plus one held by schedule, the task is queued when it drops to 0
+        std::atomic<uint32_t> m_pendingDependencies{ 0 };
+        // One per queued copy of the task, done once the last worker that got one lets go of it
+        std::atomic<uint32_t> m_references{ 0 };
+        std::atomic<bool> m_isDone{ true };
+
+        // Guards completing against tasks that depend on this one being scheduled
+        std::mutex m_mutex;
+        bool m_isCompleted = true;
+        Task *m_dependents[MAX_DEPENDENTS];
+        uint32_t m_dependentCount = 0;
+    };
+
+    // 0 threads uses one per hardware thread
+    explicit JobSystem(uint32_t threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    uint32_t getThreadCount() const;
+
+    // Runs function over [0, count) in chunks of grainSize items once every dependency is done
+    void schedule(Task &task, uint32_t count, uint32_t grainSize, Function function, void *context, std::initializer_list<Task *> dependencies = {});
+    // Works on whatever is queued until the task is done. A task has to be done before it goes away or gets scheduled
+    // again, a task that depends on it being done isn't enough
+    void wait(Task &task);
+
+    // Same as schedule with function(begin, end), which has to outlive the task
+    template<typename F>
+    void scheduleFor(Task &task, uint32_t count, uint32_t grainSize, const F &function, std::initializer_list<Task *> dependencies = {});
+    // Runs function(begin, end) over [0, count) in chunks of grainSize items and waits for all of them
+    template<typename F>
+    void parallelFor(uint32_t count, uint32_t grainSize, const F &function);
+
+    static uint32_t getChunkCount(uint32_t count, uint32_t grainSize);
+
+private:
+    // Chase-Lev deque of fixed size with the orderings of Lê et al., "Correct and Efficient Work-Stealing for Weak
+    // Memory Models". The owner pushes and pops at the bottom, everyone else steals from the top
+    class Deque {
+    public:
+        static const int64_t CAPACITY = 1024;
+
+        bool push(Task *task);
+        Task *pop();
+        Task *steal();
+
+    private:
+        alignas(64) std::atomic<int64_t> m_top{ 0 };
+        alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+        std::atomic<Task *> m_tasks[CAPACITY];
+    };
+
+    std::vector<std::unique_ptr<Deque>> m_deques;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_isStopping{ false };
+
+    // Idle workers sleep on the epoch, whoever queues work bumps it if anyone is asleep
+    alignas(64) std::atomic<uint32_t> m_epoch{ 0 };
+    std::atomic<uint32_t> m_sleeperCount{ 0 };
+
+    void runWorker(uint32_t workerIndex);
+    uint32_t getWorkerIndex() const;
+
+    void enqueue(Task &task);
+    Task *findTask(uint32_t workerIndex);
+    void execute(Task &task);
+    void complete(Task &task);
+    void release(Task &task);
+    void wake();
+};
+
+template<typename F>
+void JobSystem::scheduleFor(Task &task, uint32_t count, uint32_t grainSize, const F &function, std::initializer_list<Task *> dependencies) {
+    schedule(task, count, grainSize, [](void *context, uint32_t begin, uint32_t end) {
+        (*static_cast<const F *>(context))(begin, end);
+    }, const_cast<F *>(&function), dependencies);
+}
+
+template<typename F>
+void JobSystem::parallelFor(uint32_t count, uint32_t grainSize, const F &function) {
+    Task task;
+    scheduleFor(task, count, grainSize, function);
+    wait(task);
+}
+
+#endif //VR_JOBSYSTEM_H
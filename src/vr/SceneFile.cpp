@@ -0,0 +1,261 @@
+#include "vr/SceneFile.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::endian::native == std::endian::little, "Scene files are little-endian and read in place");
+
+
+
+const char SceneFile::MAGIC[8] = { 'O', 'X', 'T', 'S', 'C', 'E', 'N', 'E' };
+
+static_assert(sizeof(SceneFile::Record) == 60, "Scene records have a fixed size");
+
+SceneFile::SceneFile() {
+    static_assert(sizeof(Header) == 64, "The scene header has a fixed size");
+}
+
+SceneFile::~SceneFile() {
+    close();
+}
+
+void SceneFile::open(const std::string &path) {
+    close();
+
+    m_file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_file.is_open()) {
+        const Header header = createHeader(0);
+
+        std::ofstream created(path, std::ios::binary);
+        created.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        created.close();
+        if (created.fail()) {
+            throw std::runtime_error("Could not create the scene file " + path);
+        }
+
+        m_file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!m_file.is_open()) {
+            throw std::runtime_error("Could not open the scene file " + path);
+        }
+    }
+    m_path = path;
+
+    Header header;
+    m_file.read(reinterpret_cast<char *>(&header), sizeof(Header));
+    if (m_file.fail() || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        close();
+        throw std::runtime_error("Not a scene file: " + path);
+    }
+    if (header.version < 1 || header.version > VERSION || header.recordSize != sizeof(Record)) {
+        close();
+        throw std::runtime_error("Unsupported scene file version " + std::to_string(header.version) + ": " + path);
+    }
+    // Before a removal gets appended, which version 1 wouldn't know
+    if (header.version != VERSION) {
+        const uint32_t version = VERSION;
+        m_file.seekp(offsetof(Header, version));
+        m_file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+        m_file.flush();
+        if (m_file.fail()) {
+            close();
+            throw std::runtime_error("Could not upgrade the scene file " + path);
+        }
+    }
+
+    // Records past the end of the file were committed but never made it to disk
+    m_file.seekg(0, std::ios::end);
+    const size_t fileSize = (size_t)m_file.tellg();
+    m_recordCount = std::min<size_t>(header.recordCount, (fileSize - sizeof(Header)) / sizeof(Record));
+
+    if (m_recordCount) {
+        try {
+            map(sizeof(Header) + m_recordCount * sizeof(Record));
+        }
+        catch (const std::runtime_error &) {
+            close();
+            throw;
+        }
+    }
+}
+
+void SceneFile::close() {
+    unmap();
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+    m_file.clear();
+    m_path.clear();
+    m_recordCount = 0;
+}
+
+bool SceneFile::isOpen() const {
+    return m_file.is_open();
+}
+
+size_t SceneFile::size() const {
+    return m_recordCount;
+}
+
+const SceneFile::Record *SceneFile::getMappedRecords() const {
+    return m_mapping ? reinterpret_cast<const Record *>(static_cast<const char *>(m_mapping) + sizeof(Header)) : nullptr;
+}
+
+void SceneFile::unmap() {
+    if (!m_mapping) {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_mapping);
+#else
+    munmap(const_cast<void *>(m_mapping), m_mappingSize);
+#endif
+    m_mapping = nullptr;
+    m_mappingSize = 0;
+}
+
+void SceneFile::write(size_t index, const Record *records, size_t count) {
+    m_file.seekp(sizeof(Header) + index * sizeof(Record));
+    m_file.write(reinterpret_cast<const char *>(records), count * sizeof(Record));
+    m_file.flush();
+    if (m_file.fail()) {
+        throw std::runtime_error("Could not write to the scene file " + m_path);
+    }
+}
+
+void SceneFile::commit(size_t recordCount) {
+    const uint64_t count = recordCount;
+    m_file.seekp(offsetof(Header, recordCount));
+    m_file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    m_file.flush();
+    if (m_file.fail()) {
+        throw std::runtime_error("Could not write to the scene file " + m_path);
+    }
+
+    m_recordCount = recordCount;
+}
+
+void SceneFile::append(const Record *records, size_t count) {
+    write(m_recordCount, records, count);
+    commit(m_recordCount + count);
+}
+
+void SceneFile::rewrite(const Record *records, size_t count) {
+    const std::string path = m_path;
+    const std::string temporaryPath = path + ".tmp";
+
+    const Header header = createHeader(count);
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(records), count * sizeof(Record));
+    file.close();
+    if (file.fail()) {
+        std::error_code error;
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Could not write the scene file " + temporaryPath);
+    }
+
+    // Windows can't replace a file that's still open
+    close();
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    open(path);
+    unmap();
+    if (error) {
+        throw std::runtime_error("Could not replace the scene file " + path + ": " + error.message());
+    }
+}
+
+SceneFile::Record SceneFile::createRemoval(size_t index) {
+    Record removal{};
+    const uint64_t value = index;
+    memcpy(&removal.translation, &value, sizeof(value));
+    removal.type = REMOVAL_TYPE;
+    return removal;
+}
+
+size_t SceneFile::getRemovedIndex(const Record &removal) {
+    uint64_t value;
+    memcpy(&value, &removal.translation, sizeof(value));
+    return (size_t)value;
+}
+
+// The objects that are left never get ahead of the records read, so they're packed into the same array
+size_t SceneFile::compact(Record *records, size_t count) {
+    size_t objectCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].type == REMOVAL_TYPE) {
+            records[getRemovedIndex(records[i])] = records[objectCount - 1];
+            objectCount--;
+        }
+        else {
+            records[objectCount++] = records[i];
+        }
+    }
+    return objectCount;
+}
+
+SceneFile::Header SceneFile::createHeader(size_t recordCount) {
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.recordSize = sizeof(Record);
+    header.recordCount = recordCount;
+    return header;
+}
+
+// Read only and private, the records are copied out right away and the file keeps changing through m_file
+void SceneFile::map(size_t size) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not map the scene file " + m_path);
+    }
+
+    // The view keeps the mapping and the file alive on its own
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        throw std::runtime_error("Could not map the scene file " + m_path);
+    }
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    CloseHandle(mapping);
+    if (!view) {
+        throw std::runtime_error("Could not map the scene file " + m_path);
+    }
+#else
+    const int file = ::open(m_path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Could not map the scene file " + m_path);
+    }
+
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    // Everything gets read right away, faulting it all in up front saves a fault per page
+    flags |= MAP_POPULATE;
+#endif
+    void *view = mmap(nullptr, size, PROT_READ, flags, file, 0);
+    ::close(file);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Could not map the scene file " + m_path);
+    }
+#endif
+
+    m_mapping = view;
+    m_mappingSize = size;
+}
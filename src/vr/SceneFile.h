@@ -0,0 +1,81 @@
+#ifndef VR_SCENEFILE_H
+#define VR_SCENEFILE_H
+
+#include <openxr/openxr.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+
+// Placed objects as fixed size little-endian records after a small header. The file is append-only: placing appends
+// the object, removing appends a removal record, and then the record count is written. The count is what makes records
+// part of the scene, so a save that's cut short loses nothing saved before it. Loading maps the file and hands out the
+// records in place, there's nothing to parse until something got removed. Then compact() replays the removals and
+// rewrite() replaces the file with what's left
+class SceneFile {
+public:
+    // Laid out exactly like VRCore::Cube, so a whole scene is copied in one go
+    typedef struct Record {
+        XrVector3f translation;
+        XrQuaternionf rotation;
+        XrVector3f scale;
+        XrColor4f color;
+        uint32_t type;
+    };
+
+    // Version 1 files never have removals, they're read as they are and upgraded on open
+    static const uint32_t VERSION = 2;
+    // The type of a removal record. The object at the index in it goes and the last one takes its place
+    static const uint32_t REMOVAL_TYPE = UINT32_MAX;
+
+    SceneFile();
+    ~SceneFile();
+
+    // Creates the file if there's none, throws if it isn't a scene file of this version. Maps the records until unmap
+    void open(const std::string &path);
+    void close();
+    bool isOpen() const;
+
+    size_t size() const;
+    const Record *getMappedRecords() const;
+    void unmap();
+
+    // Overwrites or appends records starting at index, they're only loaded once commit counts them in
+    void write(size_t index, const Record *records, size_t count);
+    void commit(size_t recordCount);
+    // Writes the records after the last one and commits them
+    void append(const Record *records, size_t count);
+    // Replaces the file with these records through a temporary file, a rewrite that's cut short leaves the old one
+    void rewrite(const Record *records, size_t count);
+
+    static Record createRemoval(size_t index);
+    // The index is kept in the bytes of the translation
+    static size_t getRemovedIndex(const Record &removal);
+    // Applies the removals in place and returns how many objects are left, the removals have to be valid
+    static size_t compact(Record *records, size_t count);
+
+private:
+    typedef struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t recordCount;
+        uint8_t reserved[40];
+    };
+
+    static const char MAGIC[8];
+
+    static Header createHeader(size_t recordCount);
+
+    std::fstream m_file;
+    std::string m_path;
+    size_t m_recordCount = 0;
+
+    const void *m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+
+    void map(size_t size);
+};
+
+#endif //VR_SCENEFILE_H
@@ -0,0 +1,215 @@
+#include "vr/TransformCache.h"
+
+#include <algorithm>
+
+
+
+TransformCache::TransformCache(size_t bucketCount) : m_buckets(bucketCount) {
+}
+
+void TransformCache::add(const XrVector3f &translation, const XrQuaternionf &rotation, const XrVector3f &scale, const XrColor4f &color, uint32_t bucket) {
+    Bucket &target = m_buckets[bucket];
+    m_locations.push_back({ bucket, (uint32_t)target.transformations.size() });
+
+    XrMatrix4x4f &transformation = target.transformations.emplace_back();
+    XrMatrix4x4f::CreateTranslationRotationScale(&transformation, &translation, &rotation, &scale);
+    target.colors.push_back(color);
+    target.objects.push_back((uint32_t)m_locations.size() - 1);
+    growScratch();
+}
+
+void TransformCache::add(const Object *objects, size_t count, JobSystem &jobSystem) {
+    // The bookkeeping stays in order on this thread, only the transformations don't depend on each other
+    const uint32_t firstIndex = (uint32_t)m_locations.size();
+    for (size_t i = 0; i < count; i++) {
+        const Object &object = objects[i];
+        Bucket &target = m_buckets[object.bucket];
+        m_locations.push_back({ object.bucket, (uint32_t)target.objects.size() });
+        target.colors.push_back(object.color);
+        target.objects.push_back(firstIndex + (uint32_t)i);
+    }
+    for (Bucket &bucket : m_buckets) {
+        bucket.transformations.resize(bucket.objects.size());
+    }
+    growScratch();
+
+    jobSystem.parallelFor((uint32_t)count, PARALLEL_GRAIN_SIZE, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const Object &object = objects[i];
+            const Location &location = m_locations[firstIndex + i];
+            XrMatrix4x4f::CreateTranslationRotationScale(&m_buckets[location.bucket].transformations[location.index], &object.translation, &object.rotation, &object.scale);
+        }
+    });
+}
+
+void TransformCache::remove(size_t index) {
+    const Location location = m_locations[index];
+    Bucket &bucket = m_buckets[location.bucket];
+
+    const size_t lastSlot = bucket.objects.size() - 1;
+    bucket.transformations[location.index] = bucket.transformations[lastSlot];
+    bucket.colors[location.index] = bucket.colors[lastSlot];
+    bucket.objects[location.index] = bucket.objects[lastSlot];
+    m_locations[bucket.objects[location.index]].index = location.index;
+
+    bucket.transformations.pop_back();
+    bucket.colors.pop_back();
+    bucket.objects.pop_back();
+
+    const size_t lastIndex = m_locations.size() - 1;
+    if (index != lastIndex) {
+        const Location &moved = m_locations[index] = m_locations[lastIndex];
+        m_buckets[moved.bucket].objects[moved.index] = (uint32_t)index;
+    }
+    m_locations.pop_back();
+}
+
+void TransformCache::clear() {
+    for (auto &bucket : m_buckets) {
+        bucket.transformations.clear();
+        bucket.colors.clear();
+        bucket.objects.clear();
+    }
+    m_locations.clear();
+}
+
+void TransformCache::reserve(const size_t *bucketSizes) {
+    size_t count = 0;
+    for (size_t i = 0; i < m_buckets.size(); i++) {
+        Bucket &bucket = m_buckets[i];
+        const size_t capacity = bucket.objects.size() + bucketSizes[i];
+        bucket.transformations.reserve(capacity);
+        bucket.colors.reserve(capacity);
+        bucket.objects.reserve(capacity);
+        count += bucketSizes[i];
+    }
+    m_locations.reserve(m_locations.size() + count);
+    growScratch();
+}
+
+void TransformCache::growScratch() {
+    const size_t size = (m_locations.capacity() / PARALLEL_GRAIN_SIZE + 1) * m_buckets.size();
+    if (m_chunkCounts.size() < size) {
+        m_chunkCounts.resize(size);
+        m_chunkDestinations.resize(size);
+    }
+}
+
+size_t TransformCache::size() const {
+    return m_locations.size();
+}
+
+const TransformCache::Location &TransformCache::getLocation(size_t index) const {
+    return m_locations[index];
+}
+
+const XrMatrix4x4f &TransformCache::getTransformation(size_t index) const {
+    const Location &location = m_locations[index];
+    return m_buckets[location.bucket].transformations[location.index];
+}
+
+const XrColor4f &TransformCache::getColor(size_t index) const {
+    const Location &location = m_locations[index];
+    return m_buckets[location.bucket].colors[location.index];
+}
+
+size_t TransformCache::getBucketCount() const {
+    return m_buckets.size();
+}
+
+size_t TransformCache::getBucketSize(uint32_t bucket) const {
+    return m_buckets[bucket].transformations.size();
+}
+
+const XrMatrix4x4f *TransformCache::getBucketTransformations(uint32_t bucket) const {
+    return m_buckets[bucket].transformations.data();
+}
+
+const XrColor4f *TransformCache::getBucketColors(uint32_t bucket) const {
+    return m_buckets[bucket].colors.data();
+}
+
+void TransformCache::countInstances(const std::vector<uint32_t> &indices, size_t *counts) const {
+    countChunk(indices, 0, (uint32_t)indices.size(), counts);
+}
+
+void TransformCache::writeInstances(const std::vector<uint32_t> &indices, Instance **destinations) const {
+    writeChunk(indices, 0, (uint32_t)indices.size(), destinations);
+}
+
+void TransformCache::countInstances(const std::vector<uint32_t> &indices, size_t *counts, JobSystem &jobSystem) const {
+    if (indices.size() < PARALLEL_MIN_COUNT || jobSystem.getThreadCount() == 1) {
+        countInstances(indices, counts);
+        return;
+    }
+
+    const size_t bucketCount = m_buckets.size();
+    jobSystem.parallelFor((uint32_t)indices.size(), PARALLEL_GRAIN_SIZE, [&](uint32_t begin, uint32_t end) {
+        size_t *chunkCounts = &m_chunkCounts[begin / PARALLEL_GRAIN_SIZE * bucketCount];
+        std::fill(chunkCounts, chunkCounts + bucketCount, 0);
+        countChunk(indices, begin, end, chunkCounts);
+    });
+
+    const uint32_t chunkCount = JobSystem::getChunkCount((uint32_t)indices.size(), PARALLEL_GRAIN_SIZE);
+    for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+        for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+            counts[bucket] += m_chunkCounts[chunk * bucketCount + bucket];
+        }
+    }
+}
+
+// Every chunk counts its objects per bucket, which tells where in every bucket the chunk starts writing so they can
+// all write at once. Each step only depends on the one before, so the caller only waits once
+void TransformCache::writeInstances(const std::vector<uint32_t> &indices, Instance **destinations, JobSystem &jobSystem) const {
+    if (indices.size() < PARALLEL_MIN_COUNT || jobSystem.getThreadCount() == 1) {
+        writeInstances(indices, destinations);
+        return;
+    }
+
+    const size_t bucketCount = m_buckets.size();
+    const uint32_t chunkCount = JobSystem::getChunkCount((uint32_t)indices.size(), PARALLEL_GRAIN_SIZE);
+
+    const auto countChunks = [&](uint32_t begin, uint32_t end) {
+        size_t *counts = &m_chunkCounts[begin / PARALLEL_GRAIN_SIZE * bucketCount];
+        std::fill(counts, counts + bucketCount, 0);
+        countChunk(indices, begin, end, counts);
+    };
+    const auto placeChunks = [&](uint32_t, uint32_t) {
+        for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+            for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+                m_chunkDestinations[chunk * bucketCount + bucket] = destinations[bucket];
+                destinations[bucket] += m_chunkCounts[chunk * bucketCount + bucket];
+            }
+        }
+    };
+    const auto writeChunks = [&](uint32_t begin, uint32_t end) {
+        writeChunk(indices, begin, end, &m_chunkDestinations[begin / PARALLEL_GRAIN_SIZE * bucketCount]);
+    };
+
+    JobSystem::Task countTask;
+    JobSystem::Task placeTask;
+    JobSystem::Task writeTask;
+    jobSystem.scheduleFor(countTask, (uint32_t)indices.size(), PARALLEL_GRAIN_SIZE, countChunks);
+    jobSystem.scheduleFor(placeTask, 1, 1, placeChunks, { &countTask });
+    jobSystem.scheduleFor(writeTask, (uint32_t)indices.size(), PARALLEL_GRAIN_SIZE, writeChunks, { &placeTask });
+    jobSystem.wait(writeTask);
+    jobSystem.wait(placeTask);
+    jobSystem.wait(countTask);
+}
+
+void TransformCache::countChunk(const std::vector<uint32_t> &indices, uint32_t begin, uint32_t end, size_t *counts) const {
+    for (uint32_t i = begin; i < end; i++) {
+        counts[m_locations[indices[i]].bucket]++;
+    }
+}
+
+void TransformCache::writeChunk(const std::vector<uint32_t> &indices, uint32_t begin, uint32_t end, Instance **destinations) const {
+    for (uint32_t i = begin; i < end; i++) {
+        const Location &location = m_locations[indices[i]];
+        const Bucket &bucket = m_buckets[location.bucket];
+
+        Instance &instance = *destinations[location.bucket]++;
+        instance.transformation = bucket.transformations[location.index];
+        instance.color = bucket.colors[location.index];
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef VR_TRANSFORMCACHE_H
+#define VR_TRANSFORMCACHE_H
+
+#include "vr/AlignedAllocator.h"
+#include "vr/JobSystem.h"
+#include "vr/XrMatrix4x4f.h"
+
+#include <vector>
+
+
+// Model transformations of static objects, computed once when they're added. The objects are split into buckets
+// (e.g. one per mesh) and every bucket keeps its transformations and colors contiguous so they can be uploaded as is
+class TransformCache {
+public:
+    typedef struct Location {
+        uint32_t bucket;
+        uint32_t index;
+    };
+
+    // Transformation and color of one object interleaved, the layout the instanced shaders read
+    typedef struct Instance {
+        XrMatrix4x4f transformation;
+        XrColor4f color;
+    };
+
+    // Everything add takes, laid out like SceneFile::Record so loaded scenes are added as they are
+    typedef struct Object {
+        XrVector3f translation;
+        XrQuaternionf rotation;
+        XrVector3f scale;
+        XrColor4f color;
+        uint32_t bucket;
+    };
+
+    // Fewer indices than that are handled on the calling thread alone
+    static const size_t PARALLEL_MIN_COUNT = 16384;
+    static const uint32_t PARALLEL_GRAIN_SIZE = 4096;
+
+    explicit TransformCache(size_t bucketCount);
+
+    void add(const XrVector3f &translation, const XrQuaternionf &rotation, const XrVector3f &scale, const XrColor4f &color, uint32_t bucket);
+    // Adds them all in order, the transformations are computed on the job system's threads
+    void add(const Object *objects, size_t count, JobSystem &jobSystem);
+    // The last object takes the removed one's index and the last object of its bucket takes its place in the bucket
+    void remove(size_t index);
+    void clear();
+    // Makes room for bucketSizes[bucket] more objects in every bucket, before adding many at once
+    void reserve(const size_t *bucketSizes);
+
+    size_t size() const;
+    const Location &getLocation(size_t index) const;
+    const XrMatrix4x4f &getTransformation(size_t index) const;
+    const XrColor4f &getColor(size_t index) const;
+
+    size_t getBucketCount() const;
+    size_t getBucketSize(uint32_t bucket) const;
+    const XrMatrix4x4f *getBucketTransformations(uint32_t bucket) const;
+    const XrColor4f *getBucketColors(uint32_t bucket) const;
+
+    // Adds up how many of the given objects are in each bucket, counts has an entry per bucket
+    void countInstances(const std::vector<uint32_t> &indices, size_t *counts) const;
+    // Copies the given objects into the destination of their bucket, advancing it past every written instance
+    void writeInstances(const std::vector<uint32_t> &indices, Instance **destinations) const;
+    // Same results, in chunks spread over the job system's threads
+    void countInstances(const std::vector<uint32_t> &indices, size_t *counts, JobSystem &jobSystem) const;
+    void writeInstances(const std::vector<uint32_t> &indices, Instance **destinations, JobSystem &jobSystem) const;
+
+private:
+    typedef struct Bucket {
+        AlignedVector<XrMatrix4x4f> transformations;
+        AlignedVector<XrColor4f> colors;
+        // Index of the object in every slot, to fix up locations when objects move
+        std::vector<uint32_t> objects;
+    };
+
+    std::vector<Bucket> m_buckets;
+    std::vector<Location> m_locations;
+
+    // Per chunk of indices and bucket, how many instances the chunk has and where it writes them. Sized for every object
+    // there's room for so the parallel paths never allocate
+    mutable std::vector<size_t> m_chunkCounts;
+    mutable std::vector<Instance *> m_chunkDestinations;
+
+    void growScratch();
+    void countChunk(const std::vector<uint32_t> &indices, uint32_t begin, uint32_t end, size_t *counts) const;
+    void writeChunk(const std::vector<uint32_t> &indices, uint32_t begin, uint32_t end, Instance **destinations) const;
+};
+
+#endif //VR_TRANSFORMCACHE_H
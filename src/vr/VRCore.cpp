@@ -1,78 +1,288 @@
-// TODO some refactoring (move out GL stuff), depth buffer, some lighting and maybe a bit of physics
+﻿// TODO some refactoring (move out GL stuff), some lighting and maybe a bit of physics
 
 #include "vr/VRCore.h"
 #include "vr/XrMatrix4x4f.h"
+#include "debug/AllocationAudit.h"
+#include "debug/DeferredLog.h"
 
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+#if !defined(_MSC_VER)
+template<size_t N>
+static int strcpy_s(char (&destination)[N], const char *source) {
+    const size_t length = strlen(source);
+    if (length >= N) {
+        destination[0] = '\0';
+        return ERANGE;
+    }
+
+    memcpy(destination, source, length + 1);
+    return 0;
+}
+#endif
+
+// Just the file of a source location, without its directories
+static const char *getFileName(const char *path) {
+    const char *fileName = path;
+    for (const char *c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') {
+            fileName = c + 1;
+        }
+    }
+    return fileName;
+}
+
+static void checkShader(GLuint shaderId, const std::string &description) {
+    GLint result;
+    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
+    if (result == GL_FALSE) {
+        GLint infoLogLength;
+        glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+        std::vector<GLchar> infoLog(infoLogLength);
+        glGetShaderInfoLog(shaderId, infoLogLength, nullptr, infoLog.data());
+        throw std::runtime_error(description + "\t" + infoLog.data());
+    }
+}
+
+static void checkProgram(GLuint programId, const std::string &description) {
+    GLint result;
+    glGetProgramiv(programId, GL_LINK_STATUS, &result);
+    if (result == GL_FALSE) {
+        GLint infoLogLength;
+        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+        std::vector<GLchar> infoLog(infoLogLength);
+        glGetProgramInfoLog(programId, infoLogLength, nullptr, infoLog.data());
 
+        throw std::runtime_error(description + "\t" + infoLog.data());
+    }
+}
 
-VRCore::VRCore() {
+
+VRCore::VRCore(const std::string &scenePath, const RenderOptions &options)
+    : m_isInstancingEnabled(options.isInstancingEnabled), m_isGpuCullingEnabled(options.isGpuCullingEnabled),
+      m_isCullingEnabled(options.isCullingEnabled), m_isHierarchicalCullingEnabled(options.isHierarchicalCullingEnabled) {
+    spdlog::info("INSTANCING: {}, CULLING: {}, HIERARCHICAL CULLING: {}", m_isInstancingEnabled, m_isCullingEnabled, m_isHierarchicalCullingEnabled);
     try {
-        createWindow();
+        createContext();
 
         createInstance();
 
         initSystem();
-        initSession();
-
-        initReferenceSpace();
         initActions();
-        initRendering();
+
+        initSessionObjects();
 
         initGL();
+
+        if (!scenePath.empty()) {
+            loadScene(scenePath);
+        }
     }
-    catch (std::runtime_error e) {
-        VRCore::~VRCore();
-        throw e;
+    catch (...) {
+        destroy();
+        throw;
     }
 }
 
-void VRCore::runVR() {
-    XrResult pollResult;
-    while (true) {
-        do {
-            XrEventDataBuffer event{ XR_TYPE_EVENT_DATA_BUFFER };
-            event.next = nullptr;
-            pollResult = xrPollEvent(m_instance, &event);
-            if (pollResult == XR_SUCCESS) {
-                switch (event.type) {
-                    case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
-                        handleStateChange(event);
+void VRCore::runVR(uint64_t frameLimit, uint32_t pipelineDepth) {
+    // The packets only carry the culled cubes as instances
+    m_isPipelined = pipelineDepth > 0;
+    if (m_isPipelined && (!m_isInstancingEnabled || !m_isCullingEnabled)) {
+        spdlog::warn("PIPELINE: needs instancing and culling, submitting from this thread");
+        m_isPipelined = false;
+    }
+    if (pipelineDepth > MAX_PIPELINE_DEPTH) {
+        spdlog::warn("PIPELINE: the runtime doesn't hand out frames more than {} ahead, depth {} is lowered to it", MAX_PIPELINE_DEPTH, pipelineDepth);
+        pipelineDepth = MAX_PIPELINE_DEPTH;
+    }
+    m_pipelineDepth = m_isPipelined ? pipelineDepth : 0;
+    spdlog::info("PIPELINE DEPTH: {}", m_pipelineDepth);
+    if (m_isPipelined && m_isGpuCullingEnabled) {
+        spdlog::info("GPU CULLING: the render thread can't read the transform cache, culling on the CPU");
+        m_isGpuCullingEnabled = false;
+    }
 
-                        break;
-                    }
-                    case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
-                        throw std::runtime_error("The instance is about to become unusable");
+    if (m_isPipelined) {
+        runPipelined(frameLimit);
+    }
+    else {
+        runSerial(frameLimit);
+    }
 
-                        break;
+    m_profiler.log();
+    m_renderProfiler.log();
+    logResultStatistics();
+}
+
+void VRCore::runSerial(uint64_t frameLimit) {
+    while (!m_hasExited) {
+        try {
+            FrameProfiler::ScopedTimer frameTimer(m_profiler, FrameProfiler::Phase::FRAME);
+
+            if (!simulate()) {
+                continue;
+            }
+            render();
+
+            requestExit(frameLimit);
+        }
+        catch (const XrError &error) {
+            const RecoveryLevel level = getRecoveryLevel(error.getResult());
+            if (level == RecoveryLevel::NONE) {
+                throw;
+            }
+
+            spdlog::error(error.what());
+            recover(level);
+            continue;
+        }
+
+        m_profiler.endFrame();
+        m_renderProfiler.endFrame();
+        if (m_frameIndex % STATISTICS_LOG_INTERVAL == 0) {
+            m_profiler.log();
+            m_renderProfiler.log();
+            logResultStatistics();
+        }
+    }
+}
+
+void VRCore::runPipelined(uint64_t frameLimit) {
+    while (!m_hasExited) {
+        std::exception_ptr error;
+        startRenderThread();
+        try {
+            while (!m_hasExited) {
+                {
+                    FrameProfiler::ScopedTimer frameTimer(m_profiler, FrameProfiler::Phase::FRAME);
+
+                    if (!simulate()) {
+                        continue;
                     }
-                    default: {
-                        char eventBuffer[XR_MAX_STRUCTURE_NAME_SIZE];
-                        xrStructureTypeToString(m_instance, event.type, eventBuffer);
-                        spdlog::info("OTHER EVENT: {}", eventBuffer);
 
+                    // Blocks while the render thread is depth frames behind
+                    FramePacket *packet = m_framePipeline->beginWrite();
+                    if (!packet) {
+                        // The render thread stopped on an error, stopRenderThread() hands it over
                         break;
                     }
+                    prepareFrame(*packet);
+                    m_framePipeline->endWrite();
+
+                    requestExit(frameLimit);
+                }
+
+                m_profiler.endFrame();
+                if (m_frameIndex % STATISTICS_LOG_INTERVAL == 0) {
+                    m_profiler.log();
+                    logResultStatistics();
                 }
             }
-        } while (pollResult == XR_SUCCESS);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        // The simulation's own error wins, the render thread's is most likely a consequence of it
+        const std::exception_ptr renderError = stopRenderThread();
+        if (!error) {
+            error = renderError;
+        }
+        if (!error) {
+            continue;
+        }
 
-        if (m_isSessionRunning) {
-            if (m_isSessionFocused) {
-                pollActions();
+        try {
+            std::rethrow_exception(error);
+        }
+        catch (const XrError &xrError) {
+            const RecoveryLevel level = getRecoveryLevel(xrError.getResult());
+            if (level == RecoveryLevel::NONE) {
+                throw;
             }
-            render();
+
+            spdlog::error(xrError.what());
+            recover(level);
         }
+    }
+}
+
+bool VRCore::simulate() {
+    pollEvents();
+
+    if (!m_isSessionRunning) {
+        return false;
+    }
+
+    m_inputTime = std::chrono::steady_clock::now();
+    if (m_isSessionFocused) {
+        FrameProfiler::ScopedTimer inputTimer(m_profiler, FrameProfiler::Phase::INPUT);
+        pollActions();
+    }
+    m_cubeHierarchy.maintain();
+
+    return true;
+}
 
+void VRCore::requestExit(uint64_t frameLimit) {
+    if (frameLimit && m_frameIndex >= frameLimit && !m_isExitRequested) {
+        checkResult(xrRequestExitSession(m_session), "Requesting the session exit");
+        m_isExitRequested = true;
     }
+}
+
+void VRCore::pollEvents() {
+    FrameProfiler::ScopedTimer eventsTimer(m_profiler, FrameProfiler::Phase::EVENTS);
+    XrResult pollResult;
+    do {
+        XrEventDataBuffer event{ XR_TYPE_EVENT_DATA_BUFFER };
+        event.next = nullptr;
+        pollResult = xrPollEvent(m_instance, &event);
+        if (pollResult == XR_SUCCESS) {
+            switch (event.type) {
+                case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
+                    handleStateChange(event);
+
+                    break;
+                }
+                case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
+                    throw XrError("The instance is about to become unusable", XR_ERROR_INSTANCE_LOST);
 
+                    break;
+                }
+                default: {
+                    char eventBuffer[XR_MAX_STRUCTURE_NAME_SIZE];
+                    xrStructureTypeToString(m_instance, event.type, eventBuffer);
+                    DeferredLog::info("OTHER EVENT: {}", eventBuffer);
+
+                    break;
+                }
+            }
+        }
+    } while (pollResult == XR_SUCCESS);
 }
 
 void VRCore::handleStateChange(XrEventDataBuffer event) {
     const XrEventDataSessionStateChanged &stateEvent = *reinterpret_cast<XrEventDataSessionStateChanged *>(&event);
+    // Left over from a session that was already recreated
+    if (stateEvent.session != m_session) {
+        return;
+    }
 
-    spdlog::info("SESSION STATE: {}", stateEvent.state);
+    DeferredLog::info("SESSION STATE: {}", stateEvent.state);
 
     switch (stateEvent.state) {
         case XR_SESSION_STATE_READY: {
@@ -96,12 +306,24 @@ void VRCore::handleStateChange(XrEventDataBuffer event) {
         case XR_SESSION_STATE_STOPPING: {
             m_isSessionRunning = false;
             m_isSessionFocused = false;
+            // The frames already waited on have to be ended first
+            if (m_renderThread.joinable()) {
+                m_framePipeline->waitUntilEmpty();
+            }
             checkResult(xrEndSession(m_session), "Stopping the session");
 
             break;
         }
         case XR_SESSION_STATE_EXITING: {
-            throw std::runtime_error("Improper session exit");
+            if (!m_isExitRequested) {
+                throw std::runtime_error("Improper session exit");
+            }
+            m_hasExited = true;
+
+            break;
+        }
+        case XR_SESSION_STATE_LOSS_PENDING: {
+            throw XrError("The session is about to be lost", XR_ERROR_SESSION_LOST);
         }
     }
 }
@@ -113,431 +335,1018 @@ void VRCore::pollActions() {
     syncInfo.activeActionSets = &activeActionSet;
     checkResult(xrSyncActions(m_session, &syncInfo), "Syncing actions");
 
-    // Not enough buttons and no interface -> modifiers
-    std::vector<bool> modifierXAs;
-    std::vector<bool> modifierYBs;
-
-    for (int handIndex = 0; handIndex < 2; handIndex++) {
-        Hand hand = m_hands[handIndex];
-        XrActionStateGetInfo getInfo{ XR_TYPE_ACTION_STATE_GET_INFO };
-        getInfo.subactionPath = hand.path;
-
-        getInfo.action = m_inputActions.modifierXA;
-        XrActionStateBoolean modifierXAClickState{ XR_TYPE_ACTION_STATE_BOOLEAN };
-        checkResult(xrGetActionStateBoolean(m_session, &getInfo, &modifierXAClickState), "Polling a modifier XA state");
-        modifierXAs.push_back(modifierXAClickState.currentState);
-
-        getInfo.action = m_inputActions.modifierYB;
-        XrActionStateBoolean modifierYBClickState{ XR_TYPE_ACTION_STATE_BOOLEAN };
-        checkResult(xrGetActionStateBoolean(m_session, &getInfo, &modifierYBClickState), "Polling a modifier YB state");
-        modifierYBs.push_back(modifierYBClickState.currentState);
+    // Both first, a hand's gestures involve the other hand's modifiers
+    for (Hand &hand : m_hands) {
+        fetchSnapshot(hand);
     }
 
-    for (int handIndex = 0; handIndex < 2; handIndex++) {
+    for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
         Hand &hand = m_hands[handIndex];
-        XrActionStateGetInfo getInfo{ XR_TYPE_ACTION_STATE_GET_INFO };
-        getInfo.subactionPath = hand.path;
-
-        bool modifierXA = modifierXAs[handIndex];
-        bool modifierYB = modifierYBs[handIndex];
-
-        getInfo.action = m_inputActions.place;
-        XrActionStateBoolean thumbstickClickState{ XR_TYPE_ACTION_STATE_BOOLEAN };
-        checkResult(xrGetActionStateBoolean(m_session, &getInfo, &thumbstickClickState), "Polling a thumbstick click state");
+        const HandInput::Commands commands = hand.input.update(hand.snapshot, m_hands[(handIndex + 1) % HandInput::HAND_COUNT].snapshot);
 
-        getInfo.action = m_inputActions.thumbstickX;
-        XrActionStateFloat thumbstickXState{ XR_TYPE_ACTION_STATE_FLOAT };
-        checkResult(xrGetActionStateFloat(m_session, &getInfo, &thumbstickXState), "Polling a thumbstick X state");
-
-        getInfo.action = m_inputActions.thumbstickY;
-        XrActionStateFloat thumbstickYState{ XR_TYPE_ACTION_STATE_FLOAT };
-        checkResult(xrGetActionStateFloat(m_session, &getInfo, &thumbstickYState), "Polling a thumbstick Y state");
-
-        const float radius = sqrt(pow(thumbstickXState.currentState, 2) + pow(thumbstickYState.currentState, 2));
+        // PICK
+        hand.pickedCube = pickCube(hand);
 
+        // REMOVE
+        if (commands.isRemoveRequested) {
+            if (hand.pickedCube != BoundingVolumeHierarchy::NO_ITEM) {
+                removeCube(hand.pickedCube);
+            }
+        }
         // PLACE
-        if (radius < 0.25 * 1 && thumbstickClickState.changedSinceLastSync && thumbstickClickState.currentState) {
+        else if (commands.isPlaceRequested) {
             XrSpaceLocation spaceLocation{ XR_TYPE_SPACE_LOCATION };
-            XrResult result = xrLocateSpace(hand.space, m_space, thumbstickClickState.lastChangeTime, &spaceLocation);
+            checkResult(xrLocateSpace(hand.space, m_space, commands.placeTime, &spaceLocation), "Locating a placed cube");
 
-            m_cubes.push_back({
-                .translation = spaceLocation.pose.position,
-                .rotation = spaceLocation.pose.orientation,
-                .scale = hand.scale,
-                .color = hand.color,
-                .type = hand.type
-                });
-        }
-
-        // The built-in deadzones into the Reverb G2 controllers' thumbsticks make this a bit awkward
-        // 1 == max radius
-        if (radius >= 0.25 * 1) {
-            float angle = acos(thumbstickXState.currentState / radius);
-            if (thumbstickYState.currentState < 0) {
-                angle = 2 * M_PI - angle;
-            }
-
-            if (thumbstickClickState.changedSinceLastSync && thumbstickClickState.currentState) {
-                hand.m_colorStartingAngle = angle;
-                hand.m_originalColor = hand.color;
+            // Without tracking the pose is stale or made up, it would end up in the scene file
+            const XrSpaceLocationFlags validFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+            if ((spaceLocation.locationFlags & validFlags) != validFlags) {
+                spdlog::warn("PLACE: the hand isn't tracked, no cube is placed");
             }
             else {
-                XrColor4f color;
-                // CURRENT COLOR, WHITE AND BLACK
-                if (hand.m_colorStartingAngle >= 0) {
-                    bool isClockwise;
-                    if (hand.m_colorStartingAngle < angle) {
-                        isClockwise = false;
-                    }
-                    else {
-                        isClockwise = true;
-                    }
-
-                    float angleDelta = abs(angle - hand.m_colorStartingAngle);
-                    if (M_PI < angleDelta) {
-                        isClockwise = !isClockwise;
-                        angleDelta = 2 * M_PI - abs(angle - hand.m_colorStartingAngle);
-                    }
-
-                    // Direction with shortest path from the original angle to the current angle
-                    if (isClockwise) {
-                        // Old color -> black
-                        if (angleDelta <= 2. / 3. * M_PI) {
-                            float multiplier = (1. - angleDelta / (2. / 3. * M_PI));
-                            color.r = hand.m_originalColor.r * multiplier;
-                            color.g = hand.m_originalColor.g * multiplier;
-                            color.b = hand.m_originalColor.b * multiplier;
-                        }
-                        // Black -> white
-                        else {
-                            color.r = 1. * ((angleDelta - 2. / 3. * M_PI) / (2. / 3. * M_PI));
-                            color.g = color.r;
-                            color.b = color.r;
-                        }
-                    }
-                    else {
-                        // Old color -> white
-                        if (angleDelta <= 2. / 3. * M_PI) {
-                            float multiplier = (angleDelta / (2. / 3. * (float)M_PI));
-                            color.r = hand.m_originalColor.r + (1. - hand.m_originalColor.r) * multiplier;
-                            color.g = hand.m_originalColor.g + (1. - hand.m_originalColor.g) * multiplier;
-                            color.b = hand.m_originalColor.b + (1. - hand.m_originalColor.b) * multiplier;
-                        }
-                        // White -> black
-                        else {
-                            color.r = 1. * (1. - (angleDelta - 2. / 3. * M_PI) / (2. / 3. * M_PI));
-                            color.g = color.r;
-                            color.b = color.r;
-                        }
-                    }
-                }
-                // RGB
-                // TODO possibly add a second dimension for intensity of the colour
-                else {
-                    if (11. / 6. * M_PI < angle || angle <= 1. / 2. * M_PI) {
-                        color.g = 0;
-                        if (11. / 6. * M_PI < angle) {
-                            float angleDelta = angle - 11. / 6. * M_PI;
-                            color.r = angleDelta / (2. / 3. * M_PI);
-                            color.b = 1 - color.r;
-                        }
-                        else {
-                            float angleDelta = 1. / 2. * M_PI - angle;
-                            color.b = angleDelta / (2. / 3. * M_PI);
-                            color.r = 1 - color.b;
-                        }
-                    }
-                    else if (1. / 2. * M_PI < angle && angle <= 7. / 6. * M_PI) {
-                        color.b = 0;
-                        float angleDelta = angle - 1. / 2. * M_PI;
-                        color.g = angleDelta / (2. / 3. * M_PI);
-                        color.r = 1 - color.g;
-                    }
-                    else {
-                        color.r = 0;
-                        float angleDelta = angle - 7. / 6. * M_PI;
-                        color.b = angleDelta / (2. / 3. * M_PI);
-                        color.g = 1 - color.b;
-                    }
-                }
-
-                hand.color = color;
+                addCube({
+                    .translation = spaceLocation.pose.position,
+                    .rotation = spaceLocation.pose.orientation,
+                    .scale = commands.placeScale,
+                    .color = commands.placeColor,
+                    .type = hand.type
+                    });
             }
         }
-        // the thumbstick's radius is not large enough so the color picker is not enabled and there's no starting angle for CWB
-        else {
-            hand.m_colorStartingAngle = -1;
+
+        if (commands.isTypeToggled) {
+            hand.type = static_cast<CubeType>((static_cast<int>(hand.type) + 1) % 2);
         }
+    }
+}
 
-        static const float MAX_CUBE_SCALE = 10.f;
-        static const float MIN_CUBE_SCALE = .01f;
+void VRCore::fetchSnapshot(Hand &hand) {
+    XrActionStateGetInfo getInfo{ XR_TYPE_ACTION_STATE_GET_INFO };
+    getInfo.subactionPath = hand.path;
 
-        getInfo.action = m_inputActions.expand;
-        XrActionStateFloat triggerState{ XR_TYPE_ACTION_STATE_FLOAT };
-        checkResult(xrGetActionStateFloat(m_session, &getInfo, &triggerState), "Polling a trigger state");
-        if (triggerState.currentState && min(min(hand.scale.x, hand.scale.y), hand.scale.z) < MAX_CUBE_SCALE) {
-            float delta = triggerState.currentState * ((MAX_CUBE_SCALE - 1) + 10 * (1 - MIN_CUBE_SCALE)) * 0.001f;
+    for (int action = 0; action < HandInput::ACTION_COUNT; action++) {
+        HandInput::ActionState &state = hand.snapshot.states[action];
+        getInfo.action = m_actions[action];
 
-            if (modifierXA && modifierYB) {
-                hand.scale.z += delta;
-                if (hand.scale.z > MAX_CUBE_SCALE) {
-                    hand.scale.z = MAX_CUBE_SCALE;
-                }
-            }
-            else if (modifierXA) {
-                hand.scale.x += delta;
-                if (hand.scale.x > MAX_CUBE_SCALE) {
-                    hand.scale.x = MAX_CUBE_SCALE;
-                }
+        switch (HandInput::ACTIONS[action].type) {
+            case XR_ACTION_TYPE_BOOLEAN_INPUT: {
+                XrActionStateBoolean booleanState{ XR_TYPE_ACTION_STATE_BOOLEAN };
+                checkResult(xrGetActionStateBoolean(m_session, &getInfo, &booleanState), "Polling a boolean action state");
+                state = { booleanState.currentState ? 1.f : 0.f, booleanState.changedSinceLastSync, booleanState.lastChangeTime };
+
+                break;
             }
-            else if (modifierYB) {
-                hand.scale.y += delta;
-                if (hand.scale.y > MAX_CUBE_SCALE) {
-                    hand.scale.y = MAX_CUBE_SCALE;
-                }
+            case XR_ACTION_TYPE_FLOAT_INPUT: {
+                XrActionStateFloat floatState{ XR_TYPE_ACTION_STATE_FLOAT };
+                checkResult(xrGetActionStateFloat(m_session, &getInfo, &floatState), "Polling a float action state");
+                state = { floatState.currentState, floatState.changedSinceLastSync, floatState.lastChangeTime };
+
+                break;
             }
-            else {
-                for (float *e : { &hand.scale.x, &hand.scale.y, &hand.scale.z }) {
-                    *e += delta;
-                    if (*e > MAX_CUBE_SCALE) {
-                        *e = MAX_CUBE_SCALE;
-                    }
-                }
+            default: {
+                // Poses are located through their spaces
+                state = { 0.f, XR_FALSE, 0 };
+
+                break;
             }
         }
+    }
+}
 
-        getInfo.action = m_inputActions.shrink;
-        XrActionStateFloat gripState{ XR_TYPE_ACTION_STATE_FLOAT };
-        checkResult(xrGetActionStateFloat(m_session, &getInfo, &gripState), "Polling a grip state");
-        if (gripState.currentState && max(max(hand.scale.x, hand.scale.y), hand.scale.z) > MIN_CUBE_SCALE) {
+uint32_t VRCore::pickCube(const Hand &hand) {
+    // A loaded scene only gets into the hierarchy once it's built
+    if (!m_predictedDisplayTime || m_cubes.empty() || m_cubeHierarchy.size() != m_cubes.size()) {
+        return BoundingVolumeHierarchy::NO_ITEM;
+    }
 
-            float delta = gripState.currentState * ((MAX_CUBE_SCALE - 1) + 10 * (1 - MIN_CUBE_SCALE)) * 0.001f;
-            if (modifierXA && modifierYB) {
-                hand.scale.z -= delta;
-                if (hand.scale.z < MIN_CUBE_SCALE) {
-                    hand.scale.z = MIN_CUBE_SCALE;
-                }
+    // Where the last frame showed the hand
+    const XrSpaceLocation &spaceLocation = hand.location;
+    const XrSpaceLocationFlags validFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+    if ((spaceLocation.locationFlags & validFlags) != validFlags) {
+        return BoundingVolumeHierarchy::NO_ITEM;
+    }
+
+    // The grip's -Z axis points forward through the fist
+    const XrQuaternionf &orientation = spaceLocation.pose.orientation;
+    const XrVector3f direction{
+        -2.f * (orientation.x * orientation.z + orientation.w * orientation.y),
+        -2.f * (orientation.y * orientation.z - orientation.w * orientation.x),
+        -1.f + 2.f * (orientation.x * orientation.x + orientation.y * orientation.y)
+    };
+
+    const BoundingVolumeHierarchy::Hit hit = m_cubeHierarchy.raycast(spaceLocation.pose.position, direction, MAX_PICK_DISTANCE, [this](uint32_t item, const XrVector3f &origin, const XrVector3f &direction, float maxDistance) {
+        const Cube &cube = m_cubes[item];
+        return BoundingVolumeHierarchy::intersectOrientedBox(origin, direction, maxDistance, cube.translation, cube.rotation, getCubeHalfExtents(cube));
+    });
+    return hit.item;
+}
+
+void VRCore::render() {
+    prepareFrame(m_packet);
+    submitFrame(m_packet);
+}
+
+void VRCore::prepareFrame(FramePacket &packet) {
+    // Room for every cube, grown before the audited part and kept with the packet
+    if (m_isPipelined && packet.instances.size() < m_cubes.size()) {
+        packet.instances.resize(m_cubes.capacity());
+    }
+
+    packet.frameIndex = m_frameIndex;
+    packet.inputTime = m_inputTime;
+    packet.frameState = { XR_TYPE_FRAME_STATE };
+    {
+        FrameProfiler::ScopedTimer waitFrameTimer(m_profiler, FrameProfiler::Phase::WAIT_FRAME);
+        XrFrameWaitInfo frameWaitInfo{ XR_TYPE_FRAME_WAIT_INFO };
+        checkResult(xrWaitFrame(m_session, &frameWaitInfo, &packet.frameState), "Waiting for a frame");
+    }
+    m_predictedDisplayTime = packet.frameState.predictedDisplayTime;
+
+    // Everything the frame needs is either preallocated or on the stack
+    AllocationAudit::begin("VRCore::prepareFrame");
+
+    // this seems to already be true on XR_SESSION_STATE_SYNCHRONIZED before it even gets to XR_SESSION_STATE_VISIBLE? very weird
+    if (packet.frameState.shouldRender) {
+        XrViewLocateInfo viewLocateInfo{ XR_TYPE_VIEW_LOCATE_INFO };
+        viewLocateInfo.viewConfigurationType = m_viewConfigurationType;
+        viewLocateInfo.displayTime = packet.frameState.predictedDisplayTime;
+        viewLocateInfo.space = m_space;
+
+        XrViewState viewState{ XR_TYPE_VIEW_STATE };
+        uint32_t viewCountOutput;
+        checkResult(xrLocateViews(m_session, &viewLocateInfo, &viewState, VIEW_COUNT, &viewCountOutput, m_views.data()), "Locating the views");
+        std::copy(m_views.begin(), m_views.end(), packet.views);
+
+        // Once for the frame, picking uses the same locations
+        packet.highlightCount = 0;
+        for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+            Hand &hand = m_hands[handIndex];
+            hand.location = { XR_TYPE_SPACE_LOCATION };
+            checkResult(xrLocateSpace(hand.space, m_space, packet.frameState.predictedDisplayTime, &hand.location), "Locating an action space");
+
+            packet.handPoses[handIndex] = hand.location.pose;
+            packet.handScales[handIndex] = hand.input.getScale();
+            packet.handColors[handIndex] = hand.input.getColor();
+            packet.handTypes[handIndex] = hand.type;
+
+            // A little larger so they aren't hidden inside filled ones
+            if (hand.pickedCube != BoundingVolumeHierarchy::NO_ITEM) {
+                static const XrVector3f HIGHLIGHT_SCALE = { 1.05f, 1.05f, 1.05f };
+                XrMatrix4x4f scaleTransformation;
+                XrMatrix4x4f::CreateScale(&scaleTransformation, HIGHLIGHT_SCALE.x, HIGHLIGHT_SCALE.y, HIGHLIGHT_SCALE.z);
+                XrMatrix4x4f::Multiply(&packet.highlightTransformations[packet.highlightCount++], &m_transformCache.getTransformation(hand.pickedCube), &scaleTransformation);
             }
-            else if (modifierXA) {
-                hand.scale.x -= delta;
-                if (hand.scale.x < MIN_CUBE_SCALE) {
-                    hand.scale.x = MIN_CUBE_SCALE;
+        }
+
+        {
+            FrameProfiler::ScopedTimer cullingTimer(m_profiler, FrameProfiler::Phase::CULLING);
+            // The GPU culls the cubes itself while submitting the frame
+            if (m_isCullingEnabled && !m_isGpuCullingEnabled) {
+                m_frustumCuller.setFrustum(m_views.data(), VIEW_COUNT, NEAR_Z, FAR_Z);
+                if (m_isHierarchicalCullingEnabled) {
+                    m_visibleCubes.clear();
+                    m_cubeHierarchy.queryFrustum(m_frustumCuller.getPlanes(), FrustumCuller::PLANE_COUNT, m_frustumCuller.getViewCount(), m_visibleCubes);
                 }
-            }
-            else if (modifierYB) {
-                hand.scale.y -= delta;
-                if (hand.scale.y < MIN_CUBE_SCALE) {
-                    hand.scale.y = MIN_CUBE_SCALE;
+                else {
+                    m_frustumCuller.cull(m_visibleCubes, m_jobSystem);
                 }
             }
-            else {
-                for (float *e : { &hand.scale.x, &hand.scale.y, &hand.scale.z }) {
-                    *e -= delta;
-                    if (*e < MIN_CUBE_SCALE) {
-                        *e = MIN_CUBE_SCALE;
-                    }
+
+            if (m_isPipelined) {
+                // The counts are added up and the packet still holds the ones of the last frame it carried
+                std::fill(packet.instanceCounts, packet.instanceCounts + CUBE_TYPE_COUNT, 0);
+                m_transformCache.countInstances(m_visibleCubes, packet.instanceCounts, m_jobSystem);
+                CubeInstance *instances[CUBE_TYPE_COUNT];
+                CubeInstance *instance = packet.instances.data();
+                for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+                    instances[type] = instance;
+                    instance += packet.instanceCounts[type];
                 }
+                m_transformCache.writeInstances(m_visibleCubes, instances, m_jobSystem);
             }
         }
+    }
+    else {
+        // Nothing picks with where the last shown frame had the hands, they may have lost tracking since
+        for (Hand &hand : m_hands) {
+            hand.location = { XR_TYPE_SPACE_LOCATION };
+        }
+    }
 
+    AllocationAudit::end();
 
-        getInfo.action = m_inputActions.modifierYB;
-        XrActionStateBoolean modifierYBClickState{ XR_TYPE_ACTION_STATE_BOOLEAN };
-        checkResult(xrGetActionStateBoolean(m_session, &getInfo, &modifierYBClickState), "Polling a modifier YB state");
-        if (modifierXAs[(handIndex + 1) % 2] && modifierYBClickState.changedSinceLastSync && modifierYB) {
-            hand.type = static_cast<CubeType>((static_cast<int>(hand.type) + 1) % 2);
+    // Logging may allocate the first time a thread logs so it's kept out of the audited part
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+    // Only the GPU knows how many cubes it culled
+    if (packet.frameState.shouldRender && m_frameIndex % STATISTICS_LOG_INTERVAL == 0 && !m_isGpuCullingEnabled) {
+        if (m_isCullingEnabled && m_isHierarchicalCullingEnabled) {
+            const BoundingVolumeHierarchy::Statistics statistics = m_cubeHierarchy.getStatistics();
+            DEFERRED_LOG_DEBUG("CULLING: {} visible, {} culled", m_visibleCubes.size(), m_cubes.size() - m_visibleCubes.size());
+            DEFERRED_LOG_DEBUG("HIERARCHY: {} nodes, height {}, {:.2f} relative cost, {} rebuilds", statistics.nodeCount, statistics.height, statistics.relativeCost, statistics.rebuildCount);
+        }
+        else if (m_isCullingEnabled) {
+            const FrustumCuller::Statistics &statistics = m_frustumCuller.getStatistics();
+            DEFERRED_LOG_DEBUG("CULLING: {} visible, {} culled", statistics.visibleCount, statistics.culledCount);
         }
     }
+#endif
+
+    m_frameIndex++;
 }
 
-void VRCore::render() {
-    XrFrameWaitInfo frameWaitInfo{ XR_TYPE_FRAME_WAIT_INFO };
-    XrFrameState frameState{ XR_TYPE_FRAME_STATE };
-    checkResult(xrWaitFrame(m_session, &frameWaitInfo, &frameState), "Waiting for a frame");
+void VRCore::submitFrame(const FramePacket &packet) {
+    const XrFrameState &frameState = packet.frameState;
+    // Grown before the audited part, the serial loop already did when the cubes were added
+    if (m_isPipelined && frameState.shouldRender) {
+        m_instanceStreamBuffer.reserve(sizeof(CubeInstance) * (std::accumulate(packet.instanceCounts, packet.instanceCounts + CUBE_TYPE_COUNT, (size_t)0) + CUBE_TYPE_COUNT));
+    }
+
+    AllocationAudit::begin("VRCore::submitFrame");
 
-    XrFrameBeginInfo frameBeginInfo{ XR_TYPE_FRAME_BEGIN_INFO };
-    checkResult(xrBeginFrame(m_session, &frameBeginInfo), "Beginning a frame");
+    {
+        FrameProfiler::ScopedTimer beginFrameTimer(m_renderProfiler, FrameProfiler::Phase::BEGIN_FRAME);
+        XrFrameBeginInfo frameBeginInfo{ XR_TYPE_FRAME_BEGIN_INFO };
+        checkResult(xrBeginFrame(m_session, &frameBeginInfo), "Beginning a frame");
+    }
 
-    std::vector<XrCompositionLayerBaseHeader *> layers;
+    XrCompositionLayerBaseHeader *layers[1];
+    uint32_t layerCount = 0;
     XrCompositionLayerProjection projectionLayer{ XR_TYPE_COMPOSITION_LAYER_PROJECTION };
-    std::vector<XrCompositionLayerProjectionView> projectionViews(2, { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW });
+    XrCompositionLayerProjectionView projectionViews[VIEW_COUNT]{ { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW }, { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW } };
+    // Chained to the projection views, so they have to live until xrEndFrame as well
+    XrCompositionLayerDepthInfoKHR depthInfos[VIEW_COUNT]{ { XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR }, { XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR } };
 
-    // this seems to already be true on XR_SESSION_STATE_SYNCHRONIZED before it even gets to XR_SESSION_STATE_VISIBLE? very weird
     if (frameState.shouldRender) {
-        XrViewLocateInfo viewLocateInfo{ XR_TYPE_VIEW_LOCATE_INFO };
-        viewLocateInfo.viewConfigurationType = m_viewConfigurationType;
-        viewLocateInfo.displayTime = frameState.predictedDisplayTime;
-        viewLocateInfo.space = m_space;
+        writeHandTransformations(packet);
 
-        XrViewState viewState{ XR_TYPE_VIEW_STATE };
-        uint32_t viewCountOutput;
-        checkResult(xrLocateViews(m_session, &viewLocateInfo, &viewState, VIEW_COUNT, &viewCountOutput, m_views.data()), "Locating the views");
+        if (m_isInstancingEnabled) {
+            FrameProfiler::ScopedTimer instancesTimer(m_renderProfiler, FrameProfiler::Phase::INSTANCES);
+            if (m_isPipelined) {
+                streamCubeInstances(packet);
+            }
+            else if (m_isGpuCullingEnabled) {
+                cullCubesOnGpu(packet.views);
+            }
+            else {
+                updateCubeInstances();
+            }
+        }
 
         const unsigned int imageWidth = m_configViews[0].recommendedImageRectWidth;
         const unsigned int imageHeight = m_configViews[0].recommendedImageRectHeight;
-        for (int i = 0; i < VIEW_COUNT; i++) {
-            XrSwapchainImageAcquireInfo acquireInfo{ XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO };
-            uint32_t swapchainImageIndex;
-            checkResult(xrAcquireSwapchainImage(m_swapchains[i], &acquireInfo, &swapchainImageIndex), "Acquiring a swapchain image");
 
-            XrSwapchainImageWaitInfo waitInfo{ XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO };
-            waitInfo.timeout = XR_INFINITE_DURATION;
-            checkResult(xrWaitSwapchainImage(m_swapchains[i], &waitInfo), "Waiting for a swapchain image");
+        XrMatrix4x4f viewProjections[VIEW_COUNT];
+        for (int i = 0; i < VIEW_COUNT; i++) {
+            const XrView &view = packet.views[i];
+            XrMatrix4x4f projection;
+            XrMatrix4x4f::CreateProjectionFov(&projection, view.fov, NEAR_Z, FAR_Z);
+            XrMatrix4x4f viewTransformation;
+            XrMatrix4x4f::CreateViewMatrix(&viewTransformation, &view.pose.position, &view.pose.orientation);
+            XrMatrix4x4f::Multiply(&viewProjections[i], &projection, &viewTransformation);
 
-            projectionViews[i].pose = m_views[i].pose;
-            projectionViews[i].fov = m_views[i].fov;
-            projectionViews[i].subImage.swapchain = m_swapchains[i];
+            projectionViews[i].pose = view.pose;
+            projectionViews[i].fov = view.fov;
+            projectionViews[i].subImage.swapchain = m_swapchains[m_isMultiviewEnabled ? 0 : i];
+            projectionViews[i].subImage.imageArrayIndex = m_isMultiviewEnabled ? i : 0;
             projectionViews[i].subImage.imageRect.extent = { (int32_t)imageWidth, (int32_t)imageHeight };
 
-            glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer[swapchainImageIndex]);
-            glViewport(0, 0, imageWidth, imageHeight);
-            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_images[i][swapchainImageIndex].image, 0);
-            glClear(GL_COLOR_BUFFER_BIT);
+            if (m_isDepthSubmitted) {
+                depthInfos[i].subImage = projectionViews[i].subImage;
+                depthInfos[i].subImage.swapchain = m_depthSwapchains[m_isMultiviewEnabled ? 0 : i];
+                depthInfos[i].minDepth = 0.f;
+                depthInfos[i].maxDepth = 1.f;
+                depthInfos[i].nearZ = NEAR_Z;
+                depthInfos[i].farZ = FAR_Z;
+                projectionViews[i].next = &depthInfos[i];
+            }
+        }
 
-            XrMatrix4x4f projection;
-            XrMatrix4x4f::CreateProjectionFov(&projection, m_views[i].fov, 0.1f, 100.0f);
-            XrMatrix4x4f transformation;
-            XrVector3f scale{ 1.f, 1.f, 1.f };
-            XrMatrix4x4f::CreateTranslationRotationScale(&transformation, &m_views[i].pose.position, &m_views[i].pose.orientation, &scale);
-            XrMatrix4x4f viewTransformation;
-            XrMatrix4x4f::InvertRigidBody(&viewTransformation, &transformation);
-            XrMatrix4x4f viewProjection;
-            XrMatrix4x4f::Multiply(&viewProjection, &projection, &viewTransformation);
+        // Multiview renders both eyes into the layers of one array swapchain in a single pass
+        const int passCount = m_isMultiviewEnabled ? 1 : VIEW_COUNT;
+        for (int i = 0; i < passCount; i++) {
+            uint32_t swapchainImageIndex;
+            uint32_t depthImageIndex = 0;
+            {
+                FrameProfiler::ScopedTimer acquireTimer(m_renderProfiler, FrameProfiler::Phase::ACQUIRE_IMAGE);
+                XrSwapchainImageAcquireInfo acquireInfo{ XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO };
+                checkResult(xrAcquireSwapchainImage(m_swapchains[i], &acquireInfo, &swapchainImageIndex), "Acquiring a swapchain image");
+                if (!m_depthSwapchains.empty()) {
+                    checkResult(xrAcquireSwapchainImage(m_depthSwapchains[i], &acquireInfo, &depthImageIndex), "Acquiring a depth swapchain image");
+                }
+            }
 
-            for (Hand hand : m_hands) {
-                XrSpaceLocation spaceLocation{ XR_TYPE_SPACE_LOCATION };
-                checkResult(xrLocateSpace(hand.space, m_space, frameState.predictedDisplayTime, &spaceLocation), "Locating an action space");
+            {
+                FrameProfiler::ScopedTimer waitTimer(m_renderProfiler, FrameProfiler::Phase::WAIT_IMAGE);
+                XrSwapchainImageWaitInfo waitInfo{ XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO };
+                waitInfo.timeout = XR_INFINITE_DURATION;
+                checkResult(xrWaitSwapchainImage(m_swapchains[i], &waitInfo), "Waiting for a swapchain image");
+                if (!m_depthSwapchains.empty()) {
+                    checkResult(xrWaitSwapchainImage(m_depthSwapchains[i], &waitInfo), "Waiting for a depth swapchain image");
+                }
+            }
 
-                XrMatrix4x4f modelTransformation;
-                XrMatrix4x4f::CreateTranslationRotationScale(&modelTransformation, &spaceLocation.pose.position, &spaceLocation.pose.orientation, &hand.scale);
+            {
+                FrameProfiler::ScopedTimer drawTimer(m_renderProfiler, static_cast<FrameProfiler::Phase>((int)FrameProfiler::Phase::DRAW_PASS_0 + i));
+                m_renderProfiler.beginGpuPass(i);
 
-                XrMatrix4x4f modelViewProjection;
-                XrMatrix4x4f::Multiply(&modelViewProjection, &viewProjection, &modelTransformation);
-                glUniformMatrix4fv(m_modelViewProjectionUniformId, 1, GL_FALSE, modelViewProjection.m);
+                glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffers[i][swapchainImageIndex]);
 
-                std::vector<GLfloat> color{ hand.color.r, hand.color.g, hand.color.b };
-                glUniform3fv(m_vertexColorUniformId, 1, color.data());
+                if (!m_depthSwapchains.empty()) {
+                    uint32_t &attachedDepthImageIndex = m_frameBufferDepthIndices[i][swapchainImageIndex];
+                    if (depthImageIndex != attachedDepthImageIndex) {
+                        attachImage(getDepthAttachment(), m_depthImages[i][depthImageIndex].image);
+                        attachedDepthImageIndex = depthImageIndex;
+                    }
+                }
 
-                drawCube(hand.type);
-            }
+                glViewport(0, 0, imageWidth, imageHeight);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            for (const Cube &cube : m_cubes) {
-                XrMatrix4x4f modelTransformation;
-                XrMatrix4x4f::CreateTranslationRotationScale(&modelTransformation, &cube.translation, &cube.rotation, &cube.scale);
+                drawScene(packet, &viewProjections[i]);
 
-                XrMatrix4x4f modelViewProjection;
-                XrMatrix4x4f::Multiply(&modelViewProjection, &viewProjection, &modelTransformation);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-                glUniformMatrix4fv(m_modelViewProjectionUniformId, 1, GL_FALSE, modelViewProjection.m);
+                m_renderProfiler.endGpuPass();
+            }
+        }
 
-                std::vector<GLfloat> color{ cube.color.r, cube.color.g, cube.color.b };
-                glUniform3fv(m_vertexColorUniformId, 1, color.data());
+        // As late as possible, the images are released right after
+        {
+            FrameProfiler::ScopedTimer lateLatchTimer(m_renderProfiler, FrameProfiler::Phase::LATE_LATCH);
+            latchHands(packet);
+        }
 
-                drawCube(cube.type);
+        for (int i = 0; i < passCount; i++) {
+            {
+                FrameProfiler::ScopedTimer releaseTimer(m_renderProfiler, FrameProfiler::Phase::RELEASE_IMAGE);
+                XrSwapchainImageReleaseInfo releaseInfo{ XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO };
+                checkResult(xrReleaseSwapchainImage(m_swapchains[i], &releaseInfo), "Releasing a swapchain image");
+                if (!m_depthSwapchains.empty()) {
+                    checkResult(xrReleaseSwapchainImage(m_depthSwapchains[i], &releaseInfo), "Releasing a depth swapchain image");
+                }
             }
+        }
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-            XrSwapchainImageReleaseInfo releaseInfo{ XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO };
-            checkResult(xrReleaseSwapchainImage(m_swapchains[i], &releaseInfo), "Releasing a swapchain image");
+        if (m_isInstancingEnabled && m_isCullingEnabled && !m_isGpuCullingEnabled) {
+            m_instanceStreamBuffer.endFrame();
         }
+        m_handTransformationBuffer.endFrame();
 
         projectionLayer.space = m_space;
-        projectionLayer.viewCount = (uint32_t)projectionViews.size();
-        projectionLayer.views = projectionViews.data();
-        layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader *>(&projectionLayer));
+        projectionLayer.viewCount = VIEW_COUNT;
+        projectionLayer.views = projectionViews;
+        layers[layerCount++] = reinterpret_cast<XrCompositionLayerBaseHeader *>(&projectionLayer);
     }
 
     XrFrameEndInfo frameEndInfo{ XR_TYPE_FRAME_END_INFO };
     frameEndInfo.displayTime = frameState.predictedDisplayTime;
     frameEndInfo.environmentBlendMode = m_environmentBlendMode;
-    frameEndInfo.layerCount = (uint32_t)layers.size();
-    frameEndInfo.layers = layers.data();
-    checkResult(xrEndFrame(m_session, &frameEndInfo), "Ending a frame");
-}
-
-void VRCore::drawCube(CubeType type) {
-    glBindVertexArray(m_vertexArrayId);
+    frameEndInfo.layerCount = layerCount;
+    frameEndInfo.layers = layers;
+    {
+        FrameProfiler::ScopedTimer endFrameTimer(m_renderProfiler, FrameProfiler::Phase::END_FRAME);
+        checkResult(xrEndFrame(m_session, &frameEndInfo), "Ending a frame");
+    }
 
-    if (type == CubeType::EMPTY) {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_emptyCubeIndexBufferId);
+    const std::chrono::duration<float, std::milli> latency = std::chrono::steady_clock::now() - packet.inputTime;
+    m_renderProfiler.add(FrameProfiler::Phase::LATENCY, latency.count());
 
-        glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_INT, (void *)0);
-        glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_INT, (void *)(4 * sizeof(GLuint)));
-        glDrawElements(GL_LINES, 8, GL_UNSIGNED_INT, (void *)(8 * sizeof(GLuint)));
+    AllocationAudit::end();
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // Logging may allocate the first time a thread logs so it's kept out of the audited part
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+    if (frameState.shouldRender && packet.frameIndex % STATISTICS_LOG_INTERVAL == 0) {
+        if (m_isInstancingEnabled && m_isCullingEnabled && !m_isGpuCullingEnabled) {
+            const StreamBuffer::Statistics &statistics = m_instanceStreamBuffer.getStatistics();
+            DEFERRED_LOG_DEBUG("STREAMING: {} bytes, {} fence waits, {} reallocations", statistics.uploadedBytes, statistics.fenceWaits, statistics.reallocations);
+        }
     }
-    else if (type == CubeType::FILLED) {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_filledCubeIndexBufferId);
+#endif
+}
 
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
+void VRCore::streamCubeInstances(const FramePacket &packet) {
+    m_instanceStreamBuffer.beginFrame(sizeof(CubeInstance) * (std::accumulate(packet.instanceCounts, packet.instanceCounts + CUBE_TYPE_COUNT, (size_t)0) + CUBE_TYPE_COUNT));
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    const CubeInstance *instance = packet.instances.data();
+    for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+        const size_t count = packet.instanceCounts[type];
+        const StreamBuffer::Allocation allocation = m_instanceStreamBuffer.allocate(sizeof(CubeInstance) * count, sizeof(CubeInstance));
+        memcpy(allocation.pointer, instance, sizeof(CubeInstance) * count);
+        instance += count;
+
+        CubeInstances &instances = m_cubeInstances[type];
+        instances.uploadedCount = (GLsizei)count;
+        const GLuint bufferId = m_instanceStreamBuffer.getBufferId();
+        setCubeInstanceAttributes(instances, bufferId, allocation.offset, sizeof(CubeInstance), bufferId, allocation.offset + sizeof(XrMatrix4x4f), sizeof(CubeInstance));
     }
 
-    glBindVertexArray(0);
+    m_instanceStreamBuffer.flush();
 }
 
-void VRCore::createWindow() {
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+void VRCore::writeHandTransformations(const FramePacket &packet) {
+    m_handTransformationBuffer.beginFrame(sizeof(HandTransformations));
+    m_handTransformationAllocation = m_handTransformationBuffer.allocate(sizeof(HandTransformations), m_uniformBufferAlignment);
+    HandTransformations *handTransformations = static_cast<HandTransformations *>(m_handTransformationAllocation.pointer);
+
+    for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+        const XrPosef &pose = packet.handPoses[handIndex];
+        XrMatrix4x4f::CreateTranslationRotationScale(&handTransformations->transformations[handIndex], &pose.position, &pose.orientation, &packet.handScales[handIndex]);
+    }
+    handTransformations->latestOffset = 0;
 
-    SDL_Window *window = SDL_CreateWindow("", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 0, 0, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
-    SDL_GLContext context = SDL_GL_CreateContext(window);
-    SDL_GL_MakeCurrent(window, context);
+    m_handTransformationBuffer.flush();
 }
 
-void VRCore::createInstance() {
-    if (m_instance != nullptr) {
-        throw std::runtime_error("Instance shoudn't be already initialized");
+void VRCore::latchHands(const FramePacket &packet) {
+    if (!m_isLateLatchingEnabled) {
+        return;
     }
 
-    std::vector<const char *> extensions = getExtensions();
+    HandTransformations *handTransformations = static_cast<HandTransformations *>(m_handTransformationAllocation.pointer);
+    const XrSpaceLocationFlags validFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+    for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+        // The spaces only change while the render thread isn't running
+        XrSpaceLocation location{ XR_TYPE_SPACE_LOCATION };
+        checkResult(xrLocateSpace(m_hands[handIndex].space, m_space, packet.frameState.predictedDisplayTime, &location), "Late latching an action space");
+
+        XrMatrix4x4f &transformation = handTransformations->transformations[HandInput::HAND_COUNT + handIndex];
+        // A hand that lost tracking in the meantime stays where the frame started with it
+        if ((location.locationFlags & validFlags) != validFlags) {
+            transformation = handTransformations->transformations[handIndex];
+            continue;
+        }
 
-    XrInstanceCreateInfo createInfo = { XR_TYPE_INSTANCE_CREATE_INFO };
-    createInfo.enabledExtensionCount = (uint32_t)extensions.size();
-    createInfo.enabledExtensionNames = extensions.data();
+        XrMatrix4x4f::CreateTranslationRotationScale(&transformation, &location.pose.position, &location.pose.orientation, &packet.handScales[handIndex]);
+    }
 
-    createInfo.applicationInfo = { "OpenXR test", 0, "", 0, XR_CURRENT_API_VERSION };
-    checkResult(xrCreateInstance(&createInfo, &m_instance), "Creating the OXR instance");
+    // A full fence also drains the write combining buffers, a draw never sees the new offset before both matrices
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    *static_cast<volatile int32_t *>(&handTransformations->latestOffset) = HandInput::HAND_COUNT;
 }
 
-std::vector<const char *> VRCore::getExtensions() const {
-    std::vector<const char *> extensions;
-    uint32_t extensionCount;
-    checkResult(xrEnumerateInstanceExtensionProperties(nullptr, 0, &extensionCount, nullptr), "Getting the count of available OXR extensions");
+void VRCore::drawScene(const FramePacket &packet, const XrMatrix4x4f *viewProjections) {
+    // The hand transformations come from the uniform buffer, the late latch may still replace them
+    glUseProgram(m_handProgram.programId);
+    glUniformMatrix4fv(m_handProgram.viewProjectionUniformId, m_isMultiviewEnabled ? VIEW_COUNT : 1, GL_FALSE, viewProjections[0].m);
+    glBindBufferRange(GL_UNIFORM_BUFFER, HAND_TRANSFORMATIONS_BINDING, m_handTransformationBuffer.getBufferId(), m_handTransformationAllocation.offset, sizeof(HandTransformations));
 
-    std::vector<XrExtensionProperties> extensionProperties(extensionCount, { XR_TYPE_EXTENSION_PROPERTIES });
-    checkResult(xrEnumerateInstanceExtensionProperties(nullptr, extensionCount, &extensionCount, extensionProperties.data()), "Getting the properties of available OXR extensions");
+    // Every mesh is in the arena, switching between them binds nothing
+    glBindVertexArray(m_vertexArrayId);
 
-    for (uint32_t i = 0; i < extensionCount; i++) {
-        spdlog::info("EXT: {}", extensionProperties[i].extensionName);
+    for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+        glUniform1i(m_handProgram.handIndexUniformId, handIndex);
+        glUniform3fv(m_handProgram.vertexColorUniformId, 1, &packet.handColors[handIndex].r);
+
+        drawCube(packet.handTypes[handIndex]);
     }
 
-    std::vector<const char *> extensionNames = {
-        "XR_KHR_opengl_enable",
-        "XR_EXT_hp_mixed_reality_controller"
-    };
+    glUseProgram(m_isMultiviewEnabled ? m_multiviewProgramId : m_programId);
+    if (m_isMultiviewEnabled) {
+        glUniformMatrix4fv(m_multiviewViewProjectionUniformId, VIEW_COUNT, GL_FALSE, viewProjections[0].m);
+    }
 
-    for (const auto &extensionName : extensionNames) {
-        for (const auto &extensionProperty : extensionProperties) {
-            if (strcmp(extensionProperty.extensionName, extensionName) == 0) {
-                extensions.push_back(extensionName);
-                break;
-            }
-        }
+    for (uint32_t i = 0; i < packet.highlightCount; i++) {
+        setCubeUniforms(viewProjections, packet.highlightTransformations[i], &PICK_HIGHLIGHT_COLOR.r);
+
+        drawCube(CubeType::EMPTY);
     }
 
-    if (extensionNames.size() != extensions.size()) {
-        throw std::runtime_error("Not allrequired extensions are supported");
+    if (m_isInstancingEnabled) {
+        drawCubesInstanced(viewProjections);
     }
+    else {
+        // Only ever serial, the scene belongs to the simulation
+        const size_t cubeCount = m_isCullingEnabled ? m_visibleCubes.size() : m_cubes.size();
+        for (size_t i = 0; i < cubeCount; i++) {
+            const size_t cubeIndex = m_isCullingEnabled ? m_visibleCubes[i] : i;
+            const Cube &cube = m_cubes[cubeIndex];
 
-    return extensions;
-}
+            setCubeUniforms(viewProjections, m_transformCache.getTransformation(cubeIndex), &cube.color.r);
 
-void VRCore::initSystem() {
-    if (m_instance == XR_NULL_HANDLE) {
+            drawCube(cube.type);
+        }
+    }
+
+    glBindVertexArray(0);
+}
+
+void VRCore::setCubeUniforms(const XrMatrix4x4f *viewProjections, const XrMatrix4x4f &modelTransformation, const GLfloat *color) {
+    if (m_isMultiviewEnabled) {
+        // The view-projections are already set, the shader picks one per view
+        glUniformMatrix4fv(m_multiviewModelTransformationUniformId, 1, GL_FALSE, modelTransformation.m);
+        glUniform3fv(m_multiviewVertexColorUniformId, 1, color);
+    }
+    else {
+        XrMatrix4x4f modelViewProjection;
+        XrMatrix4x4f::Multiply(&modelViewProjection, viewProjections, &modelTransformation);
+        glUniformMatrix4fv(m_modelViewProjectionUniformId, 1, GL_FALSE, modelViewProjection.m);
+        glUniform3fv(m_vertexColorUniformId, 1, color);
+    }
+}
+
+void VRCore::addCube(const Cube &cube) {
+    m_cubes.push_back(cube);
+
+    // Placed cubes never move so their model transformation is only ever computed here
+    m_transformCache.add(cube.translation, cube.rotation, cube.scale, cube.color, static_cast<uint32_t>(cube.type));
+
+    m_frustumCuller.add(cube.translation, getCubeRadius(cube));
+    m_cubeHierarchy.insert((uint32_t)m_cubes.size() - 1, BoundingVolumeHierarchy::getOrientedBoxBounds(cube.translation, cube.rotation, getCubeHalfExtents(cube)));
+    saveRecord(reinterpret_cast<const SceneFile::Record &>(cube));
+
+    // Grow everything the frame loop fills per cube now rather than in the middle of a frame, the render thread grows
+    // the stream buffer itself
+    m_visibleCubes.reserve(m_cubes.capacity());
+    if (m_isInstancingEnabled && m_isCullingEnabled && !m_isGpuCullingEnabled && !m_isPipelined) {
+        m_instanceStreamBuffer.reserve(sizeof(CubeInstance) * (m_cubes.capacity() + CUBE_TYPE_COUNT));
+    }
+}
+
+void VRCore::removeCube(uint32_t index) {
+    const TransformCache::Location location = m_transformCache.getLocation(index);
+
+    m_transformCache.remove(index);
+    m_frustumCuller.remove(index);
+    m_cubeHierarchy.remove(index);
+
+    const uint32_t lastIndex = (uint32_t)m_cubes.size() - 1;
+    if (index != lastIndex) {
+        m_cubes[index] = m_cubes[lastIndex];
+        m_cubeHierarchy.rename(lastIndex, index);
+    }
+    m_cubes.pop_back();
+    // Loading moves the last cube the same way
+    saveRecord(SceneFile::createRemoval(index));
+
+    // The bucket's last cube moved into the removed one's slot, the unculled instances are uploaded again from there, as
+    // are the ones the GPU culls. Ones culled on the CPU are streamed anew every frame
+    if (m_isInstancingEnabled && (!m_isCullingEnabled || m_isGpuCullingEnabled)) {
+        CubeInstances &instances = m_cubeInstances[location.bucket];
+        instances.uploadedCount = std::min(instances.uploadedCount, (GLsizei)location.index);
+    }
+
+    // The other hand may have picked the removed or the moved cube
+    for (Hand &hand : m_hands) {
+        hand.pickedCube = BoundingVolumeHierarchy::NO_ITEM;
+    }
+}
+
+// The cube's vertices are 0.1 away from its center on every axis
+XrVector3f VRCore::getCubeHalfExtents(const Cube &cube) {
+    return { 0.1f * cube.scale.x, 0.1f * cube.scale.y, 0.1f * cube.scale.z };
+}
+
+float VRCore::getCubeRadius(const Cube &cube) {
+    const XrVector3f halfExtents = getCubeHalfExtents(cube);
+    return sqrtf(halfExtents.x * halfExtents.x + halfExtents.y * halfExtents.y + halfExtents.z * halfExtents.z);
+}
+
+void VRCore::loadScene(const std::string &path) {
+    static_assert(sizeof(Cube) == sizeof(SceneFile::Record) && offsetof(Cube, color) == offsetof(SceneFile::Record, color) && offsetof(Cube, type) == offsetof(SceneFile::Record, type), "Cubes are copied straight out of the scene file");
+    static_assert(sizeof(Cube) == sizeof(TransformCache::Object) && offsetof(Cube, color) == offsetof(TransformCache::Object, color) && offsetof(Cube, type) == offsetof(TransformCache::Object, bucket), "Cubes are added to the transform cache as they are");
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+        m_sceneFile.open(path);
+    }
+    catch (std::runtime_error e) {
+        spdlog::error("{}, placed cubes won't be saved", e.what());
+        return;
+    }
+
+    // Anything from a broken record on gets dropped. The counts only go up, removed cubes are still in them
+    const SceneFile::Record *records = m_sceneFile.getMappedRecords();
+    size_t recordCount = m_sceneFile.size();
+    size_t cubeCount = 0;
+    size_t typeCounts[CUBE_TYPE_COUNT] = {};
+    for (size_t i = 0; i < recordCount; i++) {
+        const bool isRemoval = records[i].type == SceneFile::REMOVAL_TYPE;
+        if (isRemoval ? SceneFile::getRemovedIndex(records[i]) >= cubeCount : records[i].type >= CUBE_TYPE_COUNT) {
+            spdlog::warn("SCENE: record {} of {} is broken, dropping it and the {} after it", i, path, recordCount - i - 1);
+            recordCount = i;
+            break;
+        }
+        if (isRemoval) {
+            cubeCount--;
+        }
+        else {
+            typeCounts[records[i].type]++;
+            cubeCount++;
+        }
+    }
+
+    const Cube *cubes = reinterpret_cast<const Cube *>(records);
+    m_cubes.assign(cubes, cubes + recordCount);
+    m_sceneFile.unmap();
+
+    // Removals and broken records are only replayed once, the file then starts over with the cubes that are left
+    if (cubeCount != m_sceneFile.size()) {
+        SceneFile::compact(reinterpret_cast<SceneFile::Record *>(m_cubes.data()), recordCount);
+        m_cubes.resize(cubeCount);
+        try {
+            m_sceneFile.rewrite(reinterpret_cast<const SceneFile::Record *>(m_cubes.data()), cubeCount);
+        }
+        catch (std::runtime_error e) {
+            spdlog::error("{}, placed cubes won't be saved", e.what());
+            m_sceneFile.close();
+        }
+    }
+
+    m_transformCache.reserve(typeCounts);
+    m_frustumCuller.reserve(cubeCount);
+    m_transformCache.add(reinterpret_cast<const TransformCache::Object *>(m_cubes.data()), cubeCount, m_jobSystem);
+    for (const Cube &cube : m_cubes) {
+        m_frustumCuller.add(cube.translation, getCubeRadius(cube));
+    }
+
+    std::vector<BoundingVolumeHierarchy::Box> boxes(cubeCount);
+    m_jobSystem.parallelFor((uint32_t)cubeCount, TransformCache::PARALLEL_GRAIN_SIZE, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const Cube &cube = m_cubes[i];
+            boxes[i] = BoundingVolumeHierarchy::getOrientedBoxBounds(cube.translation, cube.rotation, getCubeHalfExtents(cube));
+        }
+    });
+    // Picking only starts once the hierarchy is built and swapped in
+    m_cubeHierarchy.load(std::move(boxes));
+
+    m_visibleCubes.reserve(m_cubes.capacity());
+    if (m_isInstancingEnabled && m_isCullingEnabled && !m_isGpuCullingEnabled) {
+        m_instanceStreamBuffer.reserve(sizeof(CubeInstance) * (m_cubes.capacity() + CUBE_TYPE_COUNT));
+    }
+
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("SCENE: {} cubes loaded from {} in {:.1f} ms", cubeCount, path, milliseconds);
+}
+
+// Appends a placed cube or a removal to the scene file, saving stops for good on the first error
+void VRCore::saveRecord(const SceneFile::Record &record) {
+    if (!m_sceneFile.isOpen()) {
+        return;
+    }
+
+    try {
+        m_sceneFile.append(&record, 1);
+    }
+    catch (std::runtime_error e) {
+        spdlog::error("{}, placed cubes won't be saved anymore", e.what());
+        m_sceneFile.close();
+    }
+}
+
+void VRCore::drawCube(CubeType type) {
+    m_meshArena.draw(static_cast<uint32_t>(type));
+}
+
+void VRCore::updateCubeInstances() {
+    if (m_isCullingEnabled) {
+        // Only the visible cubes get streamed, compacted per type
+        size_t visibleCounts[CUBE_TYPE_COUNT] = {};
+        m_transformCache.countInstances(m_visibleCubes, visibleCounts, m_jobSystem);
+
+        m_instanceStreamBuffer.beginFrame(sizeof(CubeInstance) * (m_visibleCubes.size() + CUBE_TYPE_COUNT));
+
+        CubeInstance *visibleInstances[CUBE_TYPE_COUNT];
+        for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+            const StreamBuffer::Allocation allocation = m_instanceStreamBuffer.allocate(sizeof(CubeInstance) * visibleCounts[type], sizeof(CubeInstance));
+            visibleInstances[type] = static_cast<CubeInstance *>(allocation.pointer);
+
+            CubeInstances &instances = m_cubeInstances[type];
+            instances.uploadedCount = (GLsizei)visibleCounts[type];
+            const GLuint bufferId = m_instanceStreamBuffer.getBufferId();
+            setCubeInstanceAttributes(instances, bufferId, allocation.offset, sizeof(CubeInstance), bufferId, allocation.offset + sizeof(XrMatrix4x4f), sizeof(CubeInstance));
+        }
+
+        // Only ever serial, so this is the thread the jobs belong to
+        m_transformCache.writeInstances(m_visibleCubes, visibleInstances, m_jobSystem);
+
+        m_instanceStreamBuffer.flush();
+    }
+    else {
+        // The cache is laid out exactly like the instance buffers, only the newly placed cubes get uploaded
+        for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+            uploadCubeInstances(m_cubeInstances[type], m_transformCache.getBucketTransformations(type), m_transformCache.getBucketColors(type), (GLsizei)m_transformCache.getBucketSize(type));
+        }
+    }
+}
+
+void VRCore::setCubeInstanceAttributes(CubeInstances &instances, GLuint transformationBufferId, GLintptr transformationOffset, GLsizei transformationStride, GLuint colorBufferId, GLintptr colorOffset, GLsizei colorStride) {
+    glBindVertexArray(instances.vertexArrayId);
+
+    // A mat4 attribute takes up four consecutive locations, one per column
+    glBindBuffer(GL_ARRAY_BUFFER, transformationBufferId);
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribPointer(1 + column, 4, GL_FLOAT, GL_FALSE, transformationStride, (GLvoid *)(transformationOffset + column * 4 * sizeof(GLfloat)));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, colorBufferId);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, colorStride, (GLvoid *)colorOffset);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VRCore::uploadCubeInstances(CubeInstances &instances, const XrMatrix4x4f *transformations, const XrColor4f *colors, GLsizei count) {
+    GLsizei first = instances.uploadedCount;
+    if (count > instances.capacity) {
+        // Grow geometrically and upload everything again
+        instances.capacity = std::max(count, 2 * instances.capacity);
+        first = 0;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instances.transformationBufferId);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(XrMatrix4x4f) * instances.capacity, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, instances.colorBufferId);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(XrColor4f) * instances.capacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+
+    if (count > first) {
+        glBindBuffer(GL_ARRAY_BUFFER, instances.transformationBufferId);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(XrMatrix4x4f) * first, sizeof(XrMatrix4x4f) * (count - first), &transformations[first]);
+        glBindBuffer(GL_ARRAY_BUFFER, instances.colorBufferId);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(XrColor4f) * first, sizeof(XrColor4f) * (count - first), &colors[first]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    instances.uploadedCount = count;
+}
+
+void VRCore::drawCubesInstanced(const XrMatrix4x4f *viewProjections) {
+    if (m_isMultiviewEnabled) {
+        glUseProgram(m_instancedMultiviewProgramId);
+        glUniformMatrix4fv(m_instancedMultiviewViewProjectionUniformId, VIEW_COUNT, GL_FALSE, viewProjections[0].m);
+    }
+    else {
+        glUseProgram(m_instancedProgramId);
+        glUniformMatrix4fv(m_viewProjectionUniformId, 1, GL_FALSE, viewProjections[0].m);
+    }
+
+    if (m_isGpuCullingEnabled) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawCommandBufferId);
+    }
+
+    for (int type = 0; type < CUBE_TYPE_COUNT; type++) {
+        const CubeInstances &instances = m_cubeInstances[type];
+        const GLsizei count = instances.uploadedCount;
+        if (!count) {
+            continue;
+        }
+
+        // Only the instance attributes differ between the vertex arrays, the mesh is a range of the arena
+        glBindVertexArray(instances.vertexArrayId);
+        if (m_isGpuCullingEnabled) {
+            // How many of them are visible only the command knows
+            glMultiDrawElementsIndirect(m_meshArena.getMesh(type).mode, GL_UNSIGNED_INT, (void *)(sizeof(DrawElementsIndirectCommand) * type), 1, 0);
+        }
+        else {
+            m_meshArena.drawInstanced(type, count);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void VRCore::cullCubesOnGpu(const XrView *views) {
+    // The culled cubes are read from where the unculled ones are drawn from, only new and moved ones get uploaded
+    bool isResized = false;
+    for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+        CubeInstances &instances = m_cubeInstances[type];
+        uploadCubeInstances(instances, m_transformCache.getBucketTransformations(type), m_transformCache.getBucketColors(type), (GLsizei)m_transformCache.getBucketSize(type));
+        isResized = isResized || instances.capacity != m_visibleInstanceCapacities[type];
+    }
+
+    // No more of a type can be visible than there are, so every type gets a region as large as its instance buffers
+    if (isResized) {
+        GLsizeiptr size = 0;
+        for (const CubeInstances &instances : m_cubeInstances) {
+            size += sizeof(CubeInstance) * instances.capacity;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, m_visibleInstanceBufferId);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        GLintptr offset = 0;
+        for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+            CubeInstances &instances = m_cubeInstances[type];
+            setCubeInstanceAttributes(instances, m_visibleInstanceBufferId, offset, sizeof(CubeInstance), m_visibleInstanceBufferId, offset + sizeof(XrMatrix4x4f), sizeof(CubeInstance));
+            m_visibleInstanceCapacities[type] = instances.capacity;
+            offset += sizeof(CubeInstance) * instances.capacity;
+        }
+    }
+
+    DrawElementsIndirectCommand commands[CUBE_TYPE_COUNT];
+    for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+        const MeshArena::Mesh &mesh = m_meshArena.getMesh(type);
+        commands[type] = { (GLuint)mesh.indexCount, 0, mesh.firstIndex, mesh.baseVertex, 0 };
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawCommandBufferId);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // Both eyes' own frusta, a cube only one eye sees still gets drawn for both
+    XrVector4f planes[VIEW_COUNT * FrustumCuller::PLANE_COUNT];
+    for (int i = 0; i < VIEW_COUNT; i++) {
+        FrustumCuller::createViewPlanes(&planes[i * FrustumCuller::PLANE_COUNT], views[i], NEAR_Z, FAR_Z);
+    }
+
+    glUseProgram(m_cullingProgramId);
+    glUniform4fv(m_cullingPlanesUniformId, VIEW_COUNT * FrustumCuller::PLANE_COUNT, &planes[0].x);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleInstanceBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_drawCommandBufferId);
+
+    GLuint firstInstance = 0;
+    for (uint32_t type = 0; type < CUBE_TYPE_COUNT; type++) {
+        const CubeInstances &instances = m_cubeInstances[type];
+        if (instances.uploadedCount) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instances.transformationBufferId);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instances.colorBufferId);
+            glUniform1ui(m_cullingCountUniformId, (GLuint)instances.uploadedCount);
+            glUniform1ui(m_cullingCommandIndexUniformId, type);
+            glUniform1ui(m_cullingFirstInstanceUniformId, firstInstance);
+
+            // Past the limit of one dimension the groups wrap into the second
+            const GLuint groupCount = (instances.uploadedCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE;
+            const GLuint groupCountX = std::min(groupCount, GPU_CULLING_MAX_GROUP_COUNT);
+            glDispatchCompute(groupCountX, (groupCount + groupCountX - 1) / groupCountX, 1);
+        }
+        firstInstance += instances.capacity;
+    }
+
+    for (GLuint binding = 0; binding < 4; binding++) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+
+    // The draws read the commands and instances, the next frame's reset overwrites the counts
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+#if defined(OPENXRTEST_EGL)
+void VRCore::createContext() {
+    // Everything is rendered into swapchain images, so no window or pbuffer is needed, which also keeps
+    // Mesa's llvmpipe usable on machines without any display
+    if (epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+        m_display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    else {
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, nullptr, nullptr)) {
+        throw std::runtime_error("Initializing the EGL display");
+    }
+    if (!epoxy_has_egl_extension(m_display, "EGL_KHR_surfaceless_context")) {
+        throw std::runtime_error("EGL display doesn't support surfaceless contexts");
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        throw std::runtime_error("Binding the OpenGL API");
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLint configCount;
+    if (!eglChooseConfig(m_display, configAttributes, &m_config, 1, &configCount) || !configCount) {
+        throw std::runtime_error("Choosing the EGL config");
+    }
+
+    // The least the renderer needs, drivers like Mesa's hand out their newest core version anyway and GPU culling
+    // checks for what it needs
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    m_context = eglCreateContext(m_display, m_config, EGL_NO_CONTEXT, contextAttributes);
+    if (m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        throw std::runtime_error("Creating the EGL context");
+    }
+
+    // epoxy doesn't know about the OVR_multiview entry points
+    m_glFramebufferTextureMultiviewOVR = reinterpret_cast<PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC>(eglGetProcAddress("glFramebufferTextureMultiviewOVR"));
+}
+
+void VRCore::bindContext() {
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        throw std::runtime_error("Making the EGL context current");
+    }
+}
+
+void VRCore::releaseContext() {
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void VRCore::destroyContext() {
+    if (m_display == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(m_display, m_context);
+        m_context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(m_display);
+    m_display = EGL_NO_DISPLAY;
+}
+#else
+void VRCore::createContext() {
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+
+    m_window = SDL_CreateWindow("", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 0, 0, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    m_context = SDL_GL_CreateContext(m_window);
+    SDL_GL_MakeCurrent(m_window, m_context);
+
+    // epoxy doesn't know about the OVR_multiview entry points
+    m_glFramebufferTextureMultiviewOVR = reinterpret_cast<PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC>(SDL_GL_GetProcAddress("glFramebufferTextureMultiviewOVR"));
+}
+
+void VRCore::bindContext() {
+    if (SDL_GL_MakeCurrent(m_window, m_context)) {
+        throw std::runtime_error(std::string("Making the GL context current\t") + SDL_GetError());
+    }
+}
+
+void VRCore::releaseContext() {
+    SDL_GL_MakeCurrent(m_window, nullptr);
+}
+
+void VRCore::destroyContext() {
+    if (m_context) {
+        SDL_GL_DeleteContext(m_context);
+        m_context = nullptr;
+    }
+    if (m_window) {
+        SDL_DestroyWindow(m_window);
+        m_window = nullptr;
+    }
+    SDL_Quit();
+}
+#endif
+
+void VRCore::createInstance() {
+    if (m_instance != nullptr) {
+        throw std::runtime_error("Instance shoudn't be already initialized");
+    }
+
+    std::vector<const char *> extensions = getExtensions();
+
+    XrInstanceCreateInfo createInfo = { XR_TYPE_INSTANCE_CREATE_INFO };
+    createInfo.enabledExtensionCount = (uint32_t)extensions.size();
+    createInfo.enabledExtensionNames = extensions.data();
+
+    createInfo.applicationInfo = { "OpenXR test", 0, "", 0, XR_CURRENT_API_VERSION };
+    checkResult(xrCreateInstance(&createInfo, &m_instance), "Creating the OXR instance");
+}
+
+std::vector<const char *> VRCore::getExtensions() {
+    std::vector<const char *> extensions;
+    uint32_t extensionCount;
+    checkResult(xrEnumerateInstanceExtensionProperties(nullptr, 0, &extensionCount, nullptr), "Getting the count of available OXR extensions");
+
+    std::vector<XrExtensionProperties> extensionProperties(extensionCount, { XR_TYPE_EXTENSION_PROPERTIES });
+    checkResult(xrEnumerateInstanceExtensionProperties(nullptr, extensionCount, &extensionCount, extensionProperties.data()), "Getting the properties of available OXR extensions");
+
+    for (uint32_t i = 0; i < extensionCount; i++) {
+        spdlog::info("EXT: {}", extensionProperties[i].extensionName);
+    }
+
+    std::vector<const char *> extensionNames = {
+        "XR_KHR_opengl_enable",
+#if defined(OPENXRTEST_EGL)
+        OPENXRTEST_MNDX_EGL_ENABLE_EXTENSION_NAME,
+#endif
+        "XR_EXT_hp_mixed_reality_controller"
+    };
+
+    for (const auto &extensionName : extensionNames) {
+        for (const auto &extensionProperty : extensionProperties) {
+            if (strcmp(extensionProperty.extensionName, extensionName) == 0) {
+                extensions.push_back(extensionName);
+                break;
+            }
+        }
+    }
+
+    if (extensionNames.size() != extensions.size()) {
+        throw std::runtime_error("Not allrequired extensions are supported");
+    }
+
+    // Nice to have, the app works without them
+    m_isDepthLayerSupported = false;
+    for (const auto &extensionProperty : extensionProperties) {
+        if (strcmp(extensionProperty.extensionName, XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME) == 0) {
+            extensions.push_back(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+            m_isDepthLayerSupported = true;
+        }
+    }
+    spdlog::info("DEPTH LAYER: {}", m_isDepthLayerSupported);
+
+    return extensions;
+}
+
+void VRCore::initSystem() {
+    if (m_instance == XR_NULL_HANDLE) {
         throw std::runtime_error("Instance not created");
     }
     if (m_systemId != XR_NULL_SYSTEM_ID) {
@@ -581,12 +1390,23 @@ void VRCore::initSession() {
     XrGraphicsRequirementsOpenGLKHR graphicsRequirements{ XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_KHR };
     checkResult(pfnGetOpenGLGraphicsRequirementsKHR(m_instance, m_systemId, &graphicsRequirements), "Getting graphics requirements");
 
+#if defined(OPENXRTEST_EGL)
+    OpenXRTestGraphicsBindingEGLMNDX graphicsBinding{
+        OPENXRTEST_TYPE_GRAPHICS_BINDING_EGL_MNDX,
+        nullptr,
+        reinterpret_cast<PFN_OpenXRTestEglGetProcAddressMNDX>(eglGetProcAddress),
+        m_display,
+        m_config,
+        m_context
+    };
+#else
     XrGraphicsBindingOpenGLWin32KHR graphicsBinding{
         XR_TYPE_GRAPHICS_BINDING_OPENGL_WIN32_KHR,
         nullptr,
         wglGetCurrentDC(),
         wglGetCurrentContext()
     };
+#endif
 
     XrSessionCreateInfo createInfo{ XR_TYPE_SESSION_CREATE_INFO };
     createInfo.next = &graphicsBinding;
@@ -617,13 +1437,15 @@ void VRCore::initReferenceSpace() {
 }
 
 void VRCore::initActions() {
-    if (m_session == XR_NULL_HANDLE) {
-        throw std::runtime_error("Session not initialized");
+    if (m_instance == XR_NULL_HANDLE) {
+        throw std::runtime_error("Instance not created");
     }
 
-    xrStringToPath(m_instance, "/user/hand/left", &m_hands[0].path);
-    xrStringToPath(m_instance, "/user/hand/right", &m_hands[1].path);
-    std::vector<XrPath> m_handPaths = { m_hands[0].path, m_hands[1].path };
+    XrPath handPaths[HandInput::HAND_COUNT];
+    for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+        checkResult(xrStringToPath(m_instance, HandInput::HAND_PATHS[handIndex], &handPaths[handIndex]), "String to path: hand");
+        m_hands[handIndex].path = handPaths[handIndex];
+    }
 
     XrActionSetCreateInfo actionSetInfo{ XR_TYPE_ACTION_SET_CREATE_INFO };
     strcpy_s(actionSetInfo.actionSetName, "interaction");
@@ -632,111 +1454,49 @@ void VRCore::initActions() {
     checkResult(xrCreateActionSet(m_instance, &actionSetInfo, &m_actionSet), "Creating the action set");
 
     XrActionCreateInfo actionInfo{ XR_TYPE_ACTION_CREATE_INFO };
-    actionInfo.countSubactionPaths = uint32_t(m_handPaths.size());
-    actionInfo.subactionPaths = m_handPaths.data();
-
-    strcpy_s(actionInfo.actionName, "pose");
-    strcpy_s(actionInfo.localizedActionName, "Pose");
-    actionInfo.actionType = XR_ACTION_TYPE_POSE_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.pose), "Creating action \"Pose\"");
-
-    strcpy_s(actionInfo.actionName, "place");
-    strcpy_s(actionInfo.localizedActionName, "Place");
-    actionInfo.actionType = XR_ACTION_TYPE_BOOLEAN_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.place), "Creating action \"Place\"");
-
-    strcpy_s(actionInfo.actionName, "expand");
-    strcpy_s(actionInfo.localizedActionName, "Expand");
-    actionInfo.actionType = XR_ACTION_TYPE_FLOAT_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.expand), "Creating action \"Expand\"");
-
-    strcpy_s(actionInfo.actionName, "shrink");
-    strcpy_s(actionInfo.localizedActionName, "Shrink");
-    actionInfo.actionType = XR_ACTION_TYPE_FLOAT_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.shrink), "Creating action \"Shrink\"");
-
-    strcpy_s(actionInfo.actionName, "modifier_xa");
-    strcpy_s(actionInfo.localizedActionName, "Modifier XA");
-    actionInfo.actionType = XR_ACTION_TYPE_BOOLEAN_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.modifierXA), "Creating action \"Modifier XA\"");
-
-    strcpy_s(actionInfo.actionName, "modifier_yb");
-    strcpy_s(actionInfo.localizedActionName, "Modifier YB");
-    actionInfo.actionType = XR_ACTION_TYPE_BOOLEAN_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.modifierYB), "Creating action \"Modifier YB\"");
-
-    strcpy_s(actionInfo.actionName, "thumbstick_x");
-    strcpy_s(actionInfo.localizedActionName, "Thumbstick X");
-    actionInfo.actionType = XR_ACTION_TYPE_FLOAT_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.thumbstickX), "Creating action \"Thumbstick X\"");
-
-    strcpy_s(actionInfo.actionName, "thumbstick_y");
-    strcpy_s(actionInfo.localizedActionName, "Thumbstick Y");
-    actionInfo.actionType = XR_ACTION_TYPE_FLOAT_INPUT;
-    checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_inputActions.thumbstickY), "Creating action \"Thumbstick Y\"");
-
-    // Haptics are mostly an annoyance
-    //strcpy_s(actionInfo.actionName, "vibrate_left");
-    //strcpy_s(actionInfo.localizedActionName, "Vibrate Left");
-    //actionInfo.actionType = XR_ACTION_TYPE_VIBRATION_OUTPUT;
-    //checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_hands[0].vibrateAction), "Creating action \"Vibrate Left\"");
-    //
-    //strcpy_s(actionInfo.actionName, "vibrate_right");
-    //strcpy_s(actionInfo.localizedActionName, "Vibrate Right");
-    //actionInfo.actionType = XR_ACTION_TYPE_VIBRATION_OUTPUT;
-    //checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_hands[1].vibrateAction), "Creating action \"Vibrate Right\"");
-
-
-    std::vector<std::pair<XrAction, const char *>> actionPairs{
-        {m_inputActions.pose, "/input/grip/pose"},
-        {m_inputActions.place, "/input/thumbstick/click"},
-        {m_inputActions.expand, "/input/trigger/value"},
-        {m_inputActions.shrink, "/input/squeeze/value"},
-        {m_inputActions.thumbstickX, "/input/thumbstick/x"},
-        {m_inputActions.thumbstickY, "/input/thumbstick/y"},
-        // This button is being hijacked by the SteamVR implementation of the OpenXR runtime: "Invalid input type click for controller"
-        //{m_inputActions.changeType, "/input/menu/click"}
-    };
+    actionInfo.countSubactionPaths = HandInput::HAND_COUNT;
+    actionInfo.subactionPaths = handPaths;
+    for (int action = 0; action < HandInput::ACTION_COUNT; action++) {
+        const HandInput::ActionDefinition &definition = HandInput::ACTIONS[action];
+        strcpy_s(actionInfo.actionName, definition.name);
+        strcpy_s(actionInfo.localizedActionName, definition.localizedName);
+        actionInfo.actionType = definition.type;
+        checkResult(xrCreateAction(m_actionSet, &actionInfo, &m_actions[action]), ("Creating action \"" + std::string(definition.localizedName) + "\"").c_str());
+    }
+
+    // Haptics are mostly an annoyance, they'd be a XR_ACTION_TYPE_VIBRATION_OUTPUT action bound to /output/haptic
 
     std::vector<XrActionSuggestedBinding> actionBindings;
-    actionBindings.reserve(2 * actionPairs.size());
-
-    XrActionSuggestedBinding actionBinding;
-    for (const auto &actionPair : actionPairs) {
-        actionBinding.action = actionPair.first;
-        for (const std::string &side : { "/left", "/right" }) {
-            std::string path = "/user/hand" + side + actionPair.second;
-            checkResult(xrStringToPath(m_instance, path.c_str(), &actionBinding.binding), "String to path: " + path);
-            actionBindings.push_back(actionBinding);
-        }
-    }
-
-    actionBinding.action = m_inputActions.modifierXA;
-    xrStringToPath(m_instance, "/user/hand/left/input/x/click", &actionBinding.binding);
-    actionBindings.push_back(actionBinding);
-    actionBinding.action = m_inputActions.modifierXA;
-    xrStringToPath(m_instance, "/user/hand/right/input/a/click", &actionBinding.binding);
-    actionBindings.push_back(actionBinding);
-
-    actionBinding.action = m_inputActions.modifierYB;
-    xrStringToPath(m_instance, "/user/hand/left/input/y/click", &actionBinding.binding);
-    actionBindings.push_back(actionBinding);
-    actionBinding.action = m_inputActions.modifierYB;
-    xrStringToPath(m_instance, "/user/hand/right/input/b/click", &actionBinding.binding);
-    actionBindings.push_back(actionBinding);
-
-    //actionBinding.action = m_hands[0].vibrateAction;
-    //xrStringToPath(m_instance, "/user/hand/left/output/haptic", &actionBinding.binding);
-    //actionBindings.push_back(actionBinding);
-    //actionBinding.action = m_hands[1].vibrateAction;
-    //xrStringToPath(m_instance, "/user/hand/right/output/haptic", &actionBinding.binding);
-    //actionBindings.push_back(actionBinding);
-
-    XrInteractionProfileSuggestedBinding profileBindings{ XR_TYPE_INTERACTION_PROFILE_SUGGESTED_BINDING };
-    xrStringToPath(m_instance, "/interaction_profiles/hp/mixed_reality_controller", &profileBindings.interactionProfile);
-    profileBindings.countSuggestedBindings = (uint32_t)actionBindings.size();
-    profileBindings.suggestedBindings = actionBindings.data();
-    checkResult(xrSuggestInteractionProfileBindings(m_instance, &profileBindings), "Suggesting interaction bindings");
+    for (int profile = 0; profile < HandInput::PROFILE_COUNT; profile++) {
+        const HandInput::ProfileBindings &profileBindings = HandInput::PROFILES[profile];
+
+        actionBindings.clear();
+        for (int action = 0; action < HandInput::ACTION_COUNT; action++) {
+            for (int handIndex = 0; handIndex < HandInput::HAND_COUNT; handIndex++) {
+                if (!profileBindings.bindings[action][handIndex]) {
+                    continue;
+                }
+
+                XrActionSuggestedBinding actionBinding;
+                actionBinding.action = m_actions[action];
+                const std::string path = std::string(HandInput::HAND_PATHS[handIndex]) + profileBindings.bindings[action][handIndex];
+                checkResult(xrStringToPath(m_instance, path.c_str(), &actionBinding.binding), ("String to path: " + path).c_str());
+                actionBindings.push_back(actionBinding);
+            }
+        }
+
+        XrInteractionProfileSuggestedBinding suggestedBindings{ XR_TYPE_INTERACTION_PROFILE_SUGGESTED_BINDING };
+        checkResult(xrStringToPath(m_instance, profileBindings.interactionProfile, &suggestedBindings.interactionProfile), "String to path: interaction profile");
+        suggestedBindings.countSuggestedBindings = (uint32_t)actionBindings.size();
+        suggestedBindings.suggestedBindings = actionBindings.data();
+        checkResult(xrSuggestInteractionProfileBindings(m_instance, &suggestedBindings), "Suggesting interaction bindings");
+    }
+}
+
+void VRCore::attachActions() {
+    if (m_session == XR_NULL_HANDLE) {
+        throw std::runtime_error("Session not initialized");
+    }
 
     XrSessionActionSetsAttachInfo attachInfo{ XR_TYPE_SESSION_ACTION_SETS_ATTACH_INFO };
     attachInfo.countActionSets = 1;
@@ -744,10 +1504,10 @@ void VRCore::initActions() {
     checkResult(xrAttachSessionActionSets(m_session, &attachInfo), "Attaching action sets to the session");
 
     XrActionSpaceCreateInfo actionSpaceInfo{ XR_TYPE_ACTION_SPACE_CREATE_INFO };
-    actionSpaceInfo.action = m_inputActions.pose;
-    actionSpaceInfo.subactionPath = m_handPaths[0];
+    actionSpaceInfo.action = m_actions[(int)HandInput::Action::POSE];
+    actionSpaceInfo.subactionPath = m_hands[0].path;
     checkResult(xrCreateActionSpace(m_session, &actionSpaceInfo, &m_hands[0].space), "Creating an action space");
-    actionSpaceInfo.subactionPath = m_handPaths[1];
+    actionSpaceInfo.subactionPath = m_hands[1].path;
     checkResult(xrCreateActionSpace(m_session, &actionSpaceInfo, &m_hands[1].space), "Creating an action space");
 }
 
@@ -783,11 +1543,17 @@ void VRCore::initRendering() {
     swapchainInfo.height = view.recommendedImageRectHeight;
     swapchainInfo.faceCount = 1;
     swapchainInfo.mipCount = 1;
-    swapchainInfo.arraySize = 1;
 
-    m_swapchains.resize(VIEW_COUNT);
-    m_images.resize(VIEW_COUNT);
-    for (uint32_t i = 0; i < VIEW_COUNT; i++) {
+    m_isMultiviewEnabled = m_isMultiviewRequested && isMultiviewSupported();
+    spdlog::info("MULTIVIEW: {}", m_isMultiviewEnabled);
+
+    // Single pass stereo renders both views into one array swapchain, otherwise every view gets its own swapchain
+    const uint32_t swapchainCount = m_isMultiviewEnabled ? 1 : VIEW_COUNT;
+    swapchainInfo.arraySize = m_isMultiviewEnabled ? VIEW_COUNT : 1;
+
+    m_swapchains.resize(swapchainCount);
+    m_images.resize(swapchainCount);
+    for (uint32_t i = 0; i < swapchainCount; i++) {
         checkResult(xrCreateSwapchain(m_session, &swapchainInfo, &m_swapchains[i]), "Creating a swapchain");
 
         checkResult(xrEnumerateSwapchainImages(m_swapchains[i], 0, &m_swapchainLength, nullptr), "Acquiring a swapchain length");
@@ -795,83 +1561,106 @@ void VRCore::initRendering() {
 
         checkResult(xrEnumerateSwapchainImages(m_swapchains[i], m_swapchainLength, &m_swapchainLength, reinterpret_cast<XrSwapchainImageBaseHeader *>(m_images[i].data())), "Filling swapchain images");
     }
+
+    initDepth(swapchainInfo, swapchainFormats);
 }
 
-void VRCore::initGL() {
-    m_frameBuffer.resize(m_swapchainLength);
-    glGenFramebuffers(m_swapchainLength, m_frameBuffer.data());
+void VRCore::initDepth(XrSwapchainCreateInfo swapchainInfo, const std::vector<int64_t> &swapchainFormats) {
+    // In order of preference, the runtime lists its formats in its own order of preference which may not contain any depth format at all
+    static const GLenum depthFormats[] = { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32F, GL_DEPTH24_STENCIL8, GL_DEPTH_COMPONENT16 };
 
+    m_depthFormat = 0;
+    for (GLenum depthFormat : depthFormats) {
+        if (std::find(swapchainFormats.begin(), swapchainFormats.end(), (int64_t)depthFormat) != swapchainFormats.end()) {
+            m_depthFormat = depthFormat;
+            break;
+        }
+    }
 
-    m_programId = glCreateProgram();
+    m_depthImages.resize(m_swapchains.size());
+    if (m_depthFormat) {
+        // Depth swapchains mirror the color ones so the runtime can read the depth for reprojection
+        swapchainInfo.usageFlags = XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        swapchainInfo.format = m_depthFormat;
 
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+        m_depthSwapchains.resize(m_swapchains.size());
+        for (size_t i = 0; i < m_depthSwapchains.size(); i++) {
+            checkResult(xrCreateSwapchain(m_session, &swapchainInfo, &m_depthSwapchains[i]), "Creating a depth swapchain");
 
-    static const GLchar *vertexShader = R"(
-        #version 330 core
-        in vec3 position;
-        out vec3 fragmentColor;
-        uniform mat4 u_modelViewProjection;
-        uniform vec3 u_vertexColor;
+            uint32_t depthSwapchainLength;
+            checkResult(xrEnumerateSwapchainImages(m_depthSwapchains[i], 0, &depthSwapchainLength, nullptr), "Acquiring a depth swapchain length");
+            m_depthImages[i].resize(depthSwapchainLength, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR });
 
-        void main() {
-            fragmentColor = u_vertexColor;
-            gl_Position = u_modelViewProjection * vec4(position, 1);
+            checkResult(xrEnumerateSwapchainImages(m_depthSwapchains[i], depthSwapchainLength, &depthSwapchainLength, reinterpret_cast<XrSwapchainImageBaseHeader *>(m_depthImages[i].data())), "Filling depth swapchain images");
         }
-    )";
-
-    static const GLchar *fragmentShader = R"(
-        #version 330 core
-        in vec3 fragmentColor;
-        out vec3 color;
-
-        void main() {
-            color = fragmentColor;
+    }
+    else {
+        // Still depth test against textures of our own, they just can't be handed to the runtime
+        m_depthFormat = GL_DEPTH_COMPONENT24;
+        const GLenum target = m_isMultiviewEnabled ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+
+        for (size_t i = 0; i < m_depthImages.size(); i++) {
+            m_depthImages[i].resize(m_images[i].size(), { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR });
+            for (auto &depthImage : m_depthImages[i]) {
+                glGenTextures(1, &depthImage.image);
+                glBindTexture(target, depthImage.image);
+                if (m_isMultiviewEnabled) {
+                    glTexImage3D(target, 0, m_depthFormat, swapchainInfo.width, swapchainInfo.height, VIEW_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+                }
+                else {
+                    glTexImage2D(target, 0, m_depthFormat, swapchainInfo.width, swapchainInfo.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+                }
+            }
         }
-    )";
+        glBindTexture(target, 0);
+    }
 
-    auto checkShader = [](GLuint shaderId, std::string description) {
-        GLint result;
-        glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
-        if (result == GL_FALSE) {
-            GLint infoLogLength;
-            glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+    m_isDepthSubmitted = m_isDepthLayerSupported && !m_depthSwapchains.empty();
+    spdlog::info("DEPTH SWAPCHAINS: {}, SUBMITTED: {}", !m_depthSwapchains.empty(), m_isDepthSubmitted);
+}
 
-            std::vector<GLchar> infoLog(infoLogLength);
-            glGetShaderInfoLog(shaderId, infoLogLength, nullptr, infoLog.data());
-            throw std::runtime_error(description + "\t" + infoLog.data());
-        }
-    };
+bool VRCore::isMultiviewSupported() const {
+    if (!m_glFramebufferTextureMultiviewOVR || !epoxy_has_gl_extension("GL_OVR_multiview2")) {
+        return false;
+    }
 
-    auto checkProgram = [](GLuint programId, std::string description) {
-        GLint result;
-        glGetProgramiv(programId, GL_LINK_STATUS, &result);
-        if (result == GL_FALSE) {
-            GLint infoLogLength;
-            glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+    GLint maxViews = 0;
+    glGetIntegerv(GL_MAX_VIEWS_OVR, &maxViews);
 
-            std::vector<GLchar> infoLog(infoLogLength);
-            glGetProgramInfoLog(programId, infoLogLength, nullptr, infoLog.data());
+    return maxViews >= VIEW_COUNT;
+}
 
-            throw std::runtime_error(description + "\t" + infoLog.data());
-        }
-    };
+void VRCore::initGL() {
+    m_renderProfiler.initGpuQueries();
 
-    glShaderSource(vertexShaderId, 1, &vertexShader, NULL);
-    glCompileShader(vertexShaderId);
-    checkShader(vertexShaderId, "Checking the vertex shader");
-    glAttachShader(m_programId, vertexShaderId);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
 
-    glShaderSource(fragmentShaderId, 1, &fragmentShader, NULL);
-    glCompileShader(fragmentShaderId);
-    checkShader(fragmentShaderId, "Checking the fragment shader");
-    glAttachShader(m_programId, fragmentShaderId);
 
-    glLinkProgram(m_programId);
-    checkProgram(m_programId, "Checking the program linkage");
+    static const GLchar *vertexShader = R"(
+        #version 330 core
+        in vec3 position;
+        out vec3 fragmentColor;
+        uniform mat4 u_modelViewProjection;
+        uniform vec3 u_vertexColor;
 
-    glDeleteShader(vertexShaderId);
-    glDeleteShader(fragmentShaderId);
+        void main() {
+            fragmentColor = u_vertexColor;
+            gl_Position = u_modelViewProjection * vec4(position, 1);
+        }
+    )";
+
+    static const GLchar *fragmentShader = R"(
+        #version 330 core
+        in vec3 fragmentColor;
+        out vec3 color;
+
+        void main() {
+            color = fragmentColor;
+        }
+    )";
+
+    m_programId = createProgram(vertexShader, fragmentShader);
 
     m_modelViewProjectionUniformId = glGetUniformLocation(m_programId, "u_modelViewProjection");
     m_vertexColorUniformId = glGetUniformLocation(m_programId, "u_vertexColor");
@@ -892,9 +1681,9 @@ void VRCore::initGL() {
 
     // not that many indices so it should be fine
     static const std::vector<GLuint> emptyCubeIndexBufferData = {
-        0, 1, 2, 3,
+        0, 1, 1, 2, 2, 3, 3, 0,
 
-        4, 5, 6, 7,
+        4, 5, 5, 6, 6, 7, 7, 4,
 
         0, 4,
 
@@ -926,74 +1715,644 @@ void VRCore::initGL() {
     };
 
 
+    // Both cube types share the vertices, the meshes go in in the order of CubeType
+    const GLint cubeBaseVertex = m_meshArena.addVertices(cubeVertexBufferData.data(), (GLsizei)cubeVertexBufferData.size() / 3);
+    m_meshArena.addMesh(GL_LINES, emptyCubeIndexBufferData.data(), (GLsizei)emptyCubeIndexBufferData.size(), cubeBaseVertex);
+    m_meshArena.addMesh(GL_TRIANGLES, filledCubeIndexBufferData.data(), (GLsizei)filledCubeIndexBufferData.size(), cubeBaseVertex);
+    if (m_meshArena.getMeshCount() != CUBE_TYPE_COUNT) {
+        throw std::runtime_error("Every cube type needs a mesh");
+    }
+    m_meshArena.upload();
+
     glGenVertexArrays(1, &m_vertexArrayId);
     glBindVertexArray(m_vertexArrayId);
+    m_meshArena.attach(0);
+    glBindVertexArray(0);
 
-    glGenBuffers(1, &m_vertexBufferId);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertexBufferData[0]) * cubeVertexBufferData.size(), &cubeVertexBufferData[0], GL_STATIC_DRAW);
+    initInstancing();
+    initGpuCulling();
 
-    glGenBuffers(1, &m_emptyCubeIndexBufferId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_emptyCubeIndexBufferId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(emptyCubeIndexBufferData[0]) * emptyCubeIndexBufferData.size(), &emptyCubeIndexBufferData[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (m_isMultiviewEnabled) {
+        initMultiview();
+    }
 
-    glGenBuffers(1, &m_filledCubeIndexBufferId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_filledCubeIndexBufferId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(filledCubeIndexBufferData[0]) * filledCubeIndexBufferData.size(), &filledCubeIndexBufferData[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    initLateLatching();
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid *)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(m_programId);
+}
 
-    glBindVertexArray(0);
+void VRCore::initFrameBuffers() {
+    // Every swapchain image gets its own framebuffer with the attachments set once, rendering then only binds it
+    m_frameBuffers.resize(m_swapchains.size());
+    m_frameBufferDepthIndices.resize(m_swapchains.size());
+    for (size_t i = 0; i < m_swapchains.size(); i++) {
+        m_frameBuffers[i].resize(m_images[i].size());
+        m_frameBufferDepthIndices[i].resize(m_images[i].size());
+        glGenFramebuffers((GLsizei)m_frameBuffers[i].size(), m_frameBuffers[i].data());
+
+        for (size_t j = 0; j < m_images[i].size(); j++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffers[i][j]);
+            attachImage(GL_COLOR_ATTACHMENT0, m_images[i][j].image);
+            // Swapchains acquired in lockstep hand out the same index, render() fixes it up if not
+            m_frameBufferDepthIndices[i][j] = (uint32_t)(j % m_depthImages[i].size());
+            attachImage(getDepthAttachment(), m_depthImages[i][m_frameBufferDepthIndices[i][j]].image);
+
+            const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            if (status != GL_FRAMEBUFFER_COMPLETE) {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                throw std::runtime_error("Incomplete framebuffer\t" + std::to_string(status));
+            }
+        }
+    }
 
-    glUseProgram(m_programId);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-XrResult VRCore::checkResult(const XrResult result, const std::string description) const {
-    if (result != XR_SUCCESS) {
-        if (m_instance != nullptr) {
-            char resultBuffer[XR_MAX_RESULT_STRING_SIZE];
-            xrResultToString(m_instance, result, resultBuffer);
-            throw std::runtime_error(description + "\t" + resultBuffer);
+void VRCore::attachImage(GLenum attachment, GLuint image) {
+    if (m_isMultiviewEnabled) {
+        m_glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, attachment, image, 0, 0, VIEW_COUNT);
+    }
+    else {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, image, 0);
+    }
+}
+
+GLenum VRCore::getDepthAttachment() const {
+    return m_depthFormat == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+}
+
+void VRCore::initInstancing() {
+    static const GLchar *vertexShader = R"(
+        #version 330 core
+        layout(location = 0) in vec3 position;
+        layout(location = 1) in mat4 modelTransformation;
+        layout(location = 5) in vec3 vertexColor;
+        out vec3 fragmentColor;
+        uniform mat4 u_viewProjection;
+
+        void main() {
+            fragmentColor = vertexColor;
+            gl_Position = u_viewProjection * modelTransformation * vec4(position, 1);
         }
-        else {
-            throw std::runtime_error(description);
+    )";
+
+    static const GLchar *fragmentShader = R"(
+        #version 330 core
+        in vec3 fragmentColor;
+        out vec3 color;
+
+        void main() {
+            color = fragmentColor;
+        }
+    )";
+
+    m_instancedProgramId = createProgram(vertexShader, fragmentShader);
+    m_viewProjectionUniformId = glGetUniformLocation(m_instancedProgramId, "u_viewProjection");
+
+    m_cubeInstances.resize(CUBE_TYPE_COUNT);
+    for (int type = 0; type < CUBE_TYPE_COUNT; type++) {
+        CubeInstances &instances = m_cubeInstances[type];
+
+        glGenVertexArrays(1, &instances.vertexArrayId);
+        glBindVertexArray(instances.vertexArrayId);
+
+        m_meshArena.attach(0);
+
+        for (GLuint location = 1; location <= 5; location++) {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        // Culled instances are streamed every frame and point the attributes into the stream buffer instead
+        glGenBuffers(1, &instances.transformationBufferId);
+        glGenBuffers(1, &instances.colorBufferId);
+        setCubeInstanceAttributes(instances, instances.transformationBufferId, 0, sizeof(XrMatrix4x4f), instances.colorBufferId, 0, sizeof(XrColor4f));
+    }
+
+    m_instanceStreamBuffer.init(GL_ARRAY_BUFFER, sizeof(CubeInstance) * INITIAL_STREAMED_INSTANCE_COUNT, m_swapchainLength);
+    spdlog::info("PERSISTENT STREAM BUFFER: {}", m_instanceStreamBuffer.isPersistent());
+}
+
+void VRCore::initGpuCulling() {
+    m_isGpuCullingEnabled = m_isGpuCullingEnabled && m_isInstancingEnabled && m_isCullingEnabled && epoxy_gl_version() >= 43;
+    spdlog::info("GPU CULLING: {}", m_isGpuCullingEnabled);
+    if (!m_isGpuCullingEnabled) {
+        return;
+    }
+
+    // Every workgroup gathers its visible cubes first so that only one invocation per group touches the global count.
+    // The bounding sphere is the one of VRCore::getCubeRadius, the scaled axes are the first three columns
+    static const GLchar *computeShader = R"(
+        #version 430 core
+        layout(local_size_x = 64) in;
+
+        struct DrawElementsIndirectCommand {
+            uint count;
+            uint instanceCount;
+            uint firstIndex;
+            int baseVertex;
+            uint baseInstance;
+        };
+
+        struct Instance {
+            mat4 transformation;
+            vec4 color;
+        };
+
+        layout(std430, binding = 0) readonly buffer Transformations {
+            mat4 transformations[];
+        };
+        layout(std430, binding = 1) readonly buffer Colors {
+            vec4 colors[];
+        };
+        layout(std430, binding = 2) writeonly buffer VisibleInstances {
+            Instance visibleInstances[];
+        };
+        layout(std430, binding = 3) buffer Commands {
+            DrawElementsIndirectCommand commands[];
+        };
+
+        uniform vec4 u_planes[12];
+        uniform uint u_count;
+        uniform uint u_commandIndex;
+        uniform uint u_firstInstance;
+
+        shared uint s_visibleCount;
+        shared uint s_firstVisible;
+
+        bool isInside(vec3 center, float radius, int firstPlane) {
+            for (int i = firstPlane; i < firstPlane + 6; i++) {
+                if (dot(u_planes[i].xyz, center) + u_planes[i].w < -radius) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void main() {
+            if (gl_LocalInvocationIndex == 0) {
+                s_visibleCount = 0;
+            }
+            barrier();
+
+            const uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+            bool isVisible = false;
+            mat4 transformation;
+            if (index < u_count) {
+                transformation = transformations[index];
+                const vec3 center = transformation[3].xyz;
+                const float radius = 0.1 * sqrt(dot(transformation[0].xyz, transformation[0].xyz) + dot(transformation[1].xyz, transformation[1].xyz) + dot(transformation[2].xyz, transformation[2].xyz));
+                isVisible = isInside(center, radius, 0) || isInside(center, radius, 6);
+            }
+
+            uint slot = 0;
+            if (isVisible) {
+                slot = atomicAdd(s_visibleCount, 1u);
+            }
+            barrier();
+
+            if (gl_LocalInvocationIndex == 0) {
+                s_firstVisible = atomicAdd(commands[u_commandIndex].instanceCount, s_visibleCount);
+            }
+            barrier();
+
+            if (isVisible) {
+                visibleInstances[u_firstInstance + s_firstVisible + slot] = Instance(transformation, colors[index]);
+            }
+        }
+    )";
+
+    static_assert(sizeof(CubeInstance) == sizeof(XrMatrix4x4f) + sizeof(XrColor4f), "Laid out like the std430 Instance");
+    static_assert(GPU_CULLING_GROUP_SIZE == 64, "The shader's local size");
+
+    m_cullingProgramId = createComputeProgram(computeShader);
+    m_cullingPlanesUniformId = glGetUniformLocation(m_cullingProgramId, "u_planes");
+    m_cullingCountUniformId = glGetUniformLocation(m_cullingProgramId, "u_count");
+    m_cullingCommandIndexUniformId = glGetUniformLocation(m_cullingProgramId, "u_commandIndex");
+    m_cullingFirstInstanceUniformId = glGetUniformLocation(m_cullingProgramId, "u_firstInstance");
+
+    // Sized once the first cubes are uploaded
+    glGenBuffers(1, &m_visibleInstanceBufferId);
+
+    glGenBuffers(1, &m_drawCommandBufferId);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawCommandBufferId);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * CUBE_TYPE_COUNT, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void VRCore::initMultiview() {
+    static const GLchar *vertexShader = R"(
+        #version 330 core
+        #extension GL_OVR_multiview2 : require
+        layout(num_views = 2) in;
+        layout(location = 0) in vec3 position;
+        out vec3 fragmentColor;
+        uniform mat4 u_viewProjection[2];
+        uniform mat4 u_modelTransformation;
+        uniform vec3 u_vertexColor;
+
+        void main() {
+            fragmentColor = u_vertexColor;
+            gl_Position = u_viewProjection[gl_ViewID_OVR] * u_modelTransformation * vec4(position, 1);
+        }
+    )";
+
+    static const GLchar *instancedVertexShader = R"(
+        #version 330 core
+        #extension GL_OVR_multiview2 : require
+        layout(num_views = 2) in;
+        layout(location = 0) in vec3 position;
+        layout(location = 1) in mat4 modelTransformation;
+        layout(location = 5) in vec3 vertexColor;
+        out vec3 fragmentColor;
+        uniform mat4 u_viewProjection[2];
+
+        void main() {
+            fragmentColor = vertexColor;
+            gl_Position = u_viewProjection[gl_ViewID_OVR] * modelTransformation * vec4(position, 1);
+        }
+    )";
+
+    static const GLchar *fragmentShader = R"(
+        #version 330 core
+        in vec3 fragmentColor;
+        out vec3 color;
+
+        void main() {
+            color = fragmentColor;
+        }
+    )";
+
+    m_multiviewProgramId = createProgram(vertexShader, fragmentShader);
+    m_multiviewViewProjectionUniformId = glGetUniformLocation(m_multiviewProgramId, "u_viewProjection");
+    m_multiviewModelTransformationUniformId = glGetUniformLocation(m_multiviewProgramId, "u_modelTransformation");
+    m_multiviewVertexColorUniformId = glGetUniformLocation(m_multiviewProgramId, "u_vertexColor");
+
+    m_instancedMultiviewProgramId = createProgram(instancedVertexShader, fragmentShader);
+    m_instancedMultiviewViewProjectionUniformId = glGetUniformLocation(m_instancedMultiviewProgramId, "u_viewProjection");
+}
+
+void VRCore::initLateLatching() {
+    static const GLchar *vertexShader = R"(
+        #version 330 core
+        layout(location = 0) in vec3 position;
+        out vec3 fragmentColor;
+        layout(std140) uniform HandTransformations {
+            mat4 u_handTransformations[4];
+            int u_latestOffset;
+        };
+        uniform mat4 u_viewProjection;
+        uniform int u_handIndex;
+        uniform vec3 u_vertexColor;
+
+        void main() {
+            fragmentColor = u_vertexColor;
+            gl_Position = u_viewProjection * u_handTransformations[u_latestOffset + u_handIndex] * vec4(position, 1);
+        }
+    )";
+
+    static const GLchar *multiviewVertexShader = R"(
+        #version 330 core
+        #extension GL_OVR_multiview2 : require
+        layout(num_views = 2) in;
+        layout(location = 0) in vec3 position;
+        out vec3 fragmentColor;
+        layout(std140) uniform HandTransformations {
+            mat4 u_handTransformations[4];
+            int u_latestOffset;
+        };
+        uniform mat4 u_viewProjection[2];
+        uniform int u_handIndex;
+        uniform vec3 u_vertexColor;
+
+        void main() {
+            fragmentColor = u_vertexColor;
+            gl_Position = u_viewProjection[gl_ViewID_OVR] * u_handTransformations[u_latestOffset + u_handIndex] * vec4(position, 1);
+        }
+    )";
+
+    static const GLchar *fragmentShader = R"(
+        #version 330 core
+        in vec3 fragmentColor;
+        out vec3 color;
+
+        void main() {
+            color = fragmentColor;
         }
+    )";
+
+    static_assert(sizeof(HandTransformations) == 2 * HandInput::HAND_COUNT * sizeof(XrMatrix4x4f) + 4 * sizeof(int32_t), "Laid out like the std140 block");
+
+    m_handProgram.programId = createProgram(m_isMultiviewEnabled ? multiviewVertexShader : vertexShader, fragmentShader);
+    m_handProgram.viewProjectionUniformId = glGetUniformLocation(m_handProgram.programId, "u_viewProjection");
+    m_handProgram.handIndexUniformId = glGetUniformLocation(m_handProgram.programId, "u_handIndex");
+    m_handProgram.vertexColorUniformId = glGetUniformLocation(m_handProgram.programId, "u_vertexColor");
+    glUniformBlockBinding(m_handProgram.programId, glGetUniformBlockIndex(m_handProgram.programId, "HandTransformations"), HAND_TRANSFORMATIONS_BINDING);
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_uniformBufferAlignment);
+    m_handTransformationBuffer.init(GL_UNIFORM_BUFFER, std::max<GLsizeiptr>(sizeof(HandTransformations), m_uniformBufferAlignment), m_swapchainLength);
+
+    // Patching draws that are already recorded needs the mapping the GPU reads from
+    m_isLateLatchingEnabled = m_handTransformationBuffer.isPersistent();
+    spdlog::info("LATE LATCHING: {}", m_isLateLatchingEnabled);
+}
+
+GLuint VRCore::createProgram(const GLchar *vertexShader, const GLchar *fragmentShader) const {
+    GLuint programId = glCreateProgram();
+
+    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vertexShaderId, 1, &vertexShader, NULL);
+    glCompileShader(vertexShaderId);
+    checkShader(vertexShaderId, "Checking the vertex shader");
+    glAttachShader(programId, vertexShaderId);
+
+    glShaderSource(fragmentShaderId, 1, &fragmentShader, NULL);
+    glCompileShader(fragmentShaderId);
+    checkShader(fragmentShaderId, "Checking the fragment shader");
+    glAttachShader(programId, fragmentShaderId);
+
+    glLinkProgram(programId);
+    checkProgram(programId, "Checking the program linkage");
+
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
+
+    return programId;
+}
+
+GLuint VRCore::createComputeProgram(const GLchar *computeShader) const {
+    GLuint programId = glCreateProgram();
+
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &computeShader, NULL);
+    glCompileShader(computeShaderId);
+    checkShader(computeShaderId, "Checking the compute shader");
+    glAttachShader(programId, computeShaderId);
+
+    glLinkProgram(programId);
+    checkProgram(programId, "Checking the compute program linkage");
+
+    glDeleteShader(computeShaderId);
+
+    return programId;
+}
+
+XrResult VRCore::handleResult(XrResult result, const char *description, const std::source_location &location) const {
+    if (XR_SUCCEEDED(result)) {
+        std::lock_guard<std::mutex> lock(m_resultSitesMutex);
+        for (int i = 0; i < m_resultSiteCount; i++) {
+            ResultSite &site = m_resultSites[i];
+            if (site.line == location.line() && site.result == result && strcmp(site.file, location.file_name()) == 0) {
+                site.count++;
+                return result;
+            }
+        }
+        if (m_resultSiteCount < MAX_RESULT_SITES) {
+            m_resultSites[m_resultSiteCount++] = { location.file_name(), (uint32_t)location.line(), result, 1 };
+        }
+
+        return result;
     }
 
-    return result;
+    // Building the error allocates, which is fine at this point
+    AllocationAudit::end();
+
+    const std::string site = std::string(getFileName(location.file_name())) + ":" + std::to_string(location.line());
+    if (m_instance != nullptr) {
+        char resultBuffer[XR_MAX_RESULT_STRING_SIZE];
+        xrResultToString(m_instance, result, resultBuffer);
+        throw XrError(std::string(description) + "\t" + resultBuffer + "\t" + site, result);
+    }
+    else {
+        throw XrError(std::string(description) + "\t" + std::to_string(result) + "\t" + site, result);
+    }
+}
+
+void VRCore::logResultStatistics() const {
+    std::lock_guard<std::mutex> lock(m_resultSitesMutex);
+    for (int i = 0; i < m_resultSiteCount; i++) {
+        const ResultSite &site = m_resultSites[i];
+        char resultBuffer[XR_MAX_RESULT_STRING_SIZE];
+        if (m_instance == XR_NULL_HANDLE || xrResultToString(m_instance, site.result, resultBuffer) != XR_SUCCESS) {
+            snprintf(resultBuffer, sizeof(resultBuffer), "%d", site.result);
+        }
+        DeferredLog::info("XR RESULT: {} {} times at {}:{}", resultBuffer, site.count, getFileName(site.file), site.line);
+    }
 }
 
 VRCore::~VRCore() {
-    glDeleteBuffers(1, &m_vertexBufferId);
-    glDeleteBuffers(1, &m_emptyCubeIndexBufferId);
-    glDeleteBuffers(1, &m_filledCubeIndexBufferId);
-    glDeleteVertexArrays(1, &m_vertexArrayId);
-    glDeleteProgram(m_programId);
+    destroy();
+}
+
+void VRCore::destroy() {
+    // GL objects only exist once there's a context
+    if (m_context) {
+        for (auto &instances : m_cubeInstances) {
+            glDeleteBuffers(1, &instances.transformationBufferId);
+            glDeleteBuffers(1, &instances.colorBufferId);
+            glDeleteVertexArrays(1, &instances.vertexArrayId);
+        }
+        m_instanceStreamBuffer.destroy();
+        glDeleteBuffers(1, &m_visibleInstanceBufferId);
+        glDeleteBuffers(1, &m_drawCommandBufferId);
+        m_handTransformationBuffer.destroy();
+        m_renderProfiler.destroyGpuQueries();
+
+        glDeleteProgram(m_instancedProgramId);
+        glDeleteProgram(m_cullingProgramId);
+        glDeleteProgram(m_multiviewProgramId);
+        glDeleteProgram(m_instancedMultiviewProgramId);
+        glDeleteProgram(m_handProgram.programId);
+
+        m_meshArena.destroy();
+        glDeleteVertexArrays(1, &m_vertexArrayId);
+        glDeleteProgram(m_programId);
+    }
+
+    destroyInstanceObjects();
+
+    destroyContext();
+}
+
+VRCore::RecoveryLevel VRCore::getRecoveryLevel(XrResult result) {
+    switch (result) {
+        case XR_ERROR_SESSION_LOST: {
+            return RecoveryLevel::SESSION;
+        }
+        case XR_ERROR_INSTANCE_LOST: {
+            return RecoveryLevel::INSTANCE;
+        }
+        default: {
+            return RecoveryLevel::NONE;
+        }
+    }
+}
+
+void VRCore::recover(RecoveryLevel level) {
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::milliseconds delay = INITIAL_RECOVERY_DELAY;
+
+    for (int attempt = 1;; attempt++) {
+        const char *levelName = level == RecoveryLevel::INSTANCE ? "instance" : "session";
+        spdlog::warn("RECOVERY: recreating the {}, attempt {}", levelName, attempt);
+
+        try {
+            if (level == RecoveryLevel::INSTANCE) {
+                destroyInstanceObjects();
+                createInstance();
+                initSystem();
+                initActions();
+            }
+            else {
+                destroySessionObjects();
+            }
+            initSessionObjects();
+
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+            spdlog::info("RECOVERY: {} recreated in {:.1f} ms after {} attempts", levelName, duration.count(), attempt);
+            return;
+        }
+        catch (const XrError &error) {
+            if (attempt >= MAX_RECOVERY_ATTEMPTS) {
+                throw;
+            }
+            spdlog::error("RECOVERY: {}", error.what());
+
+            // Anything but a lost session, e.g. the system not being available yet, is retried from the instance up
+            if (getRecoveryLevel(error.getResult()) != RecoveryLevel::SESSION) {
+                level = RecoveryLevel::INSTANCE;
+            }
+        }
+
+        std::this_thread::sleep_for(delay);
+        delay = std::min(2 * delay, MAX_RECOVERY_DELAY);
+    }
+}
+
+void VRCore::startRenderThread() {
+    // A fresh one, a closed pipeline stays closed
+    m_framePipeline = std::make_unique<FramePipeline<FramePacket>>(m_pipelineDepth);
+    m_renderError = nullptr;
 
+    releaseContext();
+    m_renderThread = std::thread(&VRCore::runRenderThread, this);
+}
+
+std::exception_ptr VRCore::stopRenderThread() {
+    // The render thread still ends the frames already waited on
+    m_framePipeline->close();
+    m_renderThread.join();
+    bindContext();
+
+    return m_renderError;
+}
+
+void VRCore::runRenderThread() {
+    try {
+        bindContext();
+
+        while (const FramePacket *packet = m_framePipeline->beginRead()) {
+            submitFrame(*packet);
+            const uint64_t frameIndex = packet->frameIndex;
+            m_framePipeline->endRead();
+
+            m_renderProfiler.endFrame();
+            if (frameIndex % STATISTICS_LOG_INTERVAL == 0) {
+                m_renderProfiler.log();
+            }
+        }
+    }
+    catch (...) {
+        m_renderError = std::current_exception();
+        // Unblocks the simulation, a runtime that lost the session fails its xrWaitFrame as well
+        m_framePipeline->close();
+    }
+
+    releaseContext();
+}
+
+void VRCore::initSessionObjects() {
+    initSession();
+    initReferenceSpace();
+    attachActions();
+    initRendering();
+    initFrameBuffers();
+}
+
+void VRCore::destroySessionObjects() {
+    for (std::vector<GLuint> &frameBuffers : m_frameBuffers) {
+        glDeleteFramebuffers((GLsizei)frameBuffers.size(), frameBuffers.data());
+    }
+    m_frameBuffers.clear();
+    m_frameBufferDepthIndices.clear();
+
+    if (m_depthSwapchains.empty()) {
+        for (auto &depthImages : m_depthImages) {
+            for (auto &depthImage : depthImages) {
+                glDeleteTextures(1, &depthImage.image);
+            }
+        }
+    }
+    m_depthImages.clear();
+
+    // Creating them may have failed halfway
     for (auto &swapchain : m_swapchains) {
-        xrDestroySwapchain(swapchain);
+        if (swapchain != XR_NULL_HANDLE) {
+            xrDestroySwapchain(swapchain);
+        }
+    }
+    m_swapchains.clear();
+    m_images.clear();
+    for (auto &swapchain : m_depthSwapchains) {
+        if (swapchain != XR_NULL_HANDLE) {
+            xrDestroySwapchain(swapchain);
+        }
     }
+    m_depthSwapchains.clear();
 
-    if (m_actionSet != XR_NULL_HANDLE) {
-        for (auto &hand : m_hands) {
+    for (auto &hand : m_hands) {
+        if (hand.space != XR_NULL_HANDLE) {
             xrDestroySpace(hand.space);
+            hand.space = XR_NULL_HANDLE;
         }
-        xrDestroyActionSet(m_actionSet);
+        hand.pickedCube = BoundingVolumeHierarchy::NO_ITEM;
+        hand.location = { XR_TYPE_SPACE_LOCATION };
     }
 
     if (m_space != XR_NULL_HANDLE) {
         xrDestroySpace(m_space);
+        m_space = XR_NULL_HANDLE;
     }
 
     if (m_session != XR_NULL_HANDLE) {
         xrDestroySession(m_session);
+        m_session = XR_NULL_HANDLE;
+    }
+
+    m_isSessionRunning = false;
+    m_isSessionFocused = false;
+    // The exit went to the lost session, the next one has to be asked again
+    m_isExitRequested = false;
+    m_predictedDisplayTime = 0;
+}
+
+void VRCore::destroyInstanceObjects() {
+    destroySessionObjects();
+
+    if (m_actionSet != XR_NULL_HANDLE) {
+        xrDestroyActionSet(m_actionSet);
+        m_actionSet = XR_NULL_HANDLE;
     }
 
     if (m_instance != XR_NULL_HANDLE) {
         xrDestroyInstance(m_instance);
+        m_instance = XR_NULL_HANDLE;
     }
+    m_systemId = XR_NULL_SYSTEM_ID;
 }
@@ -1,53 +1,159 @@
 #ifndef VR_VRCORE_H
 #define VR_VRCORE_H
 
+// OPENXRTEST_EGL selects a surfaceless EGL context (XR_MNDX_egl_enable) instead of a hidden SDL window (WGL),
+// set by the CMake build for headless Linux machines
+#if defined(OPENXRTEST_EGL)
+// needs to be included before openxr
+#include <epoxy/egl.h>
+#include <epoxy/gl.h>
+#else
 // needs to be included before openxr
 #include <epoxy/wgl.h>
 
 #define XR_USE_PLATFORM_WIN32
+#endif
 #define XR_USE_GRAPHICS_API_OPENGL
 
 #include <openxr/openxr.h>
 #include <openxr/openxr_platform.h>
 
+#if defined(OPENXRTEST_EGL)
+#include "vr/EGLGraphicsBinding.h"
+#else
 #define SDL_MAIN_HANDLED
 
 #include <SDL.h>
+#endif
+
+#include "debug/FrameProfiler.h"
+#include "gl/MeshArena.h"
+#include "gl/StreamBuffer.h"
+#include "vr/BoundingVolumeHierarchy.h"
+#include "vr/FramePipeline.h"
+#include "vr/FrustumCuller.h"
+#include "vr/HandInput.h"
+#include "vr/JobSystem.h"
+#include "vr/SceneFile.h"
+#include "vr/TransformCache.h"
+#include "vr/XrError.h"
+#include "vr/XrMatrix4x4f.h"
 
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <source_location>
+#include <thread>
 #include <vector>
 #include <string>
 
 
 class VRCore {
 public:
-    VRCore();
+    // The ways of drawing the cubes, switchable from the command line to compare them on the same scene. GPU culling
+    // needs the other two and OpenGL 4.3, it falls back to culling on the CPU without them
+    typedef struct RenderOptions {
+        bool isInstancingEnabled = true;
+        bool isCullingEnabled = true;
+        bool isGpuCullingEnabled = true;
+        bool isHierarchicalCullingEnabled = false;
+    };
+
+    // Loads the cubes saved in the scene file and keeps saving them there, nothing is saved if the path is empty
+    VRCore(const std::string &scenePath, const RenderOptions &options);
     ~VRCore();
     bool initVR();
-    void runVR();
+    // Runs until the session exits, or for frameLimit frames first when it isn't 0. With a pipeline depth the frames are
+    // submitted from a render thread, up to that many frames behind the simulation on this thread
+    void runVR(uint64_t frameLimit = 0, uint32_t pipelineDepth = 0);
 
 private:
-    XrInstance m_instance;
-    XrSession m_session;
-    bool m_isSessionRunning;
-    bool m_isSessionFocused;
-    uint64_t m_systemId;
-    XrSpace m_space;
+    XrInstance m_instance = XR_NULL_HANDLE;
+    XrSession m_session = XR_NULL_HANDLE;
+    bool m_isSessionRunning = false;
+    bool m_isSessionFocused = false;
+    bool m_isExitRequested = false;
+    bool m_hasExited = false;
+    uint64_t m_systemId = XR_NULL_SYSTEM_ID;
+    XrSpace m_space = XR_NULL_HANDLE;
 
     void createInstance();
-    std::vector<const char *> getExtensions() const;
+    std::vector<const char *> getExtensions();
     void initSystem();
     void initSession();
     void initReferenceSpace();
+    void pollEvents();
     void handleStateChange(XrEventDataBuffer event);
-    XrResult checkResult(const XrResult, const std::string) const;
+    // Throws an XrError for failures and hands back success codes like XR_FRAME_DISCARDED or XR_SESSION_LOSS_PENDING for
+    // the caller to deal with. XR_SUCCESS is the only result that doesn't leave the caller
+    XrResult checkResult(XrResult result, const char *description, const std::source_location location = std::source_location::current()) const {
+        if (result == XR_SUCCESS) [[likely]] {
+            return result;
+        }
+        return handleResult(result, description, location);
+    }
+    OPENXRTEST_COLD XrResult handleResult(XrResult result, const char *description, const std::source_location &location) const;
+    void logResultStatistics() const;
+    // Tears everything down, safe to call on a partially constructed VRCore
+    void destroy();
+
+
+    // Recovery, losing the session only costs the session and what hangs off it, losing the instance everything
+    // OpenXR. The context, the GL objects and the scene are kept either way
+    enum class RecoveryLevel {
+        NONE,
+        SESSION,
+        INSTANCE
+    };
 
+    static constexpr std::chrono::milliseconds INITIAL_RECOVERY_DELAY{ 100 };
+    static constexpr std::chrono::milliseconds MAX_RECOVERY_DELAY{ 5000 };
+    static const int MAX_RECOVERY_ATTEMPTS = 10;
 
-    // SDL stuff
-    void createWindow();
+    static RecoveryLevel getRecoveryLevel(XrResult result);
+    void recover(RecoveryLevel level);
+    // Session, reference space, action spaces, swapchains and the framebuffers on their images
+    void initSessionObjects();
+    void destroySessionObjects();
+    void destroyInstanceObjects();
+
+
+    // Context
+#if defined(OPENXRTEST_EGL)
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLConfig m_config = nullptr;
+    EGLContext m_context = EGL_NO_CONTEXT;
+#else
+    SDL_Window *m_window = nullptr;
+    SDL_GLContext m_context = nullptr;
+#endif
+
+    void createContext();
+    void destroyContext();
 
 
     // Rendering
     static const short VIEW_COUNT = 2;
+    static constexpr float NEAR_Z = 0.1f;
+    static constexpr float FAR_Z = 100.f;
+    static const int STATISTICS_LOG_INTERVAL = 900;
+
+    // How often each checkResult call site got something other than XR_SUCCESS. Fixed size since it's counted from
+    // within audited scopes
+    typedef struct ResultSite {
+        const char *file;
+        uint32_t line;
+        XrResult result;
+        uint64_t count;
+    };
+
+    static const int MAX_RESULT_SITES = 64;
+
+    mutable ResultSite m_resultSites[MAX_RESULT_SITES];
+    mutable int m_resultSiteCount = 0;
+    // Both threads of the frame loop count, it's only taken off the XR_SUCCESS path
+    mutable std::mutex m_resultSitesMutex;
     std::vector<XrView> m_views;
     XrViewConfigurationType m_viewConfigurationType{ XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO };
     std::vector<XrViewConfigurationView> m_configViews;
@@ -55,25 +161,67 @@ private:
     std::vector<std::vector<XrSwapchainImageOpenGLKHR>> m_images;
     std::vector<XrSwapchain> m_swapchains;
     uint32_t m_swapchainLength;
+    uint64_t m_frameIndex = 0;
+    // Of the last frame, for locating things outside of it
+    XrTime m_predictedDisplayTime = 0;
+    // The simulation's, events to xrWaitFrame and culling
+    FrameProfiler m_profiler;
+    // xrBeginFrame to xrEndFrame and the GPU passes
+    FrameProfiler m_renderProfiler;
+
+    // Depth, handed to the runtime for reprojection when XR_KHR_composition_layer_depth is there
+    bool m_isDepthLayerSupported = false;
+    bool m_isDepthSubmitted = false;
+    GLenum m_depthFormat = 0;
+    std::vector<XrSwapchain> m_depthSwapchains;
+    // Mirrors m_images, textures of our own if the runtime has no depth swapchain format
+    std::vector<std::vector<XrSwapchainImageOpenGLKHR>> m_depthImages;
 
     void initRendering();
+    void initDepth(XrSwapchainCreateInfo swapchainInfo, const std::vector<int64_t> &swapchainFormats);
+    // One frame of the serial loop, prepared and submitted on this thread
     void render();
 
 
+    // Single pass stereo
+    typedef void (APIENTRYP PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint baseViewIndex, GLsizei numViews);
+
+    bool m_isMultiviewRequested = true;
+    bool m_isMultiviewEnabled = false;
+    PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC m_glFramebufferTextureMultiviewOVR = nullptr;
+    GLuint m_multiviewProgramId = 0;
+    GLuint m_multiviewViewProjectionUniformId;
+    GLuint m_multiviewModelTransformationUniformId;
+    GLuint m_multiviewVertexColorUniformId;
+    GLuint m_instancedMultiviewProgramId = 0;
+    GLuint m_instancedMultiviewViewProjectionUniformId;
+
+    bool isMultiviewSupported() const;
+    void initMultiview();
+
+
     // GL stuff TODO move this out
     GLuint m_programId;
+    // Has the mesh arena attached, bound once for every uninstanced draw of a view
     GLuint m_vertexArrayId;
-    GLuint m_vertexBufferId;
-    GLuint m_emptyCubeIndexBufferId;
-    GLuint m_filledCubeIndexBufferId;
+    MeshArena m_meshArena;
     GLuint m_modelViewProjectionUniformId;
     GLuint m_vertexColorUniformId;
-    std::vector<GLuint> m_frameBuffer;
+    // One per image of every swapchain, so per eye unless multiview is used
+    std::vector<std::vector<GLuint>> m_frameBuffers;
+    // The depth image currently attached to each framebuffer
+    std::vector<std::vector<uint32_t>> m_frameBufferDepthIndices;
 
     void initGL();
+    void initFrameBuffers();
+    void attachImage(GLenum attachment, GLuint image);
+    GLenum getDepthAttachment() const;
+    GLuint createProgram(const GLchar *vertexShader, const GLchar *fragmentShader) const;
+    GLuint createComputeProgram(const GLchar *computeShader) const;
 
 
     // Cube stuff TODO move this out
+    // Doubles as the id of the type's mesh in m_meshArena, a new primitive is a new type with its mesh added in order
     enum class CubeType {
         EMPTY,
         FILLED
@@ -88,41 +236,221 @@ private:
     };
 
     std::vector<Cube> m_cubes;
+    TransformCache m_transformCache{ CUBE_TYPE_COUNT };
+    // Loading the scene, culling and writing the instances spread over every core. Jobs are only scheduled on the
+    // thread that created the VRCore, the render thread never touches them
+    JobSystem m_jobSystem;
 
+    void addCube(const Cube &cube);
+    // The last cube takes the removed one's index
+    void removeCube(uint32_t index);
+    static XrVector3f getCubeHalfExtents(const Cube &cube);
+    static float getCubeRadius(const Cube &cube);
+    // Needs m_vertexArrayId bound
     void drawCube(CubeType type);
+    void setCubeUniforms(const XrMatrix4x4f *viewProjections, const XrMatrix4x4f &modelTransformation, const GLfloat *color);
+
+    // Every change to m_cubes is saved right away, a VRCore created after an error picks the scene up from there
+    SceneFile m_sceneFile;
+
+    void loadScene(const std::string &path);
+    void saveRecord(const SceneFile::Record &record);
+
+
+    // Instancing
+    static const short CUBE_TYPE_COUNT = 2;
+
+    // Per-instance attributes of every placed cube of one type, drawn with a single instanced call
+    typedef struct CubeInstances {
+        GLuint vertexArrayId = 0;
+        GLuint transformationBufferId = 0;
+        GLuint colorBufferId = 0;
+        GLsizei capacity = 0;
+        GLsizei uploadedCount = 0;
+    };
+
+    // Interleaved per-instance attributes of a visible cube as written into the stream buffer
+    typedef TransformCache::Instance CubeInstance;
+
+    bool m_isInstancingEnabled;
+    GLuint m_instancedProgramId = 0;
+    GLuint m_viewProjectionUniformId;
+    std::vector<CubeInstances> m_cubeInstances;
+
+    // The visible cubes change every frame, they're written straight into GPU memory one region per frame in flight
+    static const short INITIAL_STREAMED_INSTANCE_COUNT = 1024;
+    StreamBuffer m_instanceStreamBuffer;
+
+    void initInstancing();
+    void updateCubeInstances();
+    void setCubeInstanceAttributes(CubeInstances &instances, GLuint transformationBufferId, GLintptr transformationOffset, GLsizei transformationStride, GLuint colorBufferId, GLintptr colorOffset, GLsizei colorStride);
+    void uploadCubeInstances(CubeInstances &instances, const XrMatrix4x4f *transformations, const XrColor4f *colors, GLsizei count);
+    void drawCubesInstanced(const XrMatrix4x4f *viewProjections);
+
+
+    // GPU culling, the cubes stay in the buffers the unculled instances are drawn from and a compute shader tests them
+    // against both eyes' frusta. It compacts the visible ones per type and counts them straight into the indirect draw
+    // commands, the CPU never touches a cube that didn't change. Needs GL 4.3, and the transform cache on the
+    // submitting thread so pipelined frames cull on the CPU
+    static const GLuint GPU_CULLING_GROUP_SIZE = 64;
+    static const GLuint GPU_CULLING_MAX_GROUP_COUNT = 65535;
+
+    // As glMultiDrawElementsIndirect reads them
+    typedef struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    bool m_isGpuCullingEnabled;
+    GLuint m_cullingProgramId = 0;
+    GLint m_cullingPlanesUniformId;
+    GLint m_cullingCountUniformId;
+    GLint m_cullingCommandIndexUniformId;
+    GLint m_cullingFirstInstanceUniformId;
+    // One region per type as large as its instance buffers, the instanced vertex arrays read from it
+    GLuint m_visibleInstanceBufferId = 0;
+    GLsizei m_visibleInstanceCapacities[CUBE_TYPE_COUNT] = {};
+    GLuint m_drawCommandBufferId = 0;
+
+    void initGpuCulling();
+    void cullCubesOnGpu(const XrView *views);
+
+
+    // Late latching, the hand cubes read their transformations from a uniform buffer written once when the frame starts
+    // and again right before the images are released. With a persistent coherent mapping the second write still reaches
+    // the draws the GPU hasn't run yet, without recording them again. Otherwise the draws keep the first one
+    static const GLuint HAND_TRANSFORMATIONS_BINDING = 0;
+
+    // std140, the matrices are four vec4 columns and the offset is padded to a vec4
+    typedef struct HandTransformations {
+        // Frame start ones of both hands, then the late latched ones
+        XrMatrix4x4f transformations[2 * HandInput::HAND_COUNT];
+        // Which of the two the shader reads, only switched once the late latched ones are complete
+        int32_t latestOffset;
+        int32_t padding[3];
+    };
+
+    typedef struct HandProgram {
+        GLuint programId = 0;
+        GLint viewProjectionUniformId;
+        GLint handIndexUniformId;
+        GLint vertexColorUniformId;
+    };
+
+    bool m_isLateLatchingEnabled = false;
+    // The multiview one if multiview is enabled
+    HandProgram m_handProgram;
+    GLint m_uniformBufferAlignment = 0;
+    StreamBuffer m_handTransformationBuffer;
+    StreamBuffer::Allocation m_handTransformationAllocation;
+
+    void initLateLatching();
+
+
+    // Culling
+    bool m_isCullingEnabled;
+    // Walks the cube hierarchy instead of testing every cube, the frustum culler still builds the planes. Only pays off
+    // when a small part of the scene is in view, with a third of it visible the flat SIMD test is about twice as fast
+    bool m_isHierarchicalCullingEnabled;
+    FrustumCuller m_frustumCuller;
+    BoundingVolumeHierarchy m_cubeHierarchy;
+    std::vector<uint32_t> m_visibleCubes;
 
 
     // Actions
     typedef struct Hand {
-        XrPath path;
-        XrSpace space;
+        XrPath path = XR_NULL_PATH;
+        XrSpace space = XR_NULL_HANDLE;
         // Mostly an annoyance
         //XrAction vibrateAction;
-        XrColor4f color = { 1.f, 1.f, 1.f, 1.f };
-        XrVector3f scale = { 1.f, 1.f, 1.f };
+        HandInput input;
+        HandInput::Snapshot snapshot;
         CubeType type = CubeType::EMPTY;
+        // Located once per frame, at the display time of the frame
+        XrSpaceLocation location{ XR_TYPE_SPACE_LOCATION };
 
-        float m_colorStartingAngle = -1;
-        XrColor4f m_originalColor;
-    };
-
-    typedef struct InputActions {
-        XrAction pose;
-        XrAction place;
-        XrAction expand;
-        XrAction shrink;
-        XrAction modifierXA;
-        XrAction modifierYB;
-        XrAction thumbstickX;
-        XrAction thumbstickY;
+        // Placed cube the grip points at, highlighted and removed by the remove action
+        uint32_t pickedCube = BoundingVolumeHierarchy::NO_ITEM;
     };
 
     std::vector<Hand> m_hands = { Hand(), Hand() };
-    InputActions m_inputActions;
-    XrActionSet m_actionSet;
+    // Indexed by HandInput::Action
+    XrAction m_actions[HandInput::ACTION_COUNT];
+    XrActionSet m_actionSet = XR_NULL_HANDLE;
+
+    static constexpr float MAX_PICK_DISTANCE = 5.f;
+    static constexpr XrColor4f PICK_HIGHLIGHT_COLOR = { 1.f, 1.f, 1.f, 1.f };
 
     void pollActions();
+    // Every action state of the hand, each queried once
+    void fetchSnapshot(Hand &hand);
+    uint32_t pickCube(const Hand &hand);
+    // The action set belongs to the instance, attaching it and the action spaces to the session
     void initActions();
+    void attachActions();
+
+
+    // Pipelining, the simulation thread owns events, input, the scene and xrWaitFrame, the render thread the context
+    // and xrBeginFrame to xrEndFrame. Whatever the render thread needs of the scene is copied into the frame's packet,
+    // the serial loop goes through a packet as well
+    typedef struct FramePacket {
+        uint64_t frameIndex;
+        XrFrameState frameState;
+        // When the input of the frame was sampled, the latency runs from there to xrEndFrame
+        std::chrono::steady_clock::time_point inputTime;
+        XrView views[VIEW_COUNT];
+        // Located once for the frame, the render thread may late latch newer ones
+        XrPosef handPoses[HandInput::HAND_COUNT];
+        XrVector3f handScales[HandInput::HAND_COUNT];
+        XrColor4f handColors[HandInput::HAND_COUNT];
+        CubeType handTypes[HandInput::HAND_COUNT];
+        // Outlines around the picked cubes, the first highlightCount are set
+        XrMatrix4x4f highlightTransformations[HandInput::HAND_COUNT];
+        uint32_t highlightCount;
+        // Pipelined only, the visible cubes compacted per type. The serial loop streams them straight from the cache
+        std::vector<CubeInstance> instances;
+        size_t instanceCounts[CUBE_TYPE_COUNT];
+    };
+
+    // xrWaitFrame blocks until the frame it handed out last is begun, so a conformant runtime never lets the render
+    // thread fall more than one frame behind and a deeper pipeline would only hold slots that are never filled
+    static constexpr uint32_t MAX_PIPELINE_DEPTH = 1;
+
+    bool m_isPipelined = false;
+    uint32_t m_pipelineDepth = 0;
+    std::chrono::steady_clock::time_point m_inputTime;
+    FramePacket m_packet;
+    std::unique_ptr<FramePipeline<FramePacket>> m_framePipeline;
+    std::thread m_renderThread;
+    // Left by the render thread when it stops on one, picked up once it's joined
+    std::exception_ptr m_renderError;
+
+    void runSerial(uint64_t frameLimit);
+    void runPipelined(uint64_t frameLimit);
+    // Events, input and the scene, false while the session isn't running
+    bool simulate();
+    void requestExit(uint64_t frameLimit);
+    // The simulation's part of a frame: waiting for it, locating the views and the hands and culling
+    void prepareFrame(FramePacket &packet);
+    // The render thread's part, everything from xrBeginFrame to xrEndFrame
+    void submitFrame(const FramePacket &packet);
+    void streamCubeInstances(const FramePacket &packet);
+    void drawScene(const FramePacket &packet, const XrMatrix4x4f *viewProjections);
+    // Writes the transformations the hand draws start out with
+    void writeHandTransformations(const FramePacket &packet);
+    // Locates the hands again and patches the newer transformations in under the recorded draws
+    void latchHands(const FramePacket &packet);
+
+    // The context is handed to the render thread for as long as it runs
+    void startRenderThread();
+    // Takes the context back, with the render thread's error if it stopped on one
+    std::exception_ptr stopRenderThread();
+    void runRenderThread();
+    void bindContext();
+    void releaseContext();
 };
 
 #endif //VR_VRCORE_H
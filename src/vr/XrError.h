@@ -0,0 +1,30 @@
+#ifndef VR_XRERROR_H
+#define VR_XRERROR_H
+
+#include <openxr/openxr.h>
+
+#include <stdexcept>
+#include <string>
+
+// Keeps error paths out of the instruction stream of the code calling them
+#if defined(_MSC_VER)
+#define OPENXRTEST_COLD __declspec(noinline)
+#else
+#define OPENXRTEST_COLD __attribute__((cold, noinline))
+#endif
+
+// A failed OpenXR call, the result tells how much of the OpenXR state is still usable
+class XrError : public std::runtime_error {
+public:
+    XrError(const std::string &message, XrResult result) : std::runtime_error(message), m_result(result) {
+    }
+
+    XrResult getResult() const {
+        return m_result;
+    }
+
+private:
+    XrResult m_result;
+};
+
+#endif //VR_XRERROR_H
@@ -6,6 +6,28 @@
 // SPDX-License-Identifier: Apache-2.0
 // Author: J.M.P. van Waveren
 
+#ifndef VR_XRMATRIX4X4F_H
+#define VR_XRMATRIX4X4F_H
+
+#include <openxr/openxr.h>
+
+#include <cmath>
+#include <cstddef>
+
+// Compile time dispatch of the SIMD kernels, define XRMATRIX4X4F_SCALAR to only use the scalar reference code
+#if !defined(XRMATRIX4X4F_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XRMATRIX4X4F_SSE
+#include <immintrin.h>
+#if defined(__AVX__)
+#define XRMATRIX4X4F_AVX
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define XRMATRIX4X4F_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 struct XrMatrix4x4f {
     float m[16];
 
@@ -129,7 +151,7 @@ struct XrMatrix4x4f {
         result->m[15] = 1.0f;
     }
 
-    static void Multiply(XrMatrix4x4f *result, const XrMatrix4x4f *a, const XrMatrix4x4f *b) {
+    static void MultiplyScalar(XrMatrix4x4f *result, const XrMatrix4x4f *a, const XrMatrix4x4f *b) {
         result->m[0] =
             a->m[0] * b->m[0] + a->m[4] * b->m[1] + a->m[8] * b->m[2] + a->m[12] * b->m[3];
         result->m[1] =
@@ -167,7 +189,7 @@ struct XrMatrix4x4f {
             a->m[3] * b->m[12] + a->m[7] * b->m[13] + a->m[11] * b->m[14] + a->m[15] * b->m[15];
     }
 
-    static void InvertRigidBody(XrMatrix4x4f *result, const XrMatrix4x4f *src) {
+    static void InvertRigidBodyScalar(XrMatrix4x4f *result, const XrMatrix4x4f *src) {
         result->m[0] = src->m[0];
         result->m[1] = src->m[4];
         result->m[2] = src->m[8];
@@ -186,7 +208,7 @@ struct XrMatrix4x4f {
         result->m[15] = 1.0f;
     }
 
-    static void CreateViewMatrix(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation) {
+    static void CreateViewMatrixScalar(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation) {
 
         XrMatrix4x4f rotationMatrix;
         CreateFromQuaternion(&rotationMatrix, rotation);
@@ -196,10 +218,10 @@ struct XrMatrix4x4f {
             translation->z);
 
         XrMatrix4x4f viewMatrix;
-        Multiply(&viewMatrix, &translationMatrix, &rotationMatrix);
+        MultiplyScalar(&viewMatrix, &translationMatrix, &rotationMatrix);
         //Multiply(result, &translationMatrix, &rotationMatrix);
 
-        InvertRigidBody(result, &viewMatrix);
+        InvertRigidBodyScalar(result, &viewMatrix);
     }
 
     static void CreateScale(XrMatrix4x4f *result, const float x, const float y, const float z) {
@@ -221,7 +243,7 @@ struct XrMatrix4x4f {
         result->m[15] = 1.0f;
     }
 
-    static void CreateTranslationRotationScale(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation, const XrVector3f *scale) {
+    static void CreateTranslationRotationScaleScalar(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation, const XrVector3f *scale) {
         XrMatrix4x4f scaleMatrix;
         CreateScale(&scaleMatrix, scale->x, scale->y, scale->z);
 
@@ -232,8 +254,210 @@ struct XrMatrix4x4f {
         CreateTranslation(&translationMatrix, translation->x, translation->y, translation->z);
 
         XrMatrix4x4f combinedMatrix;
-        Multiply(&combinedMatrix, &rotationMatrix, &scaleMatrix);
-        Multiply(result, &translationMatrix, &combinedMatrix);
+        MultiplyScalar(&combinedMatrix, &rotationMatrix, &scaleMatrix);
+        MultiplyScalar(result, &translationMatrix, &combinedMatrix);
+    }
+
+    // The functions below use the SIMD kernels when available, the *Scalar functions above are their reference
+
+    static void Multiply(XrMatrix4x4f *result, const XrMatrix4x4f *a, const XrMatrix4x4f *b) {
+#if defined(XRMATRIX4X4F_SSE)
+        const __m128 a0 = _mm_loadu_ps(&a->m[0]);
+        const __m128 a1 = _mm_loadu_ps(&a->m[4]);
+        const __m128 a2 = _mm_loadu_ps(&a->m[8]);
+        const __m128 a3 = _mm_loadu_ps(&a->m[12]);
+        MultiplyColumnsSse(result, a0, a1, a2, a3, b);
+#elif defined(XRMATRIX4X4F_NEON)
+        const float32x4_t a0 = vld1q_f32(&a->m[0]);
+        const float32x4_t a1 = vld1q_f32(&a->m[4]);
+        const float32x4_t a2 = vld1q_f32(&a->m[8]);
+        const float32x4_t a3 = vld1q_f32(&a->m[12]);
+        MultiplyColumnsNeon(result, a0, a1, a2, a3, b);
+#else
+        MultiplyScalar(result, a, b);
+#endif
+    }
+
+    // results[i] = a * b[i], e.g. to transform many model matrices by one view-projection. results must not alias a
+    static void MultiplyBatch(XrMatrix4x4f *results, const XrMatrix4x4f *a, const XrMatrix4x4f *b, size_t count) {
+#if defined(XRMATRIX4X4F_AVX)
+        // Both 128 bit lanes hold the same column of a so every iteration produces two columns of the result
+        const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a->m[0]));
+        const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a->m[4]));
+        const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a->m[8]));
+        const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a->m[12]));
+        for (size_t i = 0; i < count; i++) {
+            for (int column = 0; column < 4; column += 2) {
+                const __m256 bColumns = _mm256_loadu_ps(&b[i].m[column * 4]);
+                __m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(bColumns, bColumns, _MM_SHUFFLE(0, 0, 0, 0)));
+                r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(bColumns, bColumns, _MM_SHUFFLE(1, 1, 1, 1))));
+                r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(bColumns, bColumns, _MM_SHUFFLE(2, 2, 2, 2))));
+                r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(bColumns, bColumns, _MM_SHUFFLE(3, 3, 3, 3))));
+                _mm256_storeu_ps(&results[i].m[column * 4], r);
+            }
+        }
+#elif defined(XRMATRIX4X4F_SSE)
+        const __m128 a0 = _mm_loadu_ps(&a->m[0]);
+        const __m128 a1 = _mm_loadu_ps(&a->m[4]);
+        const __m128 a2 = _mm_loadu_ps(&a->m[8]);
+        const __m128 a3 = _mm_loadu_ps(&a->m[12]);
+        for (size_t i = 0; i < count; i++) {
+            MultiplyColumnsSse(&results[i], a0, a1, a2, a3, &b[i]);
+        }
+#elif defined(XRMATRIX4X4F_NEON)
+        const float32x4_t a0 = vld1q_f32(&a->m[0]);
+        const float32x4_t a1 = vld1q_f32(&a->m[4]);
+        const float32x4_t a2 = vld1q_f32(&a->m[8]);
+        const float32x4_t a3 = vld1q_f32(&a->m[12]);
+        for (size_t i = 0; i < count; i++) {
+            MultiplyColumnsNeon(&results[i], a0, a1, a2, a3, &b[i]);
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+            MultiplyScalar(&results[i], a, &b[i]);
+        }
+#endif
+    }
+
+    static void InvertRigidBody(XrMatrix4x4f *result, const XrMatrix4x4f *src) {
+#if defined(XRMATRIX4X4F_SSE)
+        // Transposing the upper 3x3 gives the inverse rotation, the last column has to stay (0, 0, 0, 1)
+        __m128 r0 = _mm_loadu_ps(&src->m[0]);
+        __m128 r1 = _mm_loadu_ps(&src->m[4]);
+        __m128 r2 = _mm_loadu_ps(&src->m[8]);
+        __m128 r3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        __m128 translation = _mm_mul_ps(r0, _mm_set1_ps(src->m[12]));
+        translation = _mm_add_ps(translation, _mm_mul_ps(r1, _mm_set1_ps(src->m[13])));
+        translation = _mm_add_ps(translation, _mm_mul_ps(r2, _mm_set1_ps(src->m[14])));
+        translation = _mm_sub_ps(r3, translation);
+
+        _mm_storeu_ps(&result->m[0], r0);
+        _mm_storeu_ps(&result->m[4], r1);
+        _mm_storeu_ps(&result->m[8], r2);
+        _mm_storeu_ps(&result->m[12], translation);
+#elif defined(XRMATRIX4X4F_NEON)
+        const float32x4_t r0 = { src->m[0], src->m[4], src->m[8], 0.0f };
+        const float32x4_t r1 = { src->m[1], src->m[5], src->m[9], 0.0f };
+        const float32x4_t r2 = { src->m[2], src->m[6], src->m[10], 0.0f };
+        const float32x4_t r3 = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+        float32x4_t translation = vmulq_n_f32(r0, src->m[12]);
+        translation = vmlaq_n_f32(translation, r1, src->m[13]);
+        translation = vmlaq_n_f32(translation, r2, src->m[14]);
+
+        vst1q_f32(&result->m[0], r0);
+        vst1q_f32(&result->m[4], r1);
+        vst1q_f32(&result->m[8], r2);
+        vst1q_f32(&result->m[12], vsubq_f32(r3, translation));
+#else
+        InvertRigidBodyScalar(result, src);
+#endif
+    }
+
+    static void CreateViewMatrix(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation) {
+#if defined(XRMATRIX4X4F_SSE) || defined(XRMATRIX4X4F_NEON)
+        // (T * R)^-1 == R^T * -T, no need to build and multiply both matrices first
+        XrMatrix4x4f viewMatrix;
+        CreateTranslationRotationScale(&viewMatrix, translation, rotation, nullptr);
+        InvertRigidBody(result, &viewMatrix);
+#else
+        CreateViewMatrixScalar(result, translation, rotation);
+#endif
+    }
+
+    // A null scale is the same as a scale of 1 but skips the multiplication
+    static void CreateTranslationRotationScale(XrMatrix4x4f *result, const XrVector3f *translation, const XrQuaternionf *rotation, const XrVector3f *scale) {
+#if defined(XRMATRIX4X4F_SSE) || defined(XRMATRIX4X4F_NEON)
+        // Same terms as CreateFromQuaternion, then the columns get scaled and the translation goes straight into the last one
+        const float x2 = rotation->x + rotation->x;
+        const float y2 = rotation->y + rotation->y;
+        const float z2 = rotation->z + rotation->z;
+
+        const float xx2 = rotation->x * x2;
+        const float yy2 = rotation->y * y2;
+        const float zz2 = rotation->z * z2;
+
+        const float yz2 = rotation->y * z2;
+        const float wx2 = rotation->w * x2;
+        const float xy2 = rotation->x * y2;
+        const float wz2 = rotation->w * z2;
+        const float xz2 = rotation->x * z2;
+        const float wy2 = rotation->w * y2;
+
+#if defined(XRMATRIX4X4F_SSE)
+        __m128 c0 = _mm_set_ps(0.0f, xz2 - wy2, xy2 + wz2, 1.0f - yy2 - zz2);
+        __m128 c1 = _mm_set_ps(0.0f, yz2 + wx2, 1.0f - xx2 - zz2, xy2 - wz2);
+        __m128 c2 = _mm_set_ps(0.0f, 1.0f - xx2 - yy2, yz2 - wx2, xz2 + wy2);
+        if (scale) {
+            c0 = _mm_mul_ps(c0, _mm_set1_ps(scale->x));
+            c1 = _mm_mul_ps(c1, _mm_set1_ps(scale->y));
+            c2 = _mm_mul_ps(c2, _mm_set1_ps(scale->z));
+        }
+
+        _mm_storeu_ps(&result->m[0], c0);
+        _mm_storeu_ps(&result->m[4], c1);
+        _mm_storeu_ps(&result->m[8], c2);
+        _mm_storeu_ps(&result->m[12], _mm_set_ps(1.0f, translation->z, translation->y, translation->x));
+#else
+        float32x4_t c0 = { 1.0f - yy2 - zz2, xy2 + wz2, xz2 - wy2, 0.0f };
+        float32x4_t c1 = { xy2 - wz2, 1.0f - xx2 - zz2, yz2 + wx2, 0.0f };
+        float32x4_t c2 = { xz2 + wy2, yz2 - wx2, 1.0f - xx2 - yy2, 0.0f };
+        if (scale) {
+            c0 = vmulq_n_f32(c0, scale->x);
+            c1 = vmulq_n_f32(c1, scale->y);
+            c2 = vmulq_n_f32(c2, scale->z);
+        }
+        const float32x4_t c3 = { translation->x, translation->y, translation->z, 1.0f };
+
+        vst1q_f32(&result->m[0], c0);
+        vst1q_f32(&result->m[4], c1);
+        vst1q_f32(&result->m[8], c2);
+        vst1q_f32(&result->m[12], c3);
+#endif
+#else
+        const XrVector3f unitScale{ 1.0f, 1.0f, 1.0f };
+        CreateTranslationRotationScaleScalar(result, translation, rotation, scale ? scale : &unitScale);
+#endif
+    }
+
+private:
+#if defined(XRMATRIX4X4F_SSE)
+    static void MultiplyColumnsSse(XrMatrix4x4f *result, const __m128 a0, const __m128 a1, const __m128 a2, const __m128 a3, const XrMatrix4x4f *b) {
+        // Every column of the result is a linear combination of the columns of a
+        __m128 columns[4];
+        for (int column = 0; column < 4; column++) {
+            const float *bColumn = &b->m[column * 4];
+            __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bColumn[0]));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bColumn[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bColumn[2])));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bColumn[3])));
+            columns[column] = r;
+        }
+
+        // b may alias the result
+        for (int column = 0; column < 4; column++) {
+            _mm_storeu_ps(&result->m[column * 4], columns[column]);
+        }
+    }
+#elif defined(XRMATRIX4X4F_NEON)
+    static void MultiplyColumnsNeon(XrMatrix4x4f *result, const float32x4_t a0, const float32x4_t a1, const float32x4_t a2, const float32x4_t a3, const XrMatrix4x4f *b) {
+        float32x4_t columns[4];
+        for (int column = 0; column < 4; column++) {
+            const float32x4_t bColumn = vld1q_f32(&b->m[column * 4]);
+            float32x4_t r = vmulq_laneq_f32(a0, bColumn, 0);
+            r = vfmaq_laneq_f32(r, a1, bColumn, 1);
+            r = vfmaq_laneq_f32(r, a2, bColumn, 2);
+            r = vfmaq_laneq_f32(r, a3, bColumn, 3);
+            columns[column] = r;
+        }
+
+        for (int column = 0; column < 4; column++) {
+            vst1q_f32(&result->m[column * 4], columns[column]);
+        }
     }
+#endif
 };
 
+#endif //VR_XRMATRIX4X4F_H
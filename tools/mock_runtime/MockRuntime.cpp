@@ -0,0 +1,1461 @@
+// A stand-in OpenXR runtime that needs no headset, meant for running the real frame loop unattended on Linux.
+// Point the loader at it with XR_RUNTIME_JSON=<build dir>/openxr_mock_runtime.json and configure it through:
+//   OPENXRTEST_MOCK_DISPLAY_HZ      display refresh rate xrWaitFrame paces to (90)
+//   OPENXRTEST_MOCK_JITTER_MS       +- random delay added to every xrWaitFrame wake up (0)
+//   OPENXRTEST_MOCK_RESOLUTION      recommended per eye resolution as WIDTHxHEIGHT (1440x1584)
+//   OPENXRTEST_MOCK_CLICK_INTERVAL  syncs between two thumbstick clicks of a hand, 0 disables them (15)
+//   OPENXRTEST_MOCK_SEED            seed of the jitter (1)
+//   OPENXRTEST_MOCK_LOSE_SESSION_AT  ended frames after which the session is lost, 0 never loses it (0)
+//   OPENXRTEST_MOCK_LOSE_INSTANCE_AT ended frames after which the instance is lost, 0 never loses it (0)
+//   OPENXRTEST_MOCK_UNAVAILABLE_COUNT xrGetSystem calls after a loss that find no headset yet (0)
+// Head and hands follow a fixed script of time, swapchain images are plain textures created in the app's current
+// GL context and nothing is ever composited. Like a real runtime, xrWaitFrame blocks until the frame it handed out
+// last is begun
+
+#define XR_NO_PROTOTYPES
+#define XR_USE_GRAPHICS_API_OPENGL
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+#include "LoaderInterfaces.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#define MOCK_EXPORT __declspec(dllexport)
+#else
+#define MOCK_EXPORT __attribute__((visibility("default")))
+#endif
+
+
+
+static const uint32_t VIEW_COUNT = 2;
+static const uint32_t SWAPCHAIN_LENGTH = 3;
+static const XrSystemId SYSTEM_ID = 1;
+static const float EYE_OFFSET = 0.032f;
+
+static const char *const EXTENSIONS[] = {
+    "XR_KHR_opengl_enable",
+    "XR_MNDX_egl_enable",
+    "XR_KHR_composition_layer_depth",
+    "XR_EXT_hp_mixed_reality_controller"
+};
+
+typedef struct Config {
+    double displayHz = 90.;
+    double jitterMilliseconds = 0.;
+    uint32_t width = 1440;
+    uint32_t height = 1584;
+    uint32_t clickInterval = 15;
+    uint32_t seed = 1;
+    uint64_t loseSessionAt = 0;
+    uint64_t loseInstanceAt = 0;
+    uint32_t unavailableCount = 0;
+} Config;
+
+typedef struct Statistics {
+    uint64_t frames = 0;
+    uint64_t lateFrames = 0;
+    // xrWaitFrame calls that had to wait for the previous frame to be begun
+    uint64_t blockedWaits = 0;
+    uint64_t projectionLayers = 0;
+    uint64_t depthInfos = 0;
+} Statistics;
+
+struct XrActionSet_T;
+
+struct XrInstance_T {
+    Config config;
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<std::string> paths{ "" };
+    std::unordered_map<std::string, XrPath> pathIds;
+    std::vector<std::unique_ptr<XrActionSet_T>> actionSets;
+    Statistics statistics;
+
+    // Once lost, everything but destroying it fails, the loss pending event is delivered first
+    std::atomic<bool> isLost{ false };
+    bool isLossEventPending = false;
+};
+
+struct XrAction_T {
+    XrActionSet_T *actionSet;
+    std::string name;
+    XrActionType type;
+    // Full binding paths, e.g. /user/hand/left/input/trigger/value
+    std::vector<std::string> bindings;
+};
+
+struct XrActionSet_T {
+    XrInstance_T *instance;
+    std::string name;
+    std::vector<std::unique_ptr<XrAction_T>> actions;
+};
+
+struct XrSpace_T {
+    enum class Kind {
+        REFERENCE,
+        HAND
+    };
+
+    Kind kind;
+    XrReferenceSpaceType referenceSpaceType;
+    uint32_t hand;
+    XrPosef offset;
+};
+
+struct XrSwapchain_T {
+    XrSwapchainCreateInfo createInfo;
+    GLenum target;
+    std::vector<GLuint> images;
+    uint32_t nextImage = 0;
+    uint32_t acquiredCount = 0;
+};
+
+struct XrSession_T {
+    XrInstance_T *instance;
+    XrSessionState state = XR_SESSION_STATE_UNKNOWN;
+    std::atomic<bool> isLost{ false };
+    bool isRunning = false;
+    bool isExitRequested = false;
+    std::deque<XrEventDataSessionStateChanged> events;
+    std::vector<std::unique_ptr<XrSpace_T>> spaces;
+    std::vector<std::unique_ptr<XrSwapchain_T>> swapchains;
+
+    XrTime lastDisplayTime = 0;
+    // Waited for and not begun yet, the next xrWaitFrame blocks until it is
+    bool isFrameWaited = false;
+    bool isFrameBegun = false;
+    std::mt19937 random;
+
+    uint64_t syncIndex = 0;
+    XrTime syncTime = 0;
+};
+
+// The loader only ever creates one instance per process
+static std::mutex s_mutex;
+static std::unique_ptr<XrInstance_T> s_instance;
+static std::unique_ptr<XrSession_T> s_session;
+// Signalled on every xrBeginFrame, state change and loss, with s_mutex
+static std::condition_variable s_frameCondition;
+
+// Every loss only happens once per process, what gets recreated after it keeps running. The frames are counted over
+// every instance so the instance loss can come after the session loss
+static uint64_t s_frameCount = 0;
+static bool s_isSessionLossDone = false;
+static bool s_isInstanceLossDone = false;
+// Counts down on every xrGetSystem after a loss, the session can't be recreated either until it's back
+static uint32_t s_unavailableCount = 0;
+
+
+// Time and poses
+
+static XrTime now(const XrInstance_T &instance) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - instance.epoch).count() + 1;
+}
+
+static XrQuaternionf multiply(const XrQuaternionf &a, const XrQuaternionf &b) {
+    return {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+}
+
+static XrVector3f rotate(const XrQuaternionf &q, const XrVector3f &v) {
+    const XrVector3f t{
+        2.f * (q.y * v.z - q.z * v.y),
+        2.f * (q.z * v.x - q.x * v.z),
+        2.f * (q.x * v.y - q.y * v.x)
+    };
+
+    return {
+        v.x + q.w * t.x + (q.y * t.z - q.z * t.y),
+        v.y + q.w * t.y + (q.z * t.x - q.x * t.z),
+        v.z + q.w * t.z + (q.x * t.y - q.y * t.x)
+    };
+}
+
+static XrPosef multiply(const XrPosef &a, const XrPosef &b) {
+    const XrVector3f position = rotate(a.orientation, b.position);
+    return {
+        multiply(a.orientation, b.orientation),
+        { a.position.x + position.x, a.position.y + position.y, a.position.z + position.z }
+    };
+}
+
+static XrPosef invert(const XrPosef &pose) {
+    const XrQuaternionf orientation{ -pose.orientation.x, -pose.orientation.y, -pose.orientation.z, pose.orientation.w };
+    const XrVector3f position = rotate(orientation, pose.position);
+    return { orientation, { -position.x, -position.y, -position.z } };
+}
+
+static XrQuaternionf yaw(float angle) {
+    return { 0.f, sinf(angle / 2.f), 0.f, cosf(angle / 2.f) };
+}
+
+// Standing in the middle of the stage, swaying a bit and looking around so that culling has something to do
+static XrPosef getHeadPose(XrTime time) {
+    const float t = time / 1e9f;
+    return {
+        yaw(0.8f * sinf(0.3f * t)),
+        { 0.1f * sinf(0.5f * t), 1.6f, 0.05f * cosf(0.4f * t) }
+    };
+}
+
+// Both hands in front of the head, tracing slow loops
+static XrPosef getHandPose(XrTime time, uint32_t hand) {
+    const float t = time / 1e9f;
+    const float side = hand == 0 ? -1.f : 1.f;
+    const XrPosef head = getHeadPose(time);
+
+    const XrPosef handInHead{
+        yaw(side * 0.2f),
+        {
+            side * (0.2f + 0.05f * sinf(1.1f * t)),
+            -0.3f + 0.05f * cosf(0.9f * t),
+            -0.45f - 0.1f * sinf(0.7f * t + side)
+        }
+    };
+    return multiply(head, handInHead);
+}
+
+static XrPosef getSpacePose(const XrSpace_T &space, XrTime time) {
+    if (space.kind == XrSpace_T::Kind::HAND) {
+        return multiply(getHandPose(time, space.hand), space.offset);
+    }
+
+    if (space.referenceSpaceType == XR_REFERENCE_SPACE_TYPE_VIEW) {
+        return multiply(getHeadPose(time), space.offset);
+    }
+    return space.offset;
+}
+
+
+// Paths and input
+
+static XrPath getPath(XrInstance_T &instance, const std::string &path) {
+    auto it = instance.pathIds.find(path);
+    if (it != instance.pathIds.end()) {
+        return it->second;
+    }
+
+    const XrPath id = instance.paths.size();
+    instance.paths.push_back(path);
+    instance.pathIds[path] = id;
+    return id;
+}
+
+static const std::string *getPathString(const XrInstance_T &instance, XrPath path) {
+    if (path == XR_NULL_PATH || path >= instance.paths.size()) {
+        return nullptr;
+    }
+    return &instance.paths[path];
+}
+
+static bool endsWith(const std::string &string, const char *suffix) {
+    const size_t length = strlen(suffix);
+    return string.size() >= length && string.compare(string.size() - length, length, suffix) == 0;
+}
+
+// The scripted value of one input component after the given number of syncs, only the thumbstick gets clicked
+static float getInputValue(const Config &config, const std::string &binding, uint64_t syncIndex) {
+    if (endsWith(binding, "/thumbstick/click") && config.clickInterval) {
+        // One sync long click, the hands take turns
+        const uint64_t offset = binding.find("/user/hand/right") == 0 ? config.clickInterval / 2 : 0;
+        return (syncIndex + offset) % config.clickInterval == 0 ? 1.f : 0.f;
+    }
+
+    return 0.f;
+}
+
+typedef struct InputState {
+    float current;
+    float previous;
+    bool isActive;
+} InputState;
+
+static XrResult getInputState(XrSession session, const XrActionStateGetInfo *getInfo, XrActionType type, InputState &state) {
+    if (!session || !getInfo || !getInfo->action) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (getInfo->action->type != type) {
+        return XR_ERROR_ACTION_TYPE_MISMATCH;
+    }
+
+    const XrInstance_T &instance = *session->instance;
+    const std::string *subactionPath = getPathString(instance, getInfo->subactionPath);
+
+    // Like a runtime would: the largest magnitude of all the bound components
+    state = { 0.f, 0.f, false };
+    for (const std::string &binding : getInfo->action->bindings) {
+        if (subactionPath && binding.compare(0, subactionPath->size(), *subactionPath) != 0) {
+            continue;
+        }
+
+        state.isActive = true;
+        const float current = getInputValue(instance.config, binding, session->syncIndex);
+        const float previous = session->syncIndex ? getInputValue(instance.config, binding, session->syncIndex - 1) : 0.f;
+        if (fabsf(current) > fabsf(state.current)) {
+            state.current = current;
+        }
+        if (fabsf(previous) > fabsf(state.previous)) {
+            state.previous = previous;
+        }
+    }
+
+    return XR_SUCCESS;
+}
+
+
+// Sessions
+
+static void queueState(XrSession_T &session, XrSessionState state) {
+    XrEventDataSessionStateChanged event{ XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED };
+    event.session = &session;
+    event.state = state;
+    event.time = now(*session.instance);
+    session.events.push_back(event);
+    session.state = state;
+    s_frameCondition.notify_all();
+}
+
+static XrResult getLossResult(const XrSession_T &session) {
+    if (session.instance->isLost) {
+        return XR_ERROR_INSTANCE_LOST;
+    }
+    if (session.isLost) {
+        return XR_ERROR_SESSION_LOST;
+    }
+    return XR_SUCCESS;
+}
+
+// Called with the mutex held after a frame ended
+static void loseOnFrame(XrSession_T &session) {
+    s_frameCount++;
+    const Config &config = session.instance->config;
+
+    if (config.loseSessionAt && s_frameCount >= config.loseSessionAt && !s_isSessionLossDone) {
+        fprintf(stderr, "MOCK RUNTIME: losing the session after %llu frames\n", (unsigned long long)s_frameCount);
+        s_isSessionLossDone = true;
+        s_unavailableCount = config.unavailableCount;
+        queueState(session, XR_SESSION_STATE_LOSS_PENDING);
+        session.isLost = true;
+    }
+    if (config.loseInstanceAt && s_frameCount >= config.loseInstanceAt && !s_isInstanceLossDone) {
+        fprintf(stderr, "MOCK RUNTIME: losing the instance after %llu frames\n", (unsigned long long)s_frameCount);
+        s_isInstanceLossDone = true;
+        s_unavailableCount = config.unavailableCount;
+        session.instance->isLossEventPending = true;
+        session.instance->isLost = true;
+        s_frameCondition.notify_all();
+    }
+}
+
+static GLenum getPixelFormat(int64_t format, GLenum &type) {
+    switch (format) {
+        case GL_DEPTH_COMPONENT16:
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH_COMPONENT32F:
+            type = GL_FLOAT;
+            return GL_DEPTH_COMPONENT;
+        case GL_DEPTH24_STENCIL8:
+            type = GL_UNSIGNED_INT_24_8;
+            return GL_DEPTH_STENCIL;
+        default:
+            type = GL_UNSIGNED_BYTE;
+            return GL_RGBA;
+    }
+}
+
+static const int64_t SWAPCHAIN_FORMATS[] = {
+    GL_RGBA8,
+    GL_SRGB8_ALPHA8,
+    GL_DEPTH_COMPONENT24,
+    GL_DEPTH_COMPONENT32F,
+    GL_DEPTH24_STENCIL8
+};
+
+
+// API
+
+template<typename T>
+static XrResult enumerate(const T *values, uint32_t count, uint32_t capacity, uint32_t *countOutput, T *output) {
+    if (!countOutput) {
+        return XR_ERROR_VALIDATION_FAILURE;
+    }
+
+    *countOutput = count;
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < count) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        output[i] = values[i];
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getInstanceProcAddr(XrInstance instance, const char *name, PFN_xrVoidFunction *function);
+
+static XrResult XRAPI_CALL enumerateInstanceExtensionProperties(const char *layerName, uint32_t capacity, uint32_t *countOutput, XrExtensionProperties *properties) {
+    if (layerName) {
+        return XR_ERROR_API_LAYER_NOT_PRESENT;
+    }
+
+    const uint32_t count = sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]);
+    if (!countOutput) {
+        return XR_ERROR_VALIDATION_FAILURE;
+    }
+    *countOutput = count;
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < count) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        strncpy(properties[i].extensionName, EXTENSIONS[i], XR_MAX_EXTENSION_NAME_SIZE - 1);
+        properties[i].extensionVersion = 1;
+    }
+    return XR_SUCCESS;
+}
+
+static double getEnvironment(const char *name, double defaultValue) {
+    const char *value = getenv(name);
+    return value && *value ? atof(value) : defaultValue;
+}
+
+static XrResult XRAPI_CALL createInstance(const XrInstanceCreateInfo *createInfo, XrInstance *instance) {
+    if (!createInfo || !instance) {
+        return XR_ERROR_VALIDATION_FAILURE;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_instance) {
+        return XR_ERROR_LIMIT_REACHED;
+    }
+
+    for (uint32_t i = 0; i < createInfo->enabledExtensionCount; i++) {
+        bool isSupported = false;
+        for (const char *extension : EXTENSIONS) {
+            isSupported |= strcmp(extension, createInfo->enabledExtensionNames[i]) == 0;
+        }
+        if (!isSupported) {
+            return XR_ERROR_EXTENSION_NOT_PRESENT;
+        }
+    }
+
+    s_instance = std::make_unique<XrInstance_T>();
+    s_instance->epoch = std::chrono::steady_clock::now();
+
+    Config &config = s_instance->config;
+    config.displayHz = getEnvironment("OPENXRTEST_MOCK_DISPLAY_HZ", config.displayHz);
+    config.jitterMilliseconds = getEnvironment("OPENXRTEST_MOCK_JITTER_MS", config.jitterMilliseconds);
+    config.clickInterval = (uint32_t)getEnvironment("OPENXRTEST_MOCK_CLICK_INTERVAL", config.clickInterval);
+    config.seed = (uint32_t)getEnvironment("OPENXRTEST_MOCK_SEED", config.seed);
+    config.loseSessionAt = (uint64_t)getEnvironment("OPENXRTEST_MOCK_LOSE_SESSION_AT", (double)config.loseSessionAt);
+    config.loseInstanceAt = (uint64_t)getEnvironment("OPENXRTEST_MOCK_LOSE_INSTANCE_AT", (double)config.loseInstanceAt);
+    config.unavailableCount = (uint32_t)getEnvironment("OPENXRTEST_MOCK_UNAVAILABLE_COUNT", config.unavailableCount);
+    if (const char *resolution = getenv("OPENXRTEST_MOCK_RESOLUTION")) {
+        sscanf(resolution, "%ux%u", &config.width, &config.height);
+    }
+    if (config.displayHz <= 0.) {
+        config.displayHz = 90.;
+    }
+
+    fprintf(stderr, "MOCK RUNTIME: %.1f Hz, %.2f ms jitter, %ux%u per eye\n", config.displayHz, config.jitterMilliseconds, config.width, config.height);
+
+    *instance = s_instance.get();
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroyInstance(XrInstance instance) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance || instance != s_instance.get()) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    const Statistics &statistics = instance->statistics;
+    fprintf(stderr, "MOCK RUNTIME: %llu frames, %llu late, %llu blocked waits, %llu projection layers, %llu depth infos\n",
+        (unsigned long long)statistics.frames, (unsigned long long)statistics.lateFrames, (unsigned long long)statistics.blockedWaits,
+        (unsigned long long)statistics.projectionLayers, (unsigned long long)statistics.depthInfos);
+
+    s_session.reset();
+    s_instance.reset();
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getInstanceProperties(XrInstance instance, XrInstanceProperties *properties) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    properties->runtimeVersion = XR_MAKE_VERSION(0, 1, 0);
+    strncpy(properties->runtimeName, "OpenXRTest mock runtime", XR_MAX_RUNTIME_NAME_SIZE - 1);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL pollEvent(XrInstance instance, XrEventDataBuffer *eventData) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (instance->isLossEventPending) {
+        XrEventDataInstanceLossPending event{ XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING };
+        event.lossTime = now(*instance);
+        memcpy(eventData, &event, sizeof(event));
+        instance->isLossEventPending = false;
+        return XR_SUCCESS;
+    }
+    if (instance->isLost) {
+        return XR_ERROR_INSTANCE_LOST;
+    }
+    if (!s_session || s_session->events.empty()) {
+        return XR_EVENT_UNAVAILABLE;
+    }
+
+    const XrEventDataSessionStateChanged &event = s_session->events.front();
+    memcpy(eventData, &event, sizeof(event));
+    s_session->events.pop_front();
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL resultToString(XrInstance, XrResult value, char buffer[XR_MAX_RESULT_STRING_SIZE]) {
+    snprintf(buffer, XR_MAX_RESULT_STRING_SIZE, XR_SUCCEEDED(value) ? "XR_UNKNOWN_SUCCESS_%d" : "XR_UNKNOWN_FAILURE_%d", (int)value);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL structureTypeToString(XrInstance, XrStructureType value, char buffer[XR_MAX_STRUCTURE_NAME_SIZE]) {
+    snprintf(buffer, XR_MAX_STRUCTURE_NAME_SIZE, "XR_UNKNOWN_STRUCTURE_TYPE_%d", (int)value);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getSystem(XrInstance instance, const XrSystemGetInfo *getInfo, XrSystemId *systemId) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (getInfo->formFactor != XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY) {
+        return XR_ERROR_FORM_FACTOR_UNSUPPORTED;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (instance->isLost) {
+        return XR_ERROR_INSTANCE_LOST;
+    }
+    if (s_unavailableCount) {
+        s_unavailableCount--;
+        return XR_ERROR_FORM_FACTOR_UNAVAILABLE;
+    }
+
+    *systemId = SYSTEM_ID;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getSystemProperties(XrInstance instance, XrSystemId systemId, XrSystemProperties *properties) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+
+    properties->systemId = SYSTEM_ID;
+    properties->vendorId = 0;
+    strncpy(properties->systemName, "Mock HMD", XR_MAX_SYSTEM_NAME_SIZE - 1);
+    properties->graphicsProperties = { 4096, 4096, 16 };
+    properties->trackingProperties = { XR_TRUE, XR_TRUE };
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL enumerateEnvironmentBlendModes(XrInstance instance, XrSystemId systemId, XrViewConfigurationType, uint32_t capacity, uint32_t *countOutput, XrEnvironmentBlendMode *modes) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+
+    static const XrEnvironmentBlendMode blendModes[] = { XR_ENVIRONMENT_BLEND_MODE_OPAQUE };
+    return enumerate(blendModes, 1, capacity, countOutput, modes);
+}
+
+static XrResult XRAPI_CALL enumerateViewConfigurations(XrInstance instance, XrSystemId systemId, uint32_t capacity, uint32_t *countOutput, XrViewConfigurationType *types) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+
+    static const XrViewConfigurationType viewConfigurationTypes[] = { XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO };
+    return enumerate(viewConfigurationTypes, 1, capacity, countOutput, types);
+}
+
+static XrResult XRAPI_CALL enumerateViewConfigurationViews(XrInstance instance, XrSystemId systemId, XrViewConfigurationType type, uint32_t capacity, uint32_t *countOutput, XrViewConfigurationView *views) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+    if (type != XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) {
+        return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+    }
+
+    *countOutput = VIEW_COUNT;
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < VIEW_COUNT) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    for (uint32_t i = 0; i < VIEW_COUNT; i++) {
+        views[i].recommendedImageRectWidth = instance->config.width;
+        views[i].maxImageRectWidth = 4096;
+        views[i].recommendedImageRectHeight = instance->config.height;
+        views[i].maxImageRectHeight = 4096;
+        views[i].recommendedSwapchainSampleCount = 1;
+        views[i].maxSwapchainSampleCount = 1;
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getOpenGLGraphicsRequirements(XrInstance instance, XrSystemId systemId, XrGraphicsRequirementsOpenGLKHR *requirements) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+
+    requirements->minApiVersionSupported = XR_MAKE_VERSION(3, 3, 0);
+    requirements->maxApiVersionSupported = XR_MAKE_VERSION(4, 6, 0);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL createSession(XrInstance instance, const XrSessionCreateInfo *createInfo, XrSession *session) {
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (createInfo->systemId != SYSTEM_ID) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+    // Any OpenGL binding goes, Win32 or EGL, swapchain images are simply created in whatever context is current
+    if (!createInfo->next) {
+        return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (instance->isLost) {
+        return XR_ERROR_INSTANCE_LOST;
+    }
+    // The system id is gone along with the headset, only a new one from xrGetSystem works
+    if (s_unavailableCount) {
+        return XR_ERROR_SYSTEM_INVALID;
+    }
+    if (s_session) {
+        return XR_ERROR_LIMIT_REACHED;
+    }
+
+    s_session = std::make_unique<XrSession_T>();
+    s_session->instance = instance;
+    s_session->random.seed(instance->config.seed);
+
+    queueState(*s_session, XR_SESSION_STATE_IDLE);
+    queueState(*s_session, XR_SESSION_STATE_READY);
+
+    *session = s_session.get();
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroySession(XrSession session) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session || session != s_session.get()) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    for (auto &swapchain : session->swapchains) {
+        glDeleteTextures((GLsizei)swapchain->images.size(), swapchain->images.data());
+    }
+    s_session.reset();
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL beginSession(XrSession session, const XrSessionBeginInfo *beginInfo) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (session->isRunning) {
+        return XR_ERROR_SESSION_RUNNING;
+    }
+    if (session->state != XR_SESSION_STATE_READY) {
+        return XR_ERROR_SESSION_NOT_READY;
+    }
+    if (beginInfo->primaryViewConfigurationType != XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) {
+        return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+    }
+
+    session->isRunning = true;
+    queueState(*session, XR_SESSION_STATE_SYNCHRONIZED);
+    queueState(*session, XR_SESSION_STATE_VISIBLE);
+    queueState(*session, XR_SESSION_STATE_FOCUSED);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL endSession(XrSession session) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (!session->isRunning) {
+        return XR_ERROR_SESSION_NOT_RUNNING;
+    }
+    if (session->state != XR_SESSION_STATE_STOPPING) {
+        return XR_ERROR_SESSION_NOT_STOPPING;
+    }
+
+    session->isRunning = false;
+    session->isFrameWaited = false;
+    session->isFrameBegun = false;
+    queueState(*session, XR_SESSION_STATE_IDLE);
+    if (session->isExitRequested) {
+        queueState(*session, XR_SESSION_STATE_EXITING);
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL requestExitSession(XrSession session) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (!session->isRunning) {
+        return XR_ERROR_SESSION_NOT_RUNNING;
+    }
+
+    session->isExitRequested = true;
+    queueState(*session, XR_SESSION_STATE_STOPPING);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL enumerateReferenceSpaces(XrSession session, uint32_t capacity, uint32_t *countOutput, XrReferenceSpaceType *spaces) {
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    static const XrReferenceSpaceType referenceSpaceTypes[] = { XR_REFERENCE_SPACE_TYPE_VIEW, XR_REFERENCE_SPACE_TYPE_LOCAL, XR_REFERENCE_SPACE_TYPE_STAGE };
+    return enumerate(referenceSpaceTypes, 3, capacity, countOutput, spaces);
+}
+
+static XrResult XRAPI_CALL createReferenceSpace(XrSession session, const XrReferenceSpaceCreateInfo *createInfo, XrSpace *space) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    auto referenceSpace = std::make_unique<XrSpace_T>();
+    referenceSpace->kind = XrSpace_T::Kind::REFERENCE;
+    referenceSpace->referenceSpaceType = createInfo->referenceSpaceType;
+    referenceSpace->offset = createInfo->poseInReferenceSpace;
+    // LOCAL starts at eye height, STAGE on the floor
+    if (createInfo->referenceSpaceType == XR_REFERENCE_SPACE_TYPE_LOCAL) {
+        referenceSpace->offset = multiply({ { 0.f, 0.f, 0.f, 1.f }, { 0.f, 1.6f, 0.f } }, referenceSpace->offset);
+    }
+
+    *space = referenceSpace.get();
+    session->spaces.push_back(std::move(referenceSpace));
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getReferenceSpaceBoundsRect(XrSession session, XrReferenceSpaceType type, XrExtent2Df *bounds) {
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (type != XR_REFERENCE_SPACE_TYPE_STAGE) {
+        *bounds = { 0.f, 0.f };
+        return XR_SPACE_BOUNDS_UNAVAILABLE;
+    }
+
+    *bounds = { 3.f, 3.f };
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL createActionSpace(XrSession session, const XrActionSpaceCreateInfo *createInfo, XrSpace *space) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session || !createInfo->action) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (createInfo->action->type != XR_ACTION_TYPE_POSE_INPUT) {
+        return XR_ERROR_ACTION_TYPE_MISMATCH;
+    }
+
+    const std::string *subactionPath = getPathString(*session->instance, createInfo->subactionPath);
+
+    auto actionSpace = std::make_unique<XrSpace_T>();
+    actionSpace->kind = XrSpace_T::Kind::HAND;
+    actionSpace->hand = subactionPath && *subactionPath == "/user/hand/right" ? 1 : 0;
+    actionSpace->offset = createInfo->poseInActionSpace;
+
+    *space = actionSpace.get();
+    session->spaces.push_back(std::move(actionSpace));
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL locateSpace(XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation *location) {
+    if (!space || !baseSpace) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (time <= 0) {
+        return XR_ERROR_TIME_INVALID;
+    }
+
+    location->pose = multiply(invert(getSpacePose(*baseSpace, time)), getSpacePose(*space, time));
+    location->locationFlags = XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT |
+        XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT | XR_SPACE_LOCATION_POSITION_TRACKED_BIT;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroySpace(XrSpace space) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!space || !s_session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    auto &spaces = s_session->spaces;
+    for (auto it = spaces.begin(); it != spaces.end(); ++it) {
+        if (it->get() == space) {
+            spaces.erase(it);
+            return XR_SUCCESS;
+        }
+    }
+    return XR_ERROR_HANDLE_INVALID;
+}
+
+static XrResult XRAPI_CALL enumerateSwapchainFormats(XrSession session, uint32_t capacity, uint32_t *countOutput, int64_t *formats) {
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    return enumerate(SWAPCHAIN_FORMATS, sizeof(SWAPCHAIN_FORMATS) / sizeof(SWAPCHAIN_FORMATS[0]), capacity, countOutput, formats);
+}
+
+static XrResult XRAPI_CALL createSwapchain(XrSession session, const XrSwapchainCreateInfo *createInfo, XrSwapchain *swapchain) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    bool isFormatSupported = false;
+    for (int64_t format : SWAPCHAIN_FORMATS) {
+        isFormatSupported |= format == createInfo->format;
+    }
+    if (!isFormatSupported) {
+        return XR_ERROR_SWAPCHAIN_FORMAT_UNSUPPORTED;
+    }
+    if (!createInfo->width || !createInfo->height || !createInfo->arraySize || createInfo->faceCount != 1) {
+        return XR_ERROR_VALIDATION_FAILURE;
+    }
+
+    auto newSwapchain = std::make_unique<XrSwapchain_T>();
+    newSwapchain->createInfo = *createInfo;
+    newSwapchain->createInfo.next = nullptr;
+    newSwapchain->target = createInfo->arraySize > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    newSwapchain->images.resize(SWAPCHAIN_LENGTH);
+
+    GLenum type;
+    const GLenum pixelFormat = getPixelFormat(createInfo->format, type);
+
+    glGenTextures(SWAPCHAIN_LENGTH, newSwapchain->images.data());
+    for (GLuint image : newSwapchain->images) {
+        glBindTexture(newSwapchain->target, image);
+        glTexParameteri(newSwapchain->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(newSwapchain->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (newSwapchain->target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, (GLint)createInfo->format, createInfo->width, createInfo->height, createInfo->arraySize, 0, pixelFormat, type, nullptr);
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, 0, (GLint)createInfo->format, createInfo->width, createInfo->height, 0, pixelFormat, type, nullptr);
+        }
+    }
+    glBindTexture(newSwapchain->target, 0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteTextures(SWAPCHAIN_LENGTH, newSwapchain->images.data());
+        return XR_ERROR_RUNTIME_FAILURE;
+    }
+
+    *swapchain = newSwapchain.get();
+    session->swapchains.push_back(std::move(newSwapchain));
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroySwapchain(XrSwapchain swapchain) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!swapchain || !s_session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    auto &swapchains = s_session->swapchains;
+    for (auto it = swapchains.begin(); it != swapchains.end(); ++it) {
+        if (it->get() == swapchain) {
+            glDeleteTextures((GLsizei)swapchain->images.size(), swapchain->images.data());
+            swapchains.erase(it);
+            return XR_SUCCESS;
+        }
+    }
+    return XR_ERROR_HANDLE_INVALID;
+}
+
+static XrResult XRAPI_CALL enumerateSwapchainImages(XrSwapchain swapchain, uint32_t capacity, uint32_t *countOutput, XrSwapchainImageBaseHeader *images) {
+    if (!swapchain) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    *countOutput = (uint32_t)swapchain->images.size();
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < swapchain->images.size()) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    XrSwapchainImageOpenGLKHR *openGLImages = reinterpret_cast<XrSwapchainImageOpenGLKHR *>(images);
+    for (size_t i = 0; i < swapchain->images.size(); i++) {
+        if (openGLImages[i].type != XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+        openGLImages[i].image = swapchain->images[i];
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL acquireSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageAcquireInfo *, uint32_t *index) {
+    if (!swapchain) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (swapchain->acquiredCount == swapchain->images.size()) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    *index = swapchain->nextImage;
+    swapchain->nextImage = (swapchain->nextImage + 1) % swapchain->images.size();
+    swapchain->acquiredCount++;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL waitSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageWaitInfo *) {
+    if (!swapchain) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!swapchain->acquiredCount) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    // Nothing composites the images so they're always ready
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL releaseSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageReleaseInfo *) {
+    if (!swapchain) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!swapchain->acquiredCount) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    swapchain->acquiredCount--;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL waitFrame(XrSession session, const XrFrameWaitInfo *, XrFrameState *frameState) {
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    // As the spec has it, the app gets at most one frame ahead of xrBeginFrame no matter how deep it pipelines
+    {
+        std::unique_lock<std::mutex> lock(s_mutex);
+        if (session->isFrameWaited) {
+            session->instance->statistics.blockedWaits++;
+        }
+        s_frameCondition.wait(lock, [session]() {
+            return !session->isFrameWaited || !session->isRunning || getLossResult(*session) != XR_SUCCESS;
+        });
+        if (const XrResult result = getLossResult(*session)) {
+            return result;
+        }
+        if (!session->isRunning) {
+            return XR_ERROR_SESSION_NOT_RUNNING;
+        }
+        session->isFrameWaited = true;
+    }
+
+    const XrInstance_T &instance = *session->instance;
+    const XrDuration period = (XrDuration)(1e9 / instance.config.displayHz);
+
+    // Wake up one period before the next display time that's still ahead, like a compositor would
+    const XrTime time = now(instance);
+    XrTime displayTime = session->lastDisplayTime ? session->lastDisplayTime + period : time + period;
+    if (displayTime - period < time) {
+        if (session->lastDisplayTime) {
+            s_instance->statistics.lateFrames++;
+        }
+        displayTime += (time - (displayTime - period)) / period * period + period;
+    }
+
+    XrDuration jitter = 0;
+    if (instance.config.jitterMilliseconds > 0.) {
+        std::uniform_real_distribution<double> distribution(-instance.config.jitterMilliseconds, instance.config.jitterMilliseconds);
+        jitter = (XrDuration)(distribution(session->random) * 1e6);
+    }
+
+    const XrTime wakeTime = displayTime - period + jitter;
+    if (wakeTime > time) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wakeTime - time));
+    }
+
+    session->lastDisplayTime = displayTime;
+    frameState->predictedDisplayTime = displayTime;
+    frameState->predictedDisplayPeriod = period;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    frameState->shouldRender = session->state == XR_SESSION_STATE_VISIBLE || session->state == XR_SESSION_STATE_FOCUSED;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL beginFrame(XrSession session, const XrFrameBeginInfo *) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (!session->isRunning) {
+        return XR_ERROR_SESSION_NOT_RUNNING;
+    }
+    if (!session->isFrameWaited) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    session->isFrameWaited = false;
+    s_frameCondition.notify_all();
+    const bool isDiscarded = session->isFrameBegun;
+    session->isFrameBegun = true;
+    return isDiscarded ? XR_FRAME_DISCARDED : XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL endFrame(XrSession session, const XrFrameEndInfo *frameEndInfo) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (!session->isFrameBegun) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+    if (frameEndInfo->displayTime <= 0) {
+        return XR_ERROR_TIME_INVALID;
+    }
+    session->isFrameBegun = false;
+
+    Statistics &statistics = session->instance->statistics;
+    statistics.frames++;
+    for (uint32_t i = 0; i < frameEndInfo->layerCount; i++) {
+        const XrCompositionLayerBaseHeader *layer = frameEndInfo->layers[i];
+        if (!layer || layer->type != XR_TYPE_COMPOSITION_LAYER_PROJECTION) {
+            return XR_ERROR_LAYER_INVALID;
+        }
+
+        const XrCompositionLayerProjection *projectionLayer = reinterpret_cast<const XrCompositionLayerProjection *>(layer);
+        if (projectionLayer->viewCount != VIEW_COUNT) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+        statistics.projectionLayers++;
+
+        for (uint32_t j = 0; j < projectionLayer->viewCount; j++) {
+            const XrCompositionLayerProjectionView &view = projectionLayer->views[j];
+            if (!view.subImage.swapchain || view.subImage.imageArrayIndex >= view.subImage.swapchain->createInfo.arraySize) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            for (const XrBaseInStructure *next = reinterpret_cast<const XrBaseInStructure *>(view.next); next; next = next->next) {
+                if (next->type == XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR) {
+                    statistics.depthInfos++;
+                }
+            }
+        }
+    }
+
+    // The frame still counts, only the calls after it fail
+    loseOnFrame(*session);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL locateViews(XrSession session, const XrViewLocateInfo *locateInfo, XrViewState *viewState, uint32_t capacity, uint32_t *countOutput, XrView *views) {
+    if (!session || !locateInfo->space) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (locateInfo->viewConfigurationType != XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) {
+        return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+    }
+    if (locateInfo->displayTime <= 0) {
+        return XR_ERROR_TIME_INVALID;
+    }
+
+    *countOutput = VIEW_COUNT;
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < VIEW_COUNT) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    const XrPosef head = multiply(invert(getSpacePose(*locateInfo->space, locateInfo->displayTime)), getHeadPose(locateInfo->displayTime));
+    for (uint32_t i = 0; i < VIEW_COUNT; i++) {
+        const float side = i == 0 ? -1.f : 1.f;
+        views[i].pose = multiply(head, { { 0.f, 0.f, 0.f, 1.f }, { side * EYE_OFFSET, 0.f, 0.f } });
+        // A bit more to the outside than to the nose, like most headsets
+        views[i].fov = {
+            i == 0 ? -0.87f : -0.78f,
+            i == 0 ? 0.78f : 0.87f,
+            0.82f,
+            -0.86f
+        };
+    }
+
+    viewState->viewStateFlags = XR_VIEW_STATE_ORIENTATION_VALID_BIT | XR_VIEW_STATE_POSITION_VALID_BIT |
+        XR_VIEW_STATE_ORIENTATION_TRACKED_BIT | XR_VIEW_STATE_POSITION_TRACKED_BIT;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL stringToPath(XrInstance instance, const char *pathString, XrPath *path) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!pathString || pathString[0] != '/' || strlen(pathString) >= XR_MAX_PATH_LENGTH) {
+        return XR_ERROR_PATH_FORMAT_INVALID;
+    }
+
+    *path = getPath(*instance, pathString);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL pathToString(XrInstance instance, XrPath path, uint32_t capacity, uint32_t *countOutput, char *buffer) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    const std::string *pathString = getPathString(*instance, path);
+    if (!pathString) {
+        return XR_ERROR_PATH_INVALID;
+    }
+
+    *countOutput = (uint32_t)pathString->size() + 1;
+    if (!capacity) {
+        return XR_SUCCESS;
+    }
+    if (capacity < *countOutput) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+
+    memcpy(buffer, pathString->c_str(), *countOutput);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL createActionSet(XrInstance instance, const XrActionSetCreateInfo *createInfo, XrActionSet *actionSet) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!createInfo->actionSetName[0]) {
+        return XR_ERROR_NAME_INVALID;
+    }
+
+    auto newActionSet = std::make_unique<XrActionSet_T>();
+    newActionSet->instance = instance;
+    newActionSet->name = createInfo->actionSetName;
+
+    *actionSet = newActionSet.get();
+    instance->actionSets.push_back(std::move(newActionSet));
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroyActionSet(XrActionSet actionSet) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!actionSet || !s_instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    auto &actionSets = s_instance->actionSets;
+    for (auto it = actionSets.begin(); it != actionSets.end(); ++it) {
+        if (it->get() == actionSet) {
+            actionSets.erase(it);
+            return XR_SUCCESS;
+        }
+    }
+    return XR_ERROR_HANDLE_INVALID;
+}
+
+static XrResult XRAPI_CALL createAction(XrActionSet actionSet, const XrActionCreateInfo *createInfo, XrAction *action) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!actionSet) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!createInfo->actionName[0]) {
+        return XR_ERROR_NAME_INVALID;
+    }
+    for (const auto &existingAction : actionSet->actions) {
+        if (existingAction->name == createInfo->actionName) {
+            return XR_ERROR_NAME_DUPLICATED;
+        }
+    }
+
+    auto newAction = std::make_unique<XrAction_T>();
+    newAction->actionSet = actionSet;
+    newAction->name = createInfo->actionName;
+    newAction->type = createInfo->actionType;
+
+    *action = newAction.get();
+    actionSet->actions.push_back(std::move(newAction));
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL destroyAction(XrAction action) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!action) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    auto &actions = action->actionSet->actions;
+    for (auto it = actions.begin(); it != actions.end(); ++it) {
+        if (it->get() == action) {
+            actions.erase(it);
+            return XR_SUCCESS;
+        }
+    }
+    return XR_ERROR_HANDLE_INVALID;
+}
+
+static XrResult XRAPI_CALL suggestInteractionProfileBindings(XrInstance instance, const XrInteractionProfileSuggestedBinding *suggestedBindings) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!instance) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+
+    // Whatever profile gets suggested is the one that's "connected"
+    for (uint32_t i = 0; i < suggestedBindings->countSuggestedBindings; i++) {
+        const XrActionSuggestedBinding &binding = suggestedBindings->suggestedBindings[i];
+        const std::string *path = getPathString(*instance, binding.binding);
+        if (!binding.action || !path) {
+            return XR_ERROR_PATH_INVALID;
+        }
+        binding.action->bindings.push_back(*path);
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL attachSessionActionSets(XrSession session, const XrSessionActionSetsAttachInfo *) {
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL syncActions(XrSession session, const XrActionsSyncInfo *) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!session) {
+        return XR_ERROR_HANDLE_INVALID;
+    }
+    if (const XrResult result = getLossResult(*session)) {
+        return result;
+    }
+    if (session->state != XR_SESSION_STATE_FOCUSED) {
+        return XR_SESSION_NOT_FOCUSED;
+    }
+
+    session->syncIndex++;
+    session->syncTime = now(*session->instance);
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getActionStateBoolean(XrSession session, const XrActionStateGetInfo *getInfo, XrActionStateBoolean *state) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    InputState inputState;
+    const XrResult result = getInputState(session, getInfo, XR_ACTION_TYPE_BOOLEAN_INPUT, inputState);
+    if (result != XR_SUCCESS) {
+        return result;
+    }
+
+    state->currentState = inputState.current != 0.f;
+    state->changedSinceLastSync = (inputState.current != 0.f) != (inputState.previous != 0.f);
+    state->lastChangeTime = session->syncTime;
+    state->isActive = inputState.isActive;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getActionStateFloat(XrSession session, const XrActionStateGetInfo *getInfo, XrActionStateFloat *state) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    InputState inputState;
+    const XrResult result = getInputState(session, getInfo, XR_ACTION_TYPE_FLOAT_INPUT, inputState);
+    if (result != XR_SUCCESS) {
+        return result;
+    }
+
+    state->currentState = inputState.current;
+    state->changedSinceLastSync = inputState.current != inputState.previous;
+    state->lastChangeTime = session->syncTime;
+    state->isActive = inputState.isActive;
+    return XR_SUCCESS;
+}
+
+static XrResult XRAPI_CALL getActionStatePose(XrSession session, const XrActionStateGetInfo *getInfo, XrActionStatePose *state) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    InputState inputState;
+    const XrResult result = getInputState(session, getInfo, XR_ACTION_TYPE_POSE_INPUT, inputState);
+    if (result != XR_SUCCESS) {
+        return result;
+    }
+
+    state->isActive = inputState.isActive;
+    return XR_SUCCESS;
+}
+
+
+typedef struct Function {
+    const char *name;
+    PFN_xrVoidFunction function;
+} Function;
+
+#define MOCK_FUNCTION(name, function) { name, reinterpret_cast<PFN_xrVoidFunction>(function) }
+
+static const Function FUNCTIONS[] = {
+    MOCK_FUNCTION("xrGetInstanceProcAddr", getInstanceProcAddr),
+    MOCK_FUNCTION("xrEnumerateInstanceExtensionProperties", enumerateInstanceExtensionProperties),
+    MOCK_FUNCTION("xrCreateInstance", createInstance),
+    MOCK_FUNCTION("xrDestroyInstance", destroyInstance),
+    MOCK_FUNCTION("xrGetInstanceProperties", getInstanceProperties),
+    MOCK_FUNCTION("xrPollEvent", pollEvent),
+    MOCK_FUNCTION("xrResultToString", resultToString),
+    MOCK_FUNCTION("xrStructureTypeToString", structureTypeToString),
+    MOCK_FUNCTION("xrGetSystem", getSystem),
+    MOCK_FUNCTION("xrGetSystemProperties", getSystemProperties),
+    MOCK_FUNCTION("xrEnumerateEnvironmentBlendModes", enumerateEnvironmentBlendModes),
+    MOCK_FUNCTION("xrEnumerateViewConfigurations", enumerateViewConfigurations),
+    MOCK_FUNCTION("xrEnumerateViewConfigurationViews", enumerateViewConfigurationViews),
+    MOCK_FUNCTION("xrGetOpenGLGraphicsRequirementsKHR", getOpenGLGraphicsRequirements),
+    MOCK_FUNCTION("xrCreateSession", createSession),
+    MOCK_FUNCTION("xrDestroySession", destroySession),
+    MOCK_FUNCTION("xrBeginSession", beginSession),
+    MOCK_FUNCTION("xrEndSession", endSession),
+    MOCK_FUNCTION("xrRequestExitSession", requestExitSession),
+    MOCK_FUNCTION("xrEnumerateReferenceSpaces", enumerateReferenceSpaces),
+    MOCK_FUNCTION("xrCreateReferenceSpace", createReferenceSpace),
+    MOCK_FUNCTION("xrGetReferenceSpaceBoundsRect", getReferenceSpaceBoundsRect),
+    MOCK_FUNCTION("xrCreateActionSpace", createActionSpace),
+    MOCK_FUNCTION("xrLocateSpace", locateSpace),
+    MOCK_FUNCTION("xrDestroySpace", destroySpace),
+    MOCK_FUNCTION("xrEnumerateSwapchainFormats", enumerateSwapchainFormats),
+    MOCK_FUNCTION("xrCreateSwapchain", createSwapchain),
+    MOCK_FUNCTION("xrDestroySwapchain", destroySwapchain),
+    MOCK_FUNCTION("xrEnumerateSwapchainImages", enumerateSwapchainImages),
+    MOCK_FUNCTION("xrAcquireSwapchainImage", acquireSwapchainImage),
+    MOCK_FUNCTION("xrWaitSwapchainImage", waitSwapchainImage),
+    MOCK_FUNCTION("xrReleaseSwapchainImage", releaseSwapchainImage),
+    MOCK_FUNCTION("xrWaitFrame", waitFrame),
+    MOCK_FUNCTION("xrBeginFrame", beginFrame),
+    MOCK_FUNCTION("xrEndFrame", endFrame),
+    MOCK_FUNCTION("xrLocateViews", locateViews),
+    MOCK_FUNCTION("xrStringToPath", stringToPath),
+    MOCK_FUNCTION("xrPathToString", pathToString),
+    MOCK_FUNCTION("xrCreateActionSet", createActionSet),
+    MOCK_FUNCTION("xrDestroyActionSet", destroyActionSet),
+    MOCK_FUNCTION("xrCreateAction", createAction),
+    MOCK_FUNCTION("xrDestroyAction", destroyAction),
+    MOCK_FUNCTION("xrSuggestInteractionProfileBindings", suggestInteractionProfileBindings),
+    MOCK_FUNCTION("xrAttachSessionActionSets", attachSessionActionSets),
+    MOCK_FUNCTION("xrSyncActions", syncActions),
+    MOCK_FUNCTION("xrGetActionStateBoolean", getActionStateBoolean),
+    MOCK_FUNCTION("xrGetActionStateFloat", getActionStateFloat),
+    MOCK_FUNCTION("xrGetActionStatePose", getActionStatePose)
+};
+
+static XrResult XRAPI_CALL getInstanceProcAddr(XrInstance instance, const char *name, PFN_xrVoidFunction *function) {
+    if (!name || !function) {
+        return XR_ERROR_VALIDATION_FAILURE;
+    }
+
+    for (const Function &entry : FUNCTIONS) {
+        if (strcmp(entry.name, name) == 0) {
+            // Only these work without an instance
+            if (!instance && strcmp(name, "xrEnumerateInstanceExtensionProperties") != 0 && strcmp(name, "xrCreateInstance") != 0 &&
+                strcmp(name, "xrGetInstanceProcAddr") != 0) {
+                *function = nullptr;
+                return XR_ERROR_HANDLE_INVALID;
+            }
+
+            *function = entry.function;
+            return XR_SUCCESS;
+        }
+    }
+
+    *function = nullptr;
+    return XR_ERROR_FUNCTION_UNSUPPORTED;
+}
+
+extern "C" MOCK_EXPORT XrResult XRAPI_CALL xrNegotiateLoaderRuntimeInterface(const XrNegotiateLoaderInfo *loaderInfo, XrNegotiateRuntimeRequest *runtimeRequest) {
+    if (!loaderInfo || !runtimeRequest ||
+        loaderInfo->structType != XR_LOADER_INTERFACE_STRUCT_LOADER_INFO || loaderInfo->structVersion != XR_LOADER_INFO_STRUCT_VERSION ||
+        loaderInfo->structSize != sizeof(XrNegotiateLoaderInfo) ||
+        runtimeRequest->structType != XR_LOADER_INTERFACE_STRUCT_RUNTIME_REQUEST || runtimeRequest->structVersion != XR_RUNTIME_INFO_STRUCT_VERSION ||
+        runtimeRequest->structSize != sizeof(XrNegotiateRuntimeRequest) ||
+        loaderInfo->minInterfaceVersion > XR_CURRENT_LOADER_RUNTIME_VERSION || loaderInfo->maxInterfaceVersion < XR_CURRENT_LOADER_RUNTIME_VERSION) {
+        return XR_ERROR_INITIALIZATION_FAILED;
+    }
+
+    runtimeRequest->runtimeInterfaceVersion = XR_CURRENT_LOADER_RUNTIME_VERSION;
+    runtimeRequest->runtimeApiVersion = XR_CURRENT_API_VERSION;
+    runtimeRequest->getInstanceProcAddr = getInstanceProcAddr;
+    return XR_SUCCESS;
+}